@@ -39,6 +39,7 @@ extern "C" {
 //! CFPreferencesCopyAppValue() wrapper which checks the type of the value returned
 CFPropertyListRef CopyPreferencesValueTyped(CFStringRef key, CFTypeID type) CF_RETURNS_RETAINED;
 
+//! Cached by PostScript name; safe to call from any thread.
 extern CGFloat GetWinCTFontSizeScale(CTFontRef font);
 
 #define PERIAN_PREF_DOMAIN CFSTR("org.perian.Perian")
@@ -19,6 +19,13 @@ FOUNDATION_EXPORT const unsigned char SSAMacRenderingVersionString[];
 #import <SSAMacRendering/SubUtilities.h>
 #import <SSAMacRendering/SubImport.h>
 #import <SSAMacRendering/SubRenderer.h>
+#import <SSAMacRendering/SubTimeline.h>
+#import <SSAMacRendering/SubKaraoke.h>
+#import <SSAMacRendering/SubPreroll.h>
+#import <SSAMacRendering/SubRenderAhead.h>
+#import <SSAMacRendering/VobSubDecoder.h>
+#import <SSAMacRendering/SubYUVBlend.h>
+#import <SSAMacRendering/SubShapeCache.h>
 #include <SSAMacRendering/CommonUtils.h>
 
 #import <SSAMacRendering/SubCoreTextRenderer.h>
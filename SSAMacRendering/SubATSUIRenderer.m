@@ -637,9 +637,20 @@ enum {renderMultipleParts = 1, // call ATSUDrawText more than once, needed for c
 			}
 			break;
 		case tag_be:
-			bv();
+			fv();
 			if (!isFirstSpan) div->render_complexity |= renderMultipleParts; //FIXME: blur edges
-			spanEx->blurEdges = bval;
+			spanEx->blurEdges = fval > 0;
+			break;
+		case tag_blur:
+			fv();
+			if (!isFirstSpan) div->render_complexity |= renderMultipleParts; //FIXME: gaussian blur
+			spanEx->blurEdges = fval > 0;
+			break;
+		case tag_xbord:
+		case tag_ybord:
+			fv();
+			if (!isFirstSpan) div->render_complexity |= renderMultipleParts;
+			spanEx->outlineRadius = MAX(fval, 0); //FIXME: outlines are stroked the same width both ways
 			break;
 		case tag_p:
 			fv();
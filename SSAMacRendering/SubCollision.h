@@ -0,0 +1,54 @@
+//
+//  SubCollision.h
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "SubContext.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+//! One unpositioned div to be placed by <code>-[SubCollisionResolver resolveItems:count:]</code>.
+typedef struct SubCollisionItem {
+	NSInteger key;			//!< The event's ReadOrder, or -1 if it doesn't have one.
+	int32_t layer;
+	SubAlignmentV alignV;
+	CGFloat minY, maxY;		//!< The vertical margins the div is placed between, y going up.
+	CGFloat height;			//!< The height of the div's lines, with outlines.
+	CGFloat y;				//!< Out: the bottom edge of the placed div.
+} SubCollisionItem;
+
+/**
+ * @brief Keeps subtitle events that are on screen at the same time from overlapping.
+ *
+ * @discussion Each layer and vertical alignment is its own group, holding a sorted
+ * list of the vertical intervals that are already taken. A div is placed at its margin
+ * and then moved away from it, past the intervals it would overlap.
+ *
+ * With \c kSubCollisionsNormal, an event that was placed in the previous packet keeps its
+ * spot if it still fits, so lines don't move when unrelated events start or end.
+ * With \c kSubCollisionsReverse, newer events take the spot nearest the margin and
+ * push the older ones away.
+ *
+ * Positioned divs aren't handled here, and don't take up space: VSFilter never moves
+ * lines out of the way of a <code>\\pos</code>.
+ */
+@interface SubCollisionResolver : NSObject
+
+- (instancetype)initWithCollisions:(SubCollisions)collisions NS_DESIGNATED_INITIALIZER;
+- (instancetype)init UNAVAILABLE_ATTRIBUTE;
+
+@property (readonly) SubCollisions collisions;
+
+/// Places every item of one packet, and remembers the placements for the next call.
+- (void)resolveItems:(SubCollisionItem *)items count:(NSUInteger)count;
+
+/// Forgets the previous placements, e.g. after seeking.
+- (void)reset;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,252 @@
+//
+//  SubCollision.m
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#import "SubCollision.h"
+
+//! A taken vertical interval. Intervals in a group are sorted, and touching ones are merged.
+typedef struct SubInterval {
+	CGFloat lo, hi;
+} SubInterval;
+
+//! Where an event was placed in the previous packet.
+typedef struct SubCollisionRecord {
+	NSInteger key;
+	int64_t group;
+	CGFloat y, height;
+} SubCollisionRecord;
+
+typedef struct SubPlacementOrder {
+	NSUInteger index;
+	int64_t group;
+	NSInteger key;
+	const SubCollisionRecord *previous;
+} SubPlacementOrder;
+
+static int64_t GroupForItem(const SubCollisionItem *item)
+{
+	return ((int64_t)item->layer << 2) | item->alignV;
+}
+
+static int CompareNormalOrder(const void *a, const void *b)
+{
+	const SubPlacementOrder *oa = a, *ob = b;
+
+	if (oa->group != ob->group) return oa->group < ob->group ? -1 : 1;
+	// events that were already on screen go first, so they can stay where they are
+	if (!oa->previous != !ob->previous) return oa->previous ? -1 : 1;
+	if (oa->key != ob->key) return oa->key < ob->key ? -1 : 1;
+	return oa->index < ob->index ? -1 : (oa->index > ob->index);
+}
+
+static int CompareReverseOrder(const void *a, const void *b)
+{
+	const SubPlacementOrder *oa = a, *ob = b;
+
+	if (oa->group != ob->group) return oa->group < ob->group ? -1 : 1;
+	if (oa->key != ob->key) return oa->key > ob->key ? -1 : 1;
+	return oa->index < ob->index ? -1 : (oa->index > ob->index);
+}
+
+static int CompareRecords(const void *a, const void *b)
+{
+	const SubCollisionRecord *ra = a, *rb = b;
+
+	return ra->key < rb->key ? -1 : (ra->key > rb->key);
+}
+
+static const SubCollisionRecord *FindRecord(const SubCollisionRecord *records, NSUInteger count, NSInteger key)
+{
+	NSUInteger lo = 0, hi = count;
+
+	while (lo < hi) {
+		NSUInteger mid = lo + (hi - lo) / 2;
+		if (records[mid].key < key) lo = mid + 1;
+		else hi = mid;
+	}
+
+	return (lo < count && records[lo].key == key) ? &records[lo] : NULL;
+}
+
+//! Returns the index of the first interval ending above \c y.
+static NSUInteger FirstIntervalAbove(const SubInterval *intervals, NSUInteger count, CGFloat y)
+{
+	NSUInteger lo = 0, hi = count;
+
+	while (lo < hi) {
+		NSUInteger mid = lo + (hi - lo) / 2;
+		if (intervals[mid].hi <= y) lo = mid + 1;
+		else hi = mid;
+	}
+
+	return lo;
+}
+
+//! Returns the number of intervals starting below \c y.
+static NSUInteger CountIntervalsBelow(const SubInterval *intervals, NSUInteger count, CGFloat y)
+{
+	NSUInteger lo = 0, hi = count;
+
+	while (lo < hi) {
+		NSUInteger mid = lo + (hi - lo) / 2;
+		if (intervals[mid].lo < y) lo = mid + 1;
+		else hi = mid;
+	}
+
+	return lo;
+}
+
+static BOOL IntervalIsFree(const SubInterval *intervals, NSUInteger count, CGFloat y, CGFloat height)
+{
+	NSUInteger i = FirstIntervalAbove(intervals, count, y);
+
+	return i == count || intervals[i].lo >= y + height;
+}
+
+static CGFloat PlaceMovingUp(const SubInterval *intervals, NSUInteger count, CGFloat y, CGFloat height)
+{
+	NSUInteger i = FirstIntervalAbove(intervals, count, y);
+
+	for (; i < count && intervals[i].lo < y + height; i++)
+		y = intervals[i].hi;
+
+	return y;
+}
+
+static CGFloat PlaceMovingDown(const SubInterval *intervals, NSUInteger count, CGFloat top, CGFloat height)
+{
+	NSUInteger i = CountIntervalsBelow(intervals, count, top);
+
+	for (; i > 0 && intervals[i-1].hi > top - height; i--)
+		top = intervals[i-1].lo;
+
+	return top - height;
+}
+
+@implementation SubCollisionResolver
+{
+	SubInterval *intervals;
+	NSUInteger intervalCount, intervalCapacity;
+	SubCollisionRecord *records;
+	NSUInteger recordCount;
+}
+@synthesize collisions;
+
+- (instancetype)initWithCollisions:(SubCollisions)c
+{
+	if (self = [super init]) {
+		collisions = c;
+	}
+
+	return self;
+}
+
+- (void)dealloc
+{
+	free(intervals);
+	free(records);
+}
+
+- (void)reset
+{
+	free(records);
+	records = NULL;
+	recordCount = 0;
+}
+
+//! Marks <code>[y, y+height)</code> as taken, merging it with the intervals it touches.
+- (void)takeInterval:(CGFloat)y height:(CGFloat)height
+{
+	CGFloat lo = y, hi = y + height;
+
+	if (height <= 0) return;
+
+	NSUInteger first = FirstIntervalAbove(intervals, intervalCount, lo), last;
+
+	if (first > 0 && intervals[first-1].hi == lo) first--;
+
+	for (last = first; last < intervalCount && intervals[last].lo <= hi; last++) {
+		lo = MIN(lo, intervals[last].lo);
+		hi = MAX(hi, intervals[last].hi);
+	}
+
+	if (first == last) {
+		if (intervalCount == intervalCapacity) {
+			intervalCapacity = intervalCapacity ? intervalCapacity * 2 : 16;
+			intervals = reallocf(intervals, intervalCapacity * sizeof(SubInterval));
+		}
+		memmove(&intervals[first+1], &intervals[first], (intervalCount - first) * sizeof(SubInterval));
+		intervalCount++;
+	} else if (last - first > 1) {
+		memmove(&intervals[first+1], &intervals[last], (intervalCount - last) * sizeof(SubInterval));
+		intervalCount -= last - first - 1;
+	}
+
+	intervals[first] = (SubInterval){lo, hi};
+}
+
+- (void)resolveItems:(SubCollisionItem *)items count:(NSUInteger)count
+{
+	SubPlacementOrder *order = malloc(MAX(count, 1) * sizeof(SubPlacementOrder));
+	SubCollisionRecord *newRecords = malloc(MAX(count, 1) * sizeof(SubCollisionRecord));
+	NSUInteger newRecordCount = 0;
+	BOOL reverse = collisions == kSubCollisionsReverse;
+
+	for (NSUInteger i = 0; i < count; i++) {
+		const SubCollisionItem *item = &items[i];
+		const SubCollisionRecord *previous = NULL;
+		int64_t group = GroupForItem(item);
+
+		if (!reverse && item->key >= 0) {
+			previous = FindRecord(records, recordCount, item->key);
+			if (previous && (previous->group != group || fabs(previous->height - item->height) >= .5))
+				previous = NULL;
+		}
+
+		order[i] = (SubPlacementOrder){i, group, item->key, previous};
+	}
+
+	qsort(order, count, sizeof(SubPlacementOrder), reverse ? CompareReverseOrder : CompareNormalOrder);
+
+	for (NSUInteger i = 0; i < count; i++) {
+		SubCollisionItem *item = &items[order[i].index];
+		const SubCollisionRecord *previous = order[i].previous;
+
+		if (i == 0 || order[i].group != order[i-1].group) intervalCount = 0;
+
+		if (previous && IntervalIsFree(intervals, intervalCount, previous->y, item->height)) {
+			item->y = previous->y;
+		} else switch (item->alignV) {
+			case kSubAlignmentBottom: default:
+				item->y = PlaceMovingUp(intervals, intervalCount, item->minY, item->height);
+				break;
+			case kSubAlignmentMiddle:
+				item->y = PlaceMovingUp(intervals, intervalCount, (item->minY + item->maxY - item->height) / 2, item->height);
+				break;
+			case kSubAlignmentTop:
+				item->y = PlaceMovingDown(intervals, intervalCount, item->maxY, item->height);
+				break;
+		}
+
+		[self takeInterval:item->y height:item->height];
+
+		if (item->key >= 0)
+			newRecords[newRecordCount++] = (SubCollisionRecord){item->key, order[i].group, item->y, item->height};
+	}
+
+	qsort(newRecords, newRecordCount, sizeof(SubCollisionRecord), CompareRecords);
+	free(records);
+	records = newRecords;
+	recordCount = newRecordCount;
+
+	free(order);
+}
+
+@end
@@ -128,7 +128,13 @@ extern NSString * const kSubDefaultFontName;
 
 - (instancetype)initWithScriptType:(SubType)type headers:(nullable NSDictionary<NSString*,NSString*> *)headers styles:(nullable NSArray<NSDictionary<NSString*,NSString*>*> *)styles delegate:(nullable id<SubRenderer>)delegate;
 -(SubStyle*)styleForName:(NSString *)name;
+//! Looks up a style by name without making a string. Returns the default style if there isn't one.
+-(SubStyle*)styleForCharacters:(const unichar *)name length:(NSUInteger)length;
+//! Returns the index of the named style in \c styleList, or \c NSNotFound.
+-(NSInteger)styleIDForCharacters:(const unichar *)name length:(NSUInteger)length;
 @property (readonly, copy) NSDictionary<NSString*,SubStyle*> *styles;
+//! The script's styles in the order they were defined. Style IDs index into this.
+@property (readonly, copy) NSArray<SubStyle*> *styleList;
 @property (readonly, copy) NSDictionary<NSString*,NSString*> *headers;
 @end
 
@@ -165,7 +165,32 @@ static NSString *ColorString(SubRGBAColor *c)
 
 @end
 
+//! One entry of the style name hash table; an empty slot has a \c styleID of -1.
+typedef struct SubStyleSlot {
+	uint32_t hash;
+	int32_t styleID;
+} SubStyleSlot;
+
+static uint32_t SubHashCharacters(const unichar *chars, NSUInteger length)
+{
+	uint32_t h = 2166136261U;
+	
+	for (NSUInteger i = 0; i < length; i++) {
+		h ^= chars[i];
+		h *= 16777619U;
+	}
+	
+	return h;
+}
+
 @implementation SubContext
+{
+	NSMutableArray<SubStyle*> *styleList;
+	NSMutableData *styleNameChars;	//!< every style name's characters, back to back
+	NSMutableData *styleNameRanges;	//!< NSRange into styleNameChars, by style ID
+	SubStyleSlot *styleTable;
+	NSUInteger styleTableMask;
+}
 @synthesize resX;
 @synthesize resY;
 @synthesize styles;
@@ -234,6 +259,7 @@ BOOL IsScriptASS(NSDictionary *headers)
 			}
 			
 			defaultStyle = [styles objectForKey:@"Default"];
+			[self internStyles:stylesArray];
 		}
 		
 		if (!defaultStyle)
@@ -243,6 +269,81 @@ BOOL IsScriptASS(NSDictionary *headers)
 	return self;
 }
 
+-(void)dealloc
+{
+	free(styleTable);
+}
+
+//! Gives each style name a small integer ID and builds a hash table over the names' characters.
+-(void)internStyles:(NSArray<NSDictionary<NSString*,NSString*>*> *)stylesArray
+{
+	NSUInteger tableSize = 8;
+	
+	while (tableSize < [styles count] * 2) tableSize *= 2;
+	
+	styleList = [[NSMutableArray alloc] initWithCapacity:[styles count]];
+	styleNameChars = [[NSMutableData alloc] init];
+	styleNameRanges = [[NSMutableData alloc] init];
+	styleTableMask = tableSize - 1;
+	styleTable = malloc(tableSize * sizeof(SubStyleSlot));
+	for (NSUInteger i = 0; i < tableSize; i++) styleTable[i].styleID = -1;
+	
+	// same order and duplicate handling as the styles dictionary
+	for (NSDictionary<NSString*,NSString*> *style in stylesArray) {
+		NSString *name = [style objectForKey:@"Name"];
+		if ([name length] && [name characterAtIndex:0]=='*')
+			name = [name substringFromIndex:1];
+		
+		NSUInteger length = [name length];
+		unichar chars[length ? length : 1];
+		[name getCharacters:chars range:NSMakeRange(0, length)];
+		
+		if ([self styleIDForCharacters:chars length:length] != NSNotFound) continue;
+		
+		SubStyle *sstyle = [styles objectForKey:name];
+		NSRange range = NSMakeRange([styleNameChars length] / sizeof(unichar), length);
+		uint32_t hash = SubHashCharacters(chars, length);
+		NSUInteger slot = hash & styleTableMask;
+		
+		while (styleTable[slot].styleID != -1) slot = (slot + 1) & styleTableMask;
+		styleTable[slot] = (SubStyleSlot){hash, (int32_t)[styleList count]};
+		
+		[styleNameChars appendBytes:chars length:length * sizeof(unichar)];
+		[styleNameRanges appendBytes:&range length:sizeof(range)];
+		[styleList addObject:sstyle];
+	}
+}
+
+-(NSArray<SubStyle*> *)styleList
+{
+	return styleList ? [styleList copy] : @[];
+}
+
+-(NSInteger)styleIDForCharacters:(const unichar *)name length:(NSUInteger)length
+{
+	if (!styleTable) return NSNotFound;
+	
+	const unichar *allNames = [styleNameChars bytes];
+	const NSRange *ranges = [styleNameRanges bytes];
+	uint32_t hash = SubHashCharacters(name, length);
+	
+	for (NSUInteger slot = hash & styleTableMask; styleTable[slot].styleID != -1; slot = (slot + 1) & styleTableMask) {
+		SubStyleSlot s = styleTable[slot];
+		NSRange r = ranges[s.styleID];
+		
+		if (s.hash == hash && r.length == length && !memcmp(allNames + r.location, name, length * sizeof(unichar)))
+			return s.styleID;
+	}
+	
+	return NSNotFound;
+}
+
+-(SubStyle*)styleForCharacters:(const unichar *)name length:(NSUInteger)length
+{
+	NSInteger styleID = [self styleIDForCharacters:name length:length];
+	return styleID != NSNotFound ? [styleList objectAtIndex:styleID] : defaultStyle;
+}
+
 -(SubStyle*)styleForName:(NSString *)name
 {
 	SubStyle *sty = [styles objectForKey:name];
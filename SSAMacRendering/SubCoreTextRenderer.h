@@ -12,6 +12,25 @@
 
 NS_ASSUME_NONNULL_BEGIN
 
+//! The images of one rendered packet, back to front. Their masks live as long as the list.
+@interface SubRenderImageList : NSObject
+@property (readonly) NSUInteger count;
+@property (readonly, nullable) const SubRenderImage *images NS_RETURNS_INNER_POINTER;
+//! Total size of the masks in bytes, which is about what compositing the list reads.
+@property (readonly) size_t maskBytes;
+@end
+
+/**
+ * Renders subtitles with CoreText.
+ *
+ * @discussion Packets are laid out at the video size the renderer was created with, and recently drawn
+ * layouts are kept, so drawing a packet at several output sizes only breaks its lines once. Divs are
+ * still placed each time, so collisions follow what was drawn before.
+ * Every size gets the same line breaks and glyph positions, scaled. Glyphs aren't snapped to the pixel grid
+ * of each output, so small sizes can look slightly softer than with a renderer created at that size: the ink
+ * of a packet stays within 2 pixels or 1% of the output size of where that renderer puts it, and its total
+ * coverage within 5%.
+ */
 @interface SubCoreTextRenderer : NSObject <SubRenderer>
 
 /** 
@@ -56,6 +75,41 @@ NS_ASSUME_NONNULL_BEGIN
 
 -(void)spanChangedTag:(SubSSATagName)tag span:(SubRenderSpan*)span div:(SubRenderDiv*)div param:(void*)p;
 
+/**
+ * Renders a packet with its karaoke lines highlighted as of \c karaokeTime.
+ *
+ * @discussion \c karaokeTime is in milliseconds from the start of the karaoke event, and is used for
+ * every line of the packet, so this is only right for packets with a single karaoke event. Pass -1 to draw
+ * karaoke lines unhighlighted, which is what <code>-renderPacket:inContext:size:</code> does.
+ */
+-(void)renderPacket:(NSString *)packet inContext:(CGContextRef)c size:(CGSize)size karaokeTime:(NSInteger)karaokeTime NS_SWIFT_NAME(render(packet:in:size:karaokeTime:));
+
+/**
+ * Renders a packet with each karaoke line highlighted as of \c time into its own event.
+ *
+ * @discussion \c time is when the packet is shown, in units of <code>1/timeScale</code> seconds like the packet's
+ * times, and \c eventBeginTimes is <code>-[SubLine eventBeginTimes]</code> of the packet. Lines without a begin time
+ * and negative times draw karaoke unhighlighted.
+ */
+-(void)renderPacket:(NSString *)packet eventBeginTimes:(nullable NSArray<NSNumber*> *)eventBeginTimes inContext:(CGContextRef)c size:(CGSize)size time:(NSInteger)time timeScale:(NSUInteger)timeScale NS_SWIFT_NAME(render(packet:eventBeginTimes:in:size:time:timeScale:));
+
+/**
+ * Renders a packet as separate fill, outline and shadow masks, each bounded to the ink of one span.
+ *
+ * @discussion Nothing is drawn for the empty parts of the frame, so a host that composites or uploads
+ * the images itself only pays for the area covered by subtitles. \c karaokeTime is as in
+ * <code>-renderPacket:inContext:size:karaokeTime:</code>.
+ */
+-(SubRenderImageList *)imagesForPacket:(NSString *)packet size:(CGSize)size karaokeTime:(NSInteger)karaokeTime NS_SWIFT_NAME(images(packet:size:karaokeTime:));
+//! Same as <code>-imagesForPacket:size:karaokeTime:</code>, timing karaoke as <code>-renderPacket:eventBeginTimes:inContext:size:time:timeScale:</code> does.
+-(SubRenderImageList *)imagesForPacket:(NSString *)packet eventBeginTimes:(nullable NSArray<NSNumber*> *)eventBeginTimes size:(CGSize)size time:(NSInteger)time timeScale:(NSUInteger)timeScale NS_SWIFT_NAME(images(packet:eventBeginTimes:size:time:timeScale:));
+
+/// Forgets where the lines of earlier packets were placed, and the kept layouts. Call it after seeking, so lines that are still on screen don't keep spots from before the seek.
+-(void)reset;
+
+/// Packets with at least this many lines are laid out on several threads. \c NSUIntegerMax keeps every packet on the calling thread.
+@property NSUInteger parallelLayoutThreshold;
+
 @property (readonly) CGFloat aspectRatio;
 @end
 
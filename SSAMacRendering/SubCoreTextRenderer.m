@@ -8,6 +8,10 @@
 
 #include <CoreText/CoreText.h>
 #import "SubCoreTextRenderer.h"
+#import "SubCollision.h"
+#import "SubFontFallback.h"
+#include "SubMaskEffects.h"
+#include "SubShapeCache.h"
 #import "SubImport.h"
 #import "SubParsing.h"
 #import "SubRenderer.h"
@@ -58,9 +62,10 @@ static NSString * const Scale;
 @interface SubCoreTextSpanExtra: NSObject <NSCopying> {
 @public;
 	SubCoreTextStyle *style;
-	CGColorRef primaryColor, outlineColor, shadowColor;
-	CGFloat outlineRadius, shadowDist, scaleX, scaleY, primaryAlpha, outlineAlpha, angle, platformSizeScale, fontSize;
-	BOOL blurEdges, vertical;
+	CGColorRef primaryColor, secondaryColor, outlineColor, shadowColor;
+	CGFloat outlineRadius, shadowDist, scaleX, scaleY, primaryAlpha, secondaryAlpha, outlineAlpha, angle, platformSizeScale, fontSize;
+	BOOL vertical;
+	SubMaskEffectParams effects; //!< in script pixels
 	NSString *fontName;
 }
 
@@ -68,6 +73,12 @@ static NSString * const Scale;
 
 @end
 
+typedef NS_OPTIONS(UInt8, RenderOptions) {
+	renderMultipleParts = 1, //!< Call ATSUDrawText more than once, needed for color/border changes in the middle of lines
+	renderManualShadows = 2, //!< CG shadows can't change inside a line... probably
+	renderComplexTransforms = 4 //!< Can't draw text at all, have to transform each vertex. needed for 3D perspective, or \frz in the middle of a line
+};
+
 @implementation SubCoreTextStyle
 
 - (instancetype)initWithCoreTextStyle:(NSDictionary<NSString*,id> *)_style;
@@ -98,10 +109,13 @@ static NSString * const Scale;
 		style = [extra copy];
 		primaryColor = CreateCGColorFromRGBOpaque(sstyle->primaryColor, cs);
 		primaryAlpha = sstyle->primaryColor.alpha;
+		secondaryColor = CreateCGColorFromRGBOpaque(sstyle->secondaryColor, cs);
+		secondaryAlpha = sstyle->secondaryColor.alpha;
 		outlineColor = CreateCGColorFromRGBOpaque(sstyle->outlineColor, cs);
 		outlineAlpha = sstyle->outlineColor.alpha;
 		shadowColor  = CreateCGColorFromRGBA(sstyle->shadowColor,  cs);
 		outlineRadius = sstyle->outlineRadius;
+		effects.bordX = effects.bordY = sstyle->outlineRadius;
 		shadowDist = sstyle->shadowDist;
 		scaleX = sstyle->scaleX / 100.;
 		scaleY = sstyle->scaleY / 100.;
@@ -123,6 +137,8 @@ static NSString * const Scale;
 	ret->style = [style copy];
 	ret->primaryColor = CGColorRetain(primaryColor);
 	ret->primaryAlpha = primaryAlpha;
+	ret->secondaryColor = CGColorRetain(secondaryColor);
+	ret->secondaryAlpha = secondaryAlpha;
 	ret->outlineColor = CGColorRetain(outlineColor);
 	ret->outlineAlpha = outlineAlpha;
 	ret->shadowColor = CGColorRetain(shadowColor);
@@ -134,7 +150,7 @@ static NSString * const Scale;
 	ret->platformSizeScale = platformSizeScale;
 	ret->fontSize = fontSize;
 	ret->fontName = [fontName copy];
-	ret->blurEdges = blurEdges;
+	ret->effects = effects;
 	ret->vertical = vertical;
 	
 	return ret;
@@ -148,21 +164,156 @@ static NSString * const Scale;
 - (void)dealloc
 {
 	CGColorRelease(primaryColor);
+	CGColorRelease(secondaryColor);
 	CGColorRelease(outlineColor);
 	CGColorRelease(shadowColor);
 }
 
 @end
 
+//! A div after typesetting: its lines and measurements, ready to be placed and drawn.
+typedef struct SubDivLayout {
+	CTFrameRef frame;
+	CFIndex lineCount;
+	NSRect marginRect;
+	CGFloat imageWidth, imageHeight, descent, firstLineHeight;
+	CGFloat penX, penY; //!< left edge of the div and baseline of its last line, in video pixels from the bottom left
+	NSInteger collisionIndex; //!< index into the packet's SubCollisionItems, or -1 if the div isn't moved
+} SubDivLayout;
+
+/**
+ * The time to highlight karaoke for. A \c timeScale of 0 means \c time is already
+ * milliseconds into each line's event; otherwise it's in the packet's units and each
+ * div's own begin time is taken off. A negative \c time leaves karaoke unhighlighted.
+ */
+typedef struct SubKaraokeClock {
+	NSInteger time;
+	NSUInteger timeScale;
+} SubKaraokeClock;
+
+//! Milliseconds into \c div's event at \c clock, or -1 if karaoke shouldn't be highlighted.
+static NSInteger KaraokeTimeForDiv(SubRenderDiv *div, SubKaraokeClock clock)
+{
+	if (clock.time < 0 || !clock.timeScale) return clock.time;
+	if (div->eventBeginTime < 0) return -1;
+
+	return MAX(clock.time - div->eventBeginTime, 0) * 1000 / (NSInteger)clock.timeScale;
+}
+
+/**
+ * The parsed divs of a packet and their layouts.
+ * Layout is done in video pixels, so any output size can be drawn from the same one.
+ * Only the typesetting is reused; pen positions and karaoke colors are worked out each time the packet is drawn.
+ */
+@interface SubPacketLayout : NSObject {
+@public;
+	NSArray<SubRenderDiv*> *divs;
+	SubDivLayout *layouts;
+}
+@end
+
+@implementation SubPacketLayout
+
+- (void)dealloc
+{
+	NSUInteger count = [divs count];
+	
+	for (NSUInteger i = 0; i < count; i++) {
+		if (layouts[i].frame) CFRelease(layouts[i].frame);
+	}
+	free(layouts);
+}
+
+@end
+
+//! How many packet layouts a renderer keeps. Only the packets on screen around the current frame are wanted.
+#define kSubLayoutCacheSize 16
+//! Default for parallelLayoutThreshold: packets with fewer divs than this are laid out on the calling thread.
+#define kSubParallelLayoutThreshold 4
+
+@interface SubRenderImageList ()
+-(void)addImage:(SubRenderImage)image;
+-(void)addMask:(uint8_t *)mask length:(size_t)length;
+-(void)layerImagesFromIndex:(NSUInteger)start;
+@end
+
+@implementation SubRenderImageList
+{
+	NSMutableData *imageData;
+	NSMutableArray<NSData*> *masks;
+	size_t maskBytes;
+}
+@synthesize maskBytes;
+
+- (instancetype)init
+{
+	if (self = [super init]) {
+		imageData = [[NSMutableData alloc] init];
+		masks = [[NSMutableArray alloc] init];
+	}
+	
+	return self;
+}
+
+- (NSUInteger)count
+{
+	return [imageData length] / sizeof(SubRenderImage);
+}
+
+- (const SubRenderImage *)images
+{
+	return [imageData length] ? [imageData bytes] : NULL;
+}
+
+-(void)addImage:(SubRenderImage)image
+{
+	[imageData appendBytes:&image length:sizeof(image)];
+}
+
+//! Takes ownership of a malloced mask, which images may then point into.
+-(void)addMask:(uint8_t *)mask length:(size_t)length
+{
+	[masks addObject:[NSData dataWithBytesNoCopy:mask length:length freeWhenDone:YES]];
+	maskBytes += length;
+}
+
+//! Puts all the shadows from \c start on first, then the outlines, then the fills, keeping their order otherwise.
+-(void)layerImagesFromIndex:(NSUInteger)start
+{
+	SubRenderImage *images = [imageData mutableBytes];
+	NSUInteger count = [self count] - start, n = 0;
+	SubRenderImage *sorted = malloc(MAX(count, 1) * sizeof(SubRenderImage));
+	
+	for (SubRenderImageKind kind = kSubRenderImageShadow; kind <= kSubRenderImageFill; kind++) {
+		for (NSUInteger i = 0; i < count; i++) {
+			if (images[start + i].kind == kind) sorted[n++] = images[start + i];
+		}
+	}
+	
+	memcpy(images + start, sorted, count * sizeof(SubRenderImage));
+	free(sorted);
+}
+
+- (NSString *)description
+{
+	return [NSString stringWithFormat:@"%@ with %lu images, %zu bytes of masks", [super description], (unsigned long)[self count], maskBytes];
+}
+
+@end
+
 @implementation SubCoreTextRenderer
 {
 	SubContext *context;
 	CGFloat screenScaleX, screenScaleY, videoWidth, videoHeight;
 	BOOL drawTextBounds;
 	CGColorSpaceRef srgbCSpace;
+	SubCollisionResolver *collider;
+	NSCache<NSString*, SubPacketLayout*> *layoutCache;
+	SubFontFallback *fontFallback;
 }
 
 @synthesize context;
+@synthesize parallelLayoutThreshold;
 
 + (CGFontRef)registerFontFromData:(NSData*)data error:(NSError * _Nullable __autoreleasing * _Nullable)error
 {
@@ -255,6 +406,11 @@ static NSString * const Scale;
 		}
 		
 		context = [[SubContext alloc] initWithScriptType:type headers:headers styles:styles delegate:self];
+		collider = [[SubCollisionResolver alloc] initWithCollisions:context->collisions];
+		layoutCache = [[NSCache alloc] init];
+		layoutCache.countLimit = kSubLayoutCacheSize;
+		fontFallback = [[SubFontFallback alloc] init];
+		parallelLayoutThreshold = kSubParallelLayoutThreshold;
 		srgbCSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
 		drawTextBounds = CFPreferencesGetAppBooleanValue(CFSTR("DrawSubTextBounds"), PERIAN_PREF_DOMAIN, NULL);
 	}
@@ -419,131 +575,455 @@ static void drawShape(CGContextRef c, CGPathRef path, SubRenderDiv *div, SubCore
 	}
 }
 
-- (void)renderPacket:(NSString *)packet inContext:(CGContextRef)c size:(CGSize)size
+//! \c fallback picks fonts for characters the spans' fonts don't have, or CoreText does if it's nil.
+static NSAttributedString *AttributedStringForDiv(SubRenderDiv *div, SubFontFallback *fallback)
 {
-	CGFloat bottomPen = 0, topPen = 0, centerPen = 0, *storePen=NULL;
-	NSArray<SubRenderDiv*>* divs = SubParsePacket(packet, context, self);
-	int32_t lastLayer = 0;
-
-	CGContextSaveGState(c);
-	if (size.width != videoWidth || size.height != videoHeight) {
-		CGContextScaleCTM(c, size.width / videoWidth, size.height / videoHeight);
+	NSMutableAttributedString *str = [[NSMutableAttributedString alloc] initWithString:div->text];
+	NSUInteger spanCount = [div->spans count], textLen = [div->text length];
+	
+	for (NSUInteger i = 0; i < spanCount; i++) {
+		SubRenderSpan *span = [div->spans objectAtIndex:i];
+		SubCoreTextSpanExtra *spanEx = span.extra;
+		NSUInteger end = (i + 1 < spanCount) ? [div->spans objectAtIndex:i+1]->offset : textLen;
+		
+		if (end > span->offset)
+			[str setAttributes:spanEx->style->style range:NSMakeRange(span->offset, end - span->offset)];
 	}
-	CGContextSetLineCap(c, kCGLineCapRound); // avoid spiky outlines on some fonts
-	CGContextSetLineJoin(c, kCGLineJoinRound);
-	CGContextSetShouldSmoothFonts(c, false); // don't do LCD subpixel antialiasing
-	CGContextSetShouldSubpixelQuantizeFonts(c, false); // draw text stroke and fill in the same place
 	
-	for (SubRenderDiv *div in divs) {
-		NSInteger textLen = [div->text length];
-		if (!textLen || ![div->spans count]) {
+	[fallback applyToAttributedString:str];
+	return str;
+}
+
+//! Gives a span the look of a syllable that hasn't been sung yet.
+static void SetSpanUnsung(SubCoreTextSpanExtra *spanEx, SubKaraokeKind kind)
+{
+	CGColorRelease(spanEx->primaryColor);
+	spanEx->primaryColor = CGColorRetain(spanEx->secondaryColor);
+	spanEx->primaryAlpha = spanEx->secondaryAlpha;
+	if (kind == kSubKaraokeOutline) spanEx->outlineAlpha = 0;
+}
+
+/**
+ * The spans to draw \c div with at \c clock. For a karaoke div these are colored for how far it has got:
+ * syllables before the active one keep the primary color and the ones after it get the secondary color.
+ * An active sweep syllable's span is split where the sweep has reached.
+ * Changed spans are copies, so the cached layout serves every frame of the event.
+ */
+static NSArray<SubRenderSpan*> *SpansAtKaraokeClock(SubRenderDiv *div, SubKaraokeClock clock)
+{
+	NSInteger time = div->karaoke ? KaraokeTimeForDiv(div, clock) : -1;
+	
+	if (time < 0) return div->spans;
+	
+	SubKaraokeTimeline *karaoke = div->karaoke;
+	NSArray<SubRenderSpan*> *spans = div->spans;
+	NSUInteger spanCount = [spans count], textLen = [div->text length];
+	NSUInteger active = [karaoke indexOfSyllableAtTime:time];
+	NSMutableArray<SubRenderSpan*> *newSpans = [[NSMutableArray alloc] initWithCapacity:spanCount + 1];
+	
+	for (NSUInteger i = 0; i < spanCount; i++) {
+		SubRenderSpan *span = [spans objectAtIndex:i];
+		NSUInteger end = (i + 1 < spanCount) ? [spans objectAtIndex:i+1]->offset : textLen;
+		NSUInteger index = [karaoke indexOfSyllableAtOffset:span->offset];
+		
+		if (index == NSNotFound || (active != NSNotFound && index < active)) {
+			[newSpans addObject:span];
 			continue;
 		}
-
-		BOOL resetPens = NO, resetGState = NO;
-		NSData *ubufferData;
-		const unichar *ubuffer = SubUnicodeForString(div->text, &ubufferData);
 		
-		if (div->layer != lastLayer || div->shouldResetPens) {
-			resetPens = YES;
-			lastLayer = div->layer;
+		SubKaraokeSyllable syl = [karaoke syllableAtIndex:index];
+		CGFloat fill = (index == active) ? [karaoke fillOfSyllableAtIndex:index time:time] : 0;
+		NSUInteger split = syl.start + (NSUInteger)round(fill * (syl.end - syl.start));
+		
+		if (split >= end) {
+			[newSpans addObject:span];
+			continue;
 		}
+		
+		if (split > span->offset) [newSpans addObject:span];
+		
+		SubRenderSpan *unsung = [span copy];
+		
+		unsung->offset = MAX(split, span->offset);
+		SetSpanUnsung(unsung.extra, syl.kind);
+		[newSpans addObject:unsung];
+	}
+	
+	return newSpans;
+}
+
+#pragma mark Shaping
+
+//! Spans longer than this aren't worth caching.
+#define kSubShapeCacheMaxLength 256
 
-		NSRect marginRect = NSMakeRect(div->marginL, div->marginV, context->resX - div->marginL - div->marginR, context->resY - div->marginV - div->marginV);
+/**
+ * Shapes \c range of \c str, which must all have the same attributes, with CoreText,
+ * or takes the result from the shared shape cache. \c chars are the string's characters.
+ * Returns NULL if the font has no name.
+ */
+static const SubShapedRun *CopyShapedRange(NSAttributedString *str, const unichar *chars, NSRange range, NSDictionary<NSString*,id> *attributes)
+{
+	CTFontRef font = (__bridge CTFontRef)attributes[(NSString*)kCTFontAttributeName];
+	SubShapeCache *cache = SubShapeCacheGetShared();
+	char face[256];
+	CFStringRef faceName;
+	const SubShapedRun *shaped;
+	
+	if (!font || range.length > kSubShapeCacheMaxLength) return NULL;
+	
+	faceName = CTFontCopyPostScriptName(font);
+	BOOL named = faceName && CFStringGetCString(faceName, face, sizeof(face), kCFStringEncodingUTF8);
+	if (faceName) CFRelease(faceName);
+	if (!named) return NULL;
+	
+	CGAffineTransform matrix = CTFontGetMatrix(font);
+	SubShapeKey key = {
+		.face = face, .size = CTFontGetSize(font), .scaleX = matrix.a, .scaleY = matrix.d,
+		.text = chars + range.location, .length = range.length
+	};
+	
+	shaped = SubShapeCacheCopyRun(cache, &key);
+	if (shaped) return shaped;
+	
+	NSAttributedString *sub = [str attributedSubstringFromRange:range];
+	CTLineRef line = CTLineCreateWithAttributedString((__bridge CFAttributedStringRef)sub);
+	CFArrayRef runs = CTLineGetGlyphRuns(line);
+	CFIndex glyphCount = CTLineGetGlyphCount(line), done = 0;
+	CGGlyph *glyphs = malloc(MAX(glyphCount, 1) * sizeof(CGGlyph));
+	CGSize *advances = malloc(MAX(glyphCount, 1) * sizeof(CGSize));
+	CFIndex *indices = malloc(MAX(glyphCount, 1) * sizeof(CFIndex));
+	float *widths = malloc(MAX(glyphCount, 1) * sizeof(float));
+	uint32_t *clusters = malloc(MAX(glyphCount, 1) * sizeof(uint32_t));
+	SubShapedRun run = {0};
+	CGFloat ascent, descent, leading;
+	
+	for (CFIndex i = 0; i < CFArrayGetCount(runs); i++) {
+		CTRunRef r = CFArrayGetValueAtIndex(runs, i);
+		CFIndex n = CTRunGetGlyphCount(r);
+		CTFontRef runFont = CFDictionaryGetValue(CTRunGetAttributes(r), kCTFontAttributeName);
 		
-		marginRect.origin.x *= screenScaleX;
-		marginRect.origin.y *= screenScaleY;
-		marginRect.size.width  *= screenScaleX;
-		marginRect.size.height *= screenScaleY;
+		if (!runFont || !CFEqual(runFont, font)) run.fallback = true;
+		CTRunGetGlyphs(r, CFRangeMake(0, 0), glyphs + done);
+		CTRunGetAdvances(r, CFRangeMake(0, 0), advances + done);
+		CTRunGetStringIndices(r, CFRangeMake(0, 0), indices + done);
+		done += n;
+	}
+	
+	for (CFIndex i = 0; i < done; i++) {
+		widths[i] = advances[i].width;
+		clusters[i] = (uint32_t)indices[i];
+	}
+	
+	run.glyphCount = done;
+	run.glyphs = glyphs;
+	run.advances = widths;
+	run.clusters = clusters;
+	run.width = CTLineGetTypographicBounds(line, &ascent, &descent, &leading);
+	run.ascent = ascent;
+	run.descent = descent;
+	run.leading = leading;
+	shaped = SubShapeCacheAddRun(cache, &key, &run);
+	
+	free(glyphs);
+	free(advances);
+	free(indices);
+	free(widths);
+	free(clusters);
+	CFRelease(line);
+	return shaped;
+}
+
+/**
+ * Measures a div the way CTFramesetterSuggestFrameSizeWithConstraints does, from cached shaping.
+ * Returns NO if any line is too wide to fit without wrapping, or something couldn't be shaped.
+ */
+static BOOL MeasureWithShapeCache(NSAttributedString *str, CGFloat breakingWidth, CGSize *outSize)
+{
+	NSString *text = [str string];
+	NSUInteger length = [text length], lineStart = 0;
+	CGSize size = CGSizeZero;
+	SubUnicodeBuffer buffer;
+	const unichar *chars = SubUnicodeBufferBegin(&buffer, text);
+	
+	while (lineStart < length) {
+		NSUInteger lineEnd, contentsEnd;
+		__block CGFloat width = 0, ascent = 0, descent = 0, leading = 0;
+		__block BOOL shaped = YES;
 		
-		CGFloat penY = 0, penX = 0, breakingWidth = marginRect.size.width;
-		BreakContext breakc = {0}; ItemCount breakCount;
+		[text getLineStart:NULL end:&lineEnd contentsEnd:&contentsEnd forRange:NSMakeRange(lineStart, 0)];
 		
-//		ATSUSetTextPointerLocation(layout, ubuffer, kATSUFromTextBeginning, kATSUToTextEnd, textLen);
-//		ATSUSetTransientFontMatching(layout,TRUE);
+		// the line break belongs to the line, as it does in CoreText, and gives empty lines their height
+		[str enumerateAttributesInRange:NSMakeRange(lineStart, lineEnd - lineStart) options:0 usingBlock:^(NSDictionary<NSString*,id> *attrs, NSRange range, BOOL *stop) {
+			const SubShapedRun *run = CopyShapedRange(str, chars, range, attrs);
+			
+			if (!run) {
+				shaped = NO;
+				*stop = YES;
+				return;
+			}
+			
+			// the line break itself isn't counted in the line's width
+			if (NSMaxRange(range) > contentsEnd) {
+				for (size_t g = 0; g < run->glyphCount; g++) {
+					if (range.location + run->clusters[g] < contentsEnd) width += run->advances[g];
+				}
+			} else {
+				width += run->width;
+			}
+			ascent = MAX(ascent, run->ascent);
+			descent = MAX(descent, run->descent);
+			leading = MAX(leading, run->leading);
+			SubShapeCacheReleaseRun(SubShapeCacheGetShared(), run);
+		}];
 		
-//		SetLayoutPositioning(layout, breakingWidth, div->alignH);
-//		SetStyleSpanRuns(layout, div, ubuffer);
+		if (!shaped || width > breakingWidth) {
+			SubUnicodeBufferEnd(&buffer);
+			return NO;
+		}
+		
+		size.width = MAX(size.width, width);
+		size.height += ascent + descent + leading;
+		lineStart = lineEnd;
+	}
+	
+	SubUnicodeBufferEnd(&buffer);
+	*outSize = CGSizeMake(ceil(size.width), ceil(size.height));
+	return YES;
+}
+
+//! Typesets one div. Only reads the div and its spans, so it's safe to call for different divs at once.
+static void LayoutDiv(SubRenderDiv *div, CGFloat breakingWidth, SubFontFallback *fallback, SubDivLayout *layout)
+{
+	NSAttributedString *str = AttributedStringForDiv(div, fallback);
+	CTFramesetterRef framesetter = CTFramesetterCreateWithAttributedString((__bridge CFAttributedStringRef)str);
+	CGSize size;
+	BOOL measured = MeasureWithShapeCache(str, breakingWidth, &size);
+	
+	// Suggesting a size typesets the whole div, so it's skipped when the cache already knows every line fits.
+	if (!measured) size = CTFramesetterSuggestFrameSizeWithConstraints(framesetter, CFRangeMake(0, 0), NULL, CGSizeMake(breakingWidth, CGFLOAT_MAX), NULL);
+	
+	CGPathRef path = CGPathCreateWithRect(CGRectMake(0, 0, breakingWidth, ceil(size.height) + 1), NULL);
+	CTFrameRef frame = CTFramesetterCreateFrame(framesetter, CFRangeMake(0, 0), path, NULL);
+	
+	if (measured && CTFrameGetVisibleStringRange(frame).length < (CFIndex)[str length]) {
+		// the estimate was short; lay out again with CoreText's own measurements
+		CFRelease(frame);
+		CGPathRelease(path);
+		size = CTFramesetterSuggestFrameSizeWithConstraints(framesetter, CFRangeMake(0, 0), NULL, CGSizeMake(breakingWidth, CGFLOAT_MAX), NULL);
+		path = CGPathCreateWithRect(CGRectMake(0, 0, breakingWidth, ceil(size.height) + 1), NULL);
+		frame = CTFramesetterCreateFrame(framesetter, CFRangeMake(0, 0), path, NULL);
+	}
+	
+	CFArrayRef lines = CTFrameGetLines(frame);
+	CFIndex lineCount = CFArrayGetCount(lines);
+	CGFloat outline = div->styleLine->outlineRadius * 2;
+	
+	layout->frame = frame;
+	layout->lineCount = lineCount;
+	layout->imageWidth = size.width + outline;
+	layout->imageHeight = size.height + outline;
+	layout->descent = layout->firstLineHeight = 0;
+	
+	if (lineCount) {
+		CGFloat ascent, descent, leading;
 		
-//		breakBuffer = FindLineBreaks(layout, div, breakLocator, breakBuffer, &breakCount, breakingWidth, ubuffer, textLen);
+		CTLineGetTypographicBounds(CFArrayGetValueAtIndex(lines, 0), &ascent, &descent, &leading);
+		layout->firstLineHeight = ascent + descent + leading;
+		CTLineGetTypographicBounds(CFArrayGetValueAtIndex(lines, lineCount - 1), NULL, &layout->descent, NULL);
+	}
+	
+	CGPathRelease(path);
+	CFRelease(framesetter);
+}
+
+- (void)renderPacket:(NSString *)packet inContext:(CGContextRef)c size:(CGSize)size
+{
+	[self renderPacket:packet inContext:c size:size karaokeTime:-1];
+}
 
-		CGFloat imageWidth = 0, imageHeight = 0, descent = 0;
-//		UniCharArrayOffset *breaks = breakBuffer;
+/**
+ * Typesets the divs of a parsed packet, without placing them.
+ * Returns one SubDivLayout per div, which the caller frees.
+ */
+- (SubDivLayout *)layoutDivs:(NSArray<SubRenderDiv*> *)divs
+{
+	NSUInteger divCount = [divs count];
+	SubDivLayout *layouts = calloc(MAX(divCount, 1), sizeof(SubDivLayout));
+	CGFloat scaleX = screenScaleX, scaleY = screenScaleY, resX = context->resX, resY = context->resY;
+	
+	// Lay out every div first. Each one only writes its own slot, so the result
+	// doesn't depend on how the work was split between threads.
+	void (^layoutDiv)(size_t) = ^(size_t i) {
+		SubRenderDiv *div = [divs objectAtIndex:i];
+		SubDivLayout *layout = &layouts[i];
 		
-		if (div->positioned || div->alignV == kSubAlignmentMiddle) {
-//			GetTypographicRectangleForLayout(layout, breaks, breakCount, FloatToFixed(div->styleLine->outlineRadius), NULL, NULL, &imageHeight, &imageWidth);
+		if (![div->text length] || ![div->spans count]) {
+			return;
 		}
 		
-		if (div->positioned || div->alignV != kSubAlignmentTop) {
-//			ATSUGetLineControl(layout, kATSUFromTextBeginning, kATSULineDescentTag, sizeof(ATSUTextMeasurement), &descent, NULL);
-		}
+		NSRect marginRect = NSMakeRect(div->marginL, div->marginV, resX - div->marginL - div->marginR, resY - div->marginV - div->marginV);
 		
-#if 0
-		{
-			ATSUTextMeasurement ascent, descent;
-			
-			ATSUGetLineControl(layout, kATSUFromTextBeginning, kATSULineAscentTag,  sizeof(ATSUTextMeasurement), &ascent,  NULL);
-			ATSUGetLineControl(layout, kATSUFromTextBeginning, kATSULineDescentTag, sizeof(ATSUTextMeasurement), &descent, NULL);
-			
-			NSLog(@"\"%@\" descent %f ascent %f\n", div->text, FixedToFloat(descent), FixedToFloat(ascent));
+		marginRect.origin.x *= scaleX;
+		marginRect.origin.y *= scaleY;
+		marginRect.size.width  *= scaleX;
+		marginRect.size.height *= scaleY;
+		layout->marginRect = marginRect;
+		
+		LayoutDiv(div, marginRect.size.width, self->fontFallback, layout);
+	};
+	
+	if (divCount >= self.parallelLayoutThreshold) {
+		dispatch_apply(divCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), layoutDiv);
+	} else {
+		for (size_t i = 0; i < divCount; i++) layoutDiv(i);
+	}
+	
+	return layouts;
+}
+
+/**
+ * Sets the pen positions of a packet's typeset divs.
+ * Collisions depend on what was on screen before, so this is done every time a packet is drawn.
+ */
+- (void)placeDivs:(NSArray<SubRenderDiv*> *)divs layouts:(SubDivLayout *)layouts
+{
+	NSUInteger divCount = [divs count], collisionCount = 0;
+	SubCollisionItem *collisionItems = calloc(MAX(divCount, 1), sizeof(SubCollisionItem));
+	CGFloat scaleX = screenScaleX, scaleY = screenScaleY, resY = context->resY;
+	
+	// placement stays in packet order
+	for (NSUInteger i = 0; i < divCount; i++) {
+		SubRenderDiv *div = [divs objectAtIndex:i];
+		SubDivLayout *layout = &layouts[i];
+		
+		layout->collisionIndex = -1;
+		if (layout->frame && !div->positioned && div->scale <= 0) {
+			layout->collisionIndex = collisionCount;
+			collisionItems[collisionCount++] = (SubCollisionItem){
+				.key = div->readOrder, .layer = div->layer, .alignV = div->alignV,
+				.minY = NSMinY(layout->marginRect), .maxY = NSMaxY(layout->marginRect), .height = layout->imageHeight
+			};
 		}
-#endif
+	}
+	
+	[collider resolveItems:collisionItems count:collisionCount];
+	
+	for (NSUInteger i = 0; i < divCount; i++) {
+		SubRenderDiv *div = [divs objectAtIndex:i];
+		SubDivLayout *layout = &layouts[i];
+		CGFloat penX = 0, penY = 0;
+		
+		if (!layout->frame) continue;
 		
 		if (!div->positioned) {
-			penX = FloatToFixed(NSMinX(marginRect));
-
-			switch(div->alignV) {
-				case kSubAlignmentBottom: default:
-					if (!bottomPen || resetPens) {
-						penY = NSMinY(marginRect) + descent;
-					} else {
-						penY = bottomPen;
-					}
-					
-					storePen = &bottomPen; breakc.lStart = breakCount; breakc.lEnd = -1; breakc.direction = 1;
-					break;
-				case kSubAlignmentMiddle:
-					if (!centerPen || resetPens) {
-						penY = NSMidY(marginRect) - (imageHeight / 2) + descent;
-					} else {
-						penY = centerPen;
-					}
-					
-					storePen = &centerPen; breakc.lStart = breakCount; breakc.lEnd = -1; breakc.direction = 1;
-					break;
-				case kSubAlignmentTop:
-					if (!topPen || resetPens) {
-//						penY = NSMaxY(marginRect) - GetLineHeight(layout, kATSUFromTextBeginning, NO);
-					} else {
-						penY = topPen;
-					}
-					
-					storePen = &topPen; breakc.lStart = 0; breakc.lEnd = breakCount+1; breakc.direction = -1;
-					break;
+			penX = NSMinX(layout->marginRect);
+			
+			if (layout->collisionIndex != -1) {
+				CGFloat y = collisionItems[layout->collisionIndex].y;
+				
+				switch(div->alignV) {
+					case kSubAlignmentBottom: case kSubAlignmentMiddle: default:
+						penY = y + layout->descent;
+						break;
+					case kSubAlignmentTop:
+						penY = y + layout->imageHeight - layout->firstLineHeight;
+						break;
+				}
 			}
 		} else {
-			penX = div->posX * screenScaleX;
-			penY = (context->resY - div->posY) * screenScaleY;
+			penX = div->posX * scaleX;
+			penY = (resY - div->posY) * scaleY;
 			
 			switch (div->alignH) {
-				case kSubAlignmentCenter: penX -= imageWidth / 2; break;
-				case kSubAlignmentRight: penX -= imageWidth; break;
+				case kSubAlignmentCenter: penX -= layout->imageWidth / 2; break;
+				case kSubAlignmentRight: penX -= layout->imageWidth; break;
 				case kSubAlignmentLeft: break;
 			}
 			
 			switch (div->alignV) {
-				case kSubAlignmentMiddle: penY -= imageHeight / 2; break;
-				case kSubAlignmentTop: penY -= imageHeight; break;
+				case kSubAlignmentMiddle: penY -= layout->imageHeight / 2; break;
+				case kSubAlignmentTop: penY -= layout->imageHeight; break;
 				case kSubAlignmentBottom: break;
 			}
 			
-			penY += descent;
+			penY += layout->descent;
+		}
+		
+		layout->penX = penX;
+		layout->penY = penY;
+	}
+	
+	free(collisionItems);
+}
+
+/**
+ * Parses and typesets a packet, or takes the typesetting from the last time it was drawn, then places it.
+ * Drawing the same packet at several output sizes or karaoke times only typesets it once;
+ * karaoke is colored in when drawing.
+ */
+- (SubPacketLayout *)layoutForPacket:(NSString *)packet eventBeginTimes:(NSArray<NSNumber*> *)eventBeginTimes
+{
+	// the begin times end up in the divs, so they're part of what's cached
+	NSString *key = eventBeginTimes ? [NSString stringWithFormat:@"%@\n%@", [eventBeginTimes componentsJoinedByString:@","], packet] : packet;
+	SubPacketLayout *layout = [layoutCache objectForKey:key];
+	
+	if (!layout) {
+		layout = [[SubPacketLayout alloc] init];
+		layout->divs = SubParsePacketWithEventTimes(packet, eventBeginTimes, context, self);
+		layout->layouts = [self layoutDivs:layout->divs];
+		[layoutCache setObject:layout forKey:key];
+	}
+	
+	[self placeDivs:layout->divs layouts:layout->layouts];
+	return layout;
+}
+
+- (void)renderPacket:(NSString *)packet inContext:(CGContextRef)c size:(CGSize)size karaokeTime:(NSInteger)karaokeTime
+{
+	[self renderPacket:packet eventBeginTimes:nil inContext:c size:size karaokeClock:(SubKaraokeClock){karaokeTime, 0}];
+}
+
+- (void)renderPacket:(NSString *)packet eventBeginTimes:(NSArray<NSNumber*> *)eventBeginTimes inContext:(CGContextRef)c size:(CGSize)size time:(NSInteger)time timeScale:(NSUInteger)timeScale
+{
+	[self renderPacket:packet eventBeginTimes:eventBeginTimes inContext:c size:size karaokeClock:(SubKaraokeClock){time, MAX(timeScale, 1)}];
+}
 
-//			SetLayoutPositioning(layout, imageWidth, div->alignH);
-			storePen = NULL; breakc.lStart = breakCount; breakc.lEnd = -1; breakc.direction = 1;
+- (void)renderPacket:(NSString *)packet eventBeginTimes:(NSArray<NSNumber*> *)eventBeginTimes inContext:(CGContextRef)c size:(CGSize)size karaokeClock:(SubKaraokeClock)clock
+{
+	SubPacketLayout *packetLayout = [self layoutForPacket:packet eventBeginTimes:eventBeginTimes];
+	NSArray<SubRenderDiv*>* divs = packetLayout->divs;
+	NSUInteger divCount = [divs count];
+	SubDivLayout *layouts = packetLayout->layouts;
+
+	CGContextSaveGState(c);
+	if (size.width != videoWidth || size.height != videoHeight) {
+		CGContextScaleCTM(c, size.width / videoWidth, size.height / videoHeight);
+	}
+	CGContextSetLineCap(c, kCGLineCapRound); // avoid spiky outlines on some fonts
+	CGContextSetLineJoin(c, kCGLineJoinRound);
+	CGContextSetShouldSmoothFonts(c, false); // don't do LCD subpixel antialiasing
+	CGContextSetShouldSubpixelQuantizeFonts(c, false); // draw text stroke and fill in the same place
+	
+	for (NSUInteger i = 0; i < divCount; i++) {
+		SubRenderDiv *div = [divs objectAtIndex:i];
+		SubDivLayout *layout = &layouts[i];
+		if (!layout->frame) {
+			continue;
+		}
+
+		BOOL resetGState = NO;
+		CGFloat penY = layout->penY, penX = layout->penX;
+		CGFloat imageWidth = layout->imageWidth;
+		BreakContext breakc = {0}; ItemCount breakCount = layout->lineCount;
+		
+		if (div->positioned || (layout->collisionIndex != -1 && div->alignV != kSubAlignmentTop)) {
+			breakc.lStart = breakCount; breakc.lEnd = -1; breakc.direction = 1;
+		} else if (layout->collisionIndex != -1) {
+			breakc.lStart = 0; breakc.lEnd = breakCount+1; breakc.direction = -1;
 		}
 		
-		SubRenderSpan *firstSpan = [div->spans objectAtIndex:0];
+		SubRenderSpan *firstSpan = [SpansAtKaraokeClock(div, clock) objectAtIndex:0];
 		SubCoreTextSpanExtra *firstSpanEx = firstSpan.extra;
 
 		if (div->scale > 0) {
@@ -590,12 +1070,284 @@ static void drawShape(CGContextRef c, CGPathRef path, SubRenderDiv *div, SubCore
 		}
 		if (resetGState)
 			CGContextRestoreGState(c);
+	}
+	CGContextRestoreGState(c);
+}
+
+#pragma mark Image lists
+
+//! Where the masks of a packet go: the output size and how video pixels map onto it.
+typedef struct SubImageTarget {
+	CGFloat scaleX, scaleY;			//!< output pixels per video pixel
+	CGFloat effectScaleX, effectScaleY;	//!< output pixels per script pixel
+	CGFloat videoHeight;
+	int width, height;
+} SubImageTarget;
+
+//! One glyph run, or the part of it belonging to a single span, with its line's origin.
+typedef struct SubSpanRun {
+	CTRunRef run;
+	CFRange glyphs;
+	CGPoint origin;
+	NSUInteger span;
+} SubSpanRun;
+
+static uint32_t PackColor(CGColorRef color, CGFloat alpha)
+{
+	const CGFloat *comp = CGColorGetComponents(color);
+	size_t n = CGColorGetNumberOfComponents(color);
+	CGFloat r = comp[0], g = n >= 3 ? comp[1] : r, b = n >= 3 ? comp[2] : r, a = comp[n - 1] * alpha;
+	
+#define to8(x) ((uint32_t)lrint(MIN(MAX(x, 0.), 1.) * 255.))
+	return to8(r) << 24 | to8(g) << 16 | to8(b) << 8 | to8(a);
+#undef to8
+}
+
+//! Adds an image of part of a mask, clipped to the output. Nothing is added if the color is transparent.
+static void AddClippedImage(SubRenderImageList *list, const SubImageTarget *target, SubRenderImageKind kind, uint32_t color,
+							const uint8_t *mask, ptrdiff_t stride, int x, int y, int width, int height)
+{
+	int x0 = MAX(x, 0), y0 = MAX(y, 0);
+	int x1 = MIN(x + width, target->width), y1 = MIN(y + height, target->height);
+	
+	if (!(color & 0xFF) || x1 <= x0 || y1 <= y0) return;
+	
+	[list addImage:(SubRenderImage){
+		.x = x0, .y = y0, .width = x1 - x0, .height = y1 - y0, .stride = stride,
+		.color = color, .kind = kind, .alpha = mask + (y0 - y) * stride + (x0 - x)
+	}];
+}
+
+/**
+ * Draws one span's ink into a fill mask covering \c inkRect (in output pixels) plus room for its effects,
+ * derives the outline from it, and adds the shadow, outline and fill images to \c list.
+ * \c draw is called with a context whose CTM maps video pixels onto the mask.
+ */
+static void AddSpanImages(SubRenderImageList *list, const SubImageTarget *target, SubRenderDiv *div, SubCoreTextSpanExtra *spanEx,
+						  CGRect inkRect, void (^draw)(CGContextRef c))
+{
+	SubMaskEffectParams effects = spanEx->effects;
+	BOOL normalBorder = div->styleLine->borderStyle == kSubBorderStyleNormal;
+	
+	effects.bordX *= target->effectScaleX;
+	effects.bordY *= target->effectScaleY;
+	effects.blur *= target->effectScaleY;
+	
+	int pad = SubMaskEffectPadding(effects.bordX, effects.bordY, effects.blur, effects.blurEdges) + 1;
+	CGRect maskRect = CGRectIntersection(CGRectInset(CGRectIntegral(inkRect), -pad, -pad), CGRectMake(0, 0, target->width, target->height));
+	
+	if (CGRectIsEmpty(maskRect)) return;
+	
+	int x = CGRectGetMinX(maskRect), y = CGRectGetMinY(maskRect);
+	int width = CGRectGetWidth(maskRect), height = CGRectGetHeight(maskRect);
+	ptrdiff_t stride = (width + 15) & ~15;
+	size_t length = stride * height;
+	BOOL hasOutline = effects.bordX > 0 || effects.bordY > 0, hasShadow = normalBorder && spanEx->shadowDist;
+	uint8_t *fill = calloc(length, 1), *outline = NULL, *shadow = NULL;
+	CGContextRef c = CGBitmapContextCreate(fill, width, height, 8, stride, NULL, (CGBitmapInfo)kCGImageAlphaOnly);
+	
+	if (!c) {
+		Codecprintf(NULL, "Couldn't create a %dx%d mask context\n", width, height);
+		free(fill);
+		return;
+	}
+	
+	// video pixels are y-up from the bottom of the video, output pixels are y-down
+	CGContextTranslateCTM(c, -x, height + y - target->videoHeight * target->scaleY);
+	CGContextScaleCTM(c, target->scaleX, target->scaleY);
+	CGContextSetShouldSmoothFonts(c, false);
+	CGContextSetShouldSubpixelQuantizeFonts(c, false);
+	draw(c);
+	CGContextRelease(c);
+	
+	[list addMask:fill length:length];
+	
+	if (hasOutline) {
+		outline = calloc(length, 1);
+		[list addMask:outline length:length];
 		
-		ubufferData = nil;
-		if (storePen) *storePen = penY;
+		if (normalBorder) {
+			SubMaskApplyEffects(&effects, fill, outline, width, height, stride);
+			
+			// a translucent fill shouldn't show the outline through it, but the shadow is still the whole shape
+			if (spanEx->primaryAlpha < 1.) {
+				if (hasShadow) {
+					shadow = malloc(length);
+					memcpy(shadow, outline, length);
+					[list addMask:shadow length:length];
+				}
+				for (size_t i = 0; i < length; i++) outline[i] = outline[i] > fill[i] ? outline[i] - fill[i] : 0;
+			}
+		} else {
+			// opaque box: covers the text plus the border width
+			int bx = MAX(CGRectGetMinX(inkRect) - effects.bordX - x, 0), by = MAX(CGRectGetMinY(inkRect) - effects.bordY - y, 0);
+			int bw = MIN(CGRectGetMaxX(inkRect) + effects.bordX - x, width) - bx, bh = MIN(CGRectGetMaxY(inkRect) + effects.bordY - y, height) - by;
+			
+			for (int row = by; row < by + bh; row++) memset(outline + row * stride + bx, 0xFF, MAX(bw, 0));
+			SubMaskApplyEffects(&effects, fill, NULL, width, height, stride);
+		}
+	} else {
+		SubMaskApplyEffects(&effects, fill, NULL, width, height, stride);
+	}
+	
+	if (hasShadow) {
+		// the shadow is the outermost mask moved over, so it usually shares its buffer
+		int dx = (int)lround(spanEx->shadowDist * target->effectScaleX), dy = (int)lround(spanEx->shadowDist * target->effectScaleY);
+		
+		if (!shadow) shadow = outline ? outline : fill;
+		AddClippedImage(list, target, kSubRenderImageShadow, PackColor(spanEx->shadowColor, 1),
+						shadow, stride, x + dx, y + dy, width, height);
+	}
+	if (outline) {
+		AddClippedImage(list, target, kSubRenderImageOutline, PackColor(spanEx->outlineColor, spanEx->outlineAlpha),
+						outline, stride, x, y, width, height);
+	}
+	AddClippedImage(list, target, kSubRenderImageFill, PackColor(spanEx->primaryColor, spanEx->primaryAlpha),
+					fill, stride, x, y, width, height);
+}
 
+//! Splits a laid out div's glyph runs by \c spans, which are the div's or ones split from them. Returns a malloced array of \c *outCount runs.
+static SubSpanRun *CopySpanRuns(SubRenderDiv *div, NSArray<SubRenderSpan*> *spans, const SubDivLayout *layout, NSUInteger *outCount)
+{
+	CFArrayRef lines = CTFrameGetLines(layout->frame);
+	CFIndex lineCount = CFArrayGetCount(lines), runCapacity = 16, runCount = 0;
+	NSUInteger spanCount = [spans count];
+	CGPoint *origins = malloc(MAX(lineCount, 1) * sizeof(CGPoint));
+	SubSpanRun *runs = malloc(runCapacity * sizeof(SubSpanRun));
+	CGFloat textX = layout->penX + div->styleLine->outlineRadius;
+	
+	CTFrameGetLineOrigins(layout->frame, CFRangeMake(0, 0), origins);
+	
+	for (CFIndex l = 0; l < lineCount; l++) {
+		CFArrayRef glyphRuns = CTLineGetGlyphRuns(CFArrayGetValueAtIndex(lines, l));
+		CGPoint origin = CGPointMake(textX + origins[l].x, layout->penY + origins[l].y - origins[lineCount - 1].y);
+		
+		for (CFIndex r = 0; r < CFArrayGetCount(glyphRuns); r++) {
+			CTRunRef run = CFArrayGetValueAtIndex(glyphRuns, r);
+			CFIndex glyphCount = CTRunGetGlyphCount(run);
+			const CFIndex *stringIndices = CTRunGetStringIndicesPtr(run);
+			CFIndex *indexBuf = NULL;
+			NSUInteger span = 0;
+			
+			if (!stringIndices) {
+				indexBuf = malloc(MAX(glyphCount, 1) * sizeof(CFIndex));
+				CTRunGetStringIndices(run, CFRangeMake(0, 0), indexBuf);
+				stringIndices = indexBuf;
+			}
+			
+			// runs can cross span boundaries when neighboring spans have the same attributes
+			for (CFIndex g = 0; g < glyphCount; g++) {
+				NSUInteger offset = stringIndices[g];
+				
+				while (span > 0 && [spans objectAtIndex:span]->offset > offset) span--;
+				while (span + 1 < spanCount && [spans objectAtIndex:span + 1]->offset <= offset) span++;
+				
+				if (runCount && runs[runCount - 1].run == run && runs[runCount - 1].span == span &&
+					runs[runCount - 1].glyphs.location + runs[runCount - 1].glyphs.length == g) {
+					runs[runCount - 1].glyphs.length++;
+					continue;
+				}
+				
+				if (runCount == runCapacity) {
+					runCapacity *= 2;
+					runs = realloc(runs, runCapacity * sizeof(SubSpanRun));
+				}
+				runs[runCount++] = (SubSpanRun){.run = run, .glyphs = CFRangeMake(g, 1), .origin = origin, .span = span};
+			}
+			
+			free(indexBuf);
+		}
 	}
-	CGContextRestoreGState(c);
+	
+	free(origins);
+	*outCount = runCount;
+	return runs;
+}
+
+- (SubRenderImageList *)imagesForPacket:(NSString *)packet size:(CGSize)size karaokeTime:(NSInteger)karaokeTime
+{
+	return [self imagesForPacket:packet eventBeginTimes:nil size:size karaokeClock:(SubKaraokeClock){karaokeTime, 0}];
+}
+
+- (SubRenderImageList *)imagesForPacket:(NSString *)packet eventBeginTimes:(NSArray<NSNumber*> *)eventBeginTimes size:(CGSize)size time:(NSInteger)time timeScale:(NSUInteger)timeScale
+{
+	return [self imagesForPacket:packet eventBeginTimes:eventBeginTimes size:size karaokeClock:(SubKaraokeClock){time, MAX(timeScale, 1)}];
+}
+
+- (SubRenderImageList *)imagesForPacket:(NSString *)packet eventBeginTimes:(NSArray<NSNumber*> *)eventBeginTimes size:(CGSize)size karaokeClock:(SubKaraokeClock)clock
+{
+	SubPacketLayout *packetLayout = [self layoutForPacket:packet eventBeginTimes:eventBeginTimes];
+	NSArray<SubRenderDiv*>* divs = packetLayout->divs;
+	NSUInteger divCount = [divs count];
+	SubDivLayout *layouts = packetLayout->layouts;
+	SubRenderImageList *list = [[SubRenderImageList alloc] init];
+	SubImageTarget target = {
+		.scaleX = size.width / videoWidth, .scaleY = size.height / videoHeight,
+		.videoHeight = videoHeight, .width = (int)size.width, .height = (int)size.height
+	};
+	// video pixels to y-down output pixels
+	CGAffineTransform toOutput = CGAffineTransformMake(target.scaleX, 0, 0, -target.scaleY, 0, videoHeight * target.scaleY);
+	
+	target.effectScaleX = screenScaleX * target.scaleX;
+	target.effectScaleY = screenScaleY * target.scaleY;
+	
+	for (NSUInteger i = 0; i < divCount; i++) {
+		SubRenderDiv *div = [divs objectAtIndex:i];
+		SubDivLayout *layout = &layouts[i];
+		if (!layout->frame) {
+			continue;
+		}
+		
+		NSArray<SubRenderSpan*> *spans = SpansAtKaraokeClock(div, clock);
+		SubCoreTextSpanExtra *firstSpanEx = [spans objectAtIndex:0].extra;
+		
+		if (div->scale > 0) {
+			CGAffineTransform trans = CGAffineTransformRotate(CGAffineTransformMakeTranslation(div->posX, div->posY), firstSpanEx->angle * M_PI / 180.);
+			CGAffineTransform flip = CGAffineTransformMake(1, 0, 0, -1, 0, videoHeight * screenScaleY);
+			CGPathRef pr = CreateSubParseSubShapesWithString(div->text, &trans);
+			CGRect ink = CGRectApplyAffineTransform(CGPathGetBoundingBox(pr), CGAffineTransformConcat(flip, toOutput));
+			
+			AddSpanImages(list, &target, div, firstSpanEx, ink, ^(CGContextRef c) {
+				CGContextConcatCTM(c, flip);
+				CGContextAddPath(c, pr);
+				CGContextFillPath(c);
+			});
+			CGPathRelease(pr);
+			continue;
+		}
+		
+		NSUInteger runCount, spanCount = [spans count], firstImage = [list count];
+		SubSpanRun *runs = CopySpanRuns(div, spans, layout, &runCount);
+		
+		for (NSUInteger s = 0; s < spanCount; s++) {
+			CGRect ink = CGRectNull;
+			
+			for (NSUInteger r = 0; r < runCount; r++) {
+				if (runs[r].span != s) continue;
+				
+				CGRect bounds = CTRunGetImageBounds(runs[r].run, NULL, runs[r].glyphs);
+				bounds = CGRectOffset(bounds, runs[r].origin.x, runs[r].origin.y);
+				ink = CGRectUnion(ink, CGRectApplyAffineTransform(bounds, toOutput));
+			}
+			
+			if (CGRectIsNull(ink) || CGRectIsEmpty(ink)) continue;
+			
+			AddSpanImages(list, &target, div, [spans objectAtIndex:s].extra, ink, ^(CGContextRef c) {
+				CGContextSetTextMatrix(c, CGAffineTransformIdentity);
+				for (NSUInteger r = 0; r < runCount; r++) {
+					if (runs[r].span != s) continue;
+					
+					CGContextSetTextPosition(c, runs[r].origin.x, runs[r].origin.y);
+					CTRunDraw(runs[r].run, c, runs[r].glyphs);
+				}
+			});
+		}
+		
+		free(runs);
+		[list layerImagesFromIndex:firstImage];
+	}
+	
+	return list;
 }
 
 -(void)didCompleteHeaderParsing:(SubContext*)sc
@@ -664,12 +1416,6 @@ static void UpdateFontNameSize(SubCoreTextSpanExtra *spanEx, CGFloat screenScale
 }
 
 
-typedef NS_OPTIONS(UInt8, RenderOptions) {
-	renderMultipleParts = 1, //!< Call ATSUDrawText more than once, needed for color/border changes in the middle of lines
-	renderManualShadows = 2, //!< CG shadows can't change inside a line... probably
-	renderComplexTransforms = 4 //!< Can't draw text at all, have to transform each vertex. needed for 3D perspective, or \frz in the middle of a line
-};
-
 -(void)spanChangedTag:(SubSSATagName)tag span:(SubRenderSpan*)span div:(SubRenderDiv*)div param:(void*)p
 {
 	SubCoreTextSpanExtra *spanEx = span.extra;
@@ -718,7 +1464,7 @@ typedef NS_OPTIONS(UInt8, RenderOptions) {
 		case tag_bord:
 			fv();
 			if (!isFirstSpan) div->render_complexity |= renderMultipleParts;
-			spanEx->outlineRadius = fval;
+			spanEx->outlineRadius = spanEx->effects.bordX = spanEx->effects.bordY = fval;
 			break;
 		case tag_shad:
 			fv();
@@ -805,7 +1551,7 @@ typedef NS_OPTIONS(UInt8, RenderOptions) {
 			iv();
 			fval = (255-ival)/255.;
 			if (!isFirstSpan) div->render_complexity |= renderMultipleParts | renderManualShadows;
-			spanEx->primaryAlpha = spanEx->outlineAlpha = fval;
+			spanEx->primaryAlpha = spanEx->secondaryAlpha = spanEx->outlineAlpha = fval;
 			spanEx->shadowColor = CopyCGColorWithAlpha(spanEx->shadowColor, fval);
 			break;
 		case tag_r:
@@ -819,9 +1565,24 @@ typedef NS_OPTIONS(UInt8, RenderOptions) {
 		}
 			break;
 		case tag_be:
-			bv();
-			if (!isFirstSpan) div->render_complexity |= renderMultipleParts; //FIXME: blur edges
-			spanEx->blurEdges = bval;
+			fv();
+			if (!isFirstSpan) div->render_complexity |= renderMultipleParts;
+			spanEx->effects.blurEdges = MAX((int)lroundf(fval), 0);
+			break;
+		case tag_blur:
+			fv();
+			if (!isFirstSpan) div->render_complexity |= renderMultipleParts;
+			spanEx->effects.blur = MAX(fval, 0);
+			break;
+		case tag_xbord:
+			fv();
+			if (!isFirstSpan) div->render_complexity |= renderMultipleParts;
+			spanEx->effects.bordX = MAX(fval, 0);
+			break;
+		case tag_ybord:
+			fv();
+			if (!isFirstSpan) div->render_complexity |= renderMultipleParts;
+			spanEx->effects.bordY = MAX(fval, 0);
 			break;
 		case tag_p:
 			fv();
@@ -836,14 +1597,15 @@ typedef NS_OPTIONS(UInt8, RenderOptions) {
 			Codecprintf(NULL, "Unimplemented SSA tag 'fry'\n");
 			break;
 		case tag_2c:
+			CGColorRelease(spanEx->secondaryColor);
+			if (!isFirstSpan) div->render_complexity |= renderMultipleParts;
 			colorv();
-			Codecprintf(NULL, "Unimplemented SSA tag '2c'\n");
-			CGColorRelease(color);
+			spanEx->secondaryColor = color;
 			break;
 		case tag_2a:
-			colorv();
-			Codecprintf(NULL, "Unimplemented SSA tag '2a'\n");
-			CGColorRelease(color);
+			iv();
+			if (!isFirstSpan) div->render_complexity |= renderMultipleParts;
+			spanEx->secondaryAlpha = (255-ival)/255.;
 			break;
 		case tag_t:
 			Codecprintf(NULL, "Unimplemented SSA tag 't'\n");
@@ -864,6 +1626,12 @@ typedef NS_OPTIONS(UInt8, RenderOptions) {
 	}
 }
 
+-(void)reset
+{
+	[collider reset];
+	[layoutCache removeAllObjects];
+}
+
 -(CGFloat)aspectRatio
 {
 	return videoWidth / videoHeight;
@@ -875,8 +1643,7 @@ typedef NS_OPTIONS(UInt8, RenderOptions) {
 
 //! Windows and OS X use different TrueType fields to measure text.
 //! Some Windows fonts have one field set incorrectly(?), so we have to compensate.
-//! This should be cached
-CGFloat GetWinCTFontSizeScale(CTFontRef font)
+static CGFloat CalculateWinCTFontSizeScale(CTFontRef font)
 {
 	TT_Header headTable = {0};
 	TT_OS2 os2Table = {0};
@@ -908,6 +1675,30 @@ CGFloat GetWinCTFontSizeScale(CTFontRef font)
 	return (winSize && unitsPerEM) ? ((CGFloat)unitsPerEM / (CGFloat)winSize) : 1;
 }
 
+CGFloat GetWinCTFontSizeScale(CTFontRef font)
+{
+	static NSCache<NSString*,NSNumber*> *scaleCache;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		scaleCache = [[NSCache alloc] init];
+	});
+	
+	// keyed by PostScript name, so every size and trait copy of a font shares an entry
+	NSString *psName = CFBridgingRelease(CTFontCopyPostScriptName(font));
+	
+	// NSCache doesn't take nil keys, and a nameless font has nothing to share with anyway
+	if (!psName) return CalculateWinCTFontSizeScale(font);
+	
+	NSNumber *cached = [scaleCache objectForKey:psName];
+	if (cached) {
+		return [cached doubleValue];
+	}
+	
+	CGFloat scale = CalculateWinCTFontSizeScale(font);
+	[scaleCache setObject:@(scale) forKey:psName];
+	return scale;
+}
+
 static void FindAllPossibleLineBreaks(NSString *line, uint8_t *breakOpportunities)
 {
 	CFLocaleRef locale = CFLocaleCopyCurrent();
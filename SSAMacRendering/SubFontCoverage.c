@@ -0,0 +1,254 @@
+//
+//  SubFontCoverage.c
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "SubFontCoverage.h"
+
+#define kPageWords 4 // 256 bits
+#define kMaxCharacter 0x10FFFF
+
+struct SubFontCoverage {
+	uint16_t pageIndex[kSubFontCoveragePageCount]; //!< 0 for empty pages, otherwise one more than the page's index in \c pages
+	uint64_t (*pages)[kPageWords];
+	size_t pageCount, pageCapacity;
+	size_t characterCount;
+};
+
+static uint16_t ReadU16(const uint8_t *p) {return (p[0] << 8) | p[1];}
+static uint32_t ReadU32(const uint8_t *p) {return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];}
+
+static uint64_t *GetPage(SubFontCoverage *coverage, uint32_t page)
+{
+	if (!coverage->pageIndex[page]) {
+		if (coverage->pageCount == coverage->pageCapacity) {
+			coverage->pageCapacity = coverage->pageCapacity ? coverage->pageCapacity * 2 : 16;
+			coverage->pages = realloc(coverage->pages, coverage->pageCapacity * sizeof(*coverage->pages));
+		}
+		memset(coverage->pages[coverage->pageCount], 0, sizeof(*coverage->pages));
+		coverage->pageIndex[page] = ++coverage->pageCount;
+	}
+
+	return coverage->pages[coverage->pageIndex[page] - 1];
+}
+
+static void AddCharacter(SubFontCoverage *coverage, uint32_t c)
+{
+	uint64_t *page, bit;
+
+	if (c > kMaxCharacter) return;
+	page = GetPage(coverage, c >> kSubFontCoveragePageBits);
+	bit = 1ULL << (c & 63);
+	if (!(page[(c >> 6) & 3] & bit)) {
+		page[(c >> 6) & 3] |= bit;
+		coverage->characterCount++;
+	}
+}
+
+//! Adds \c first through \c last, a word at a time. Format 12 fonts cover whole blocks in one group.
+static void AddRange(SubFontCoverage *coverage, uint32_t first, uint32_t last)
+{
+	if (last > kMaxCharacter) last = kMaxCharacter;
+
+	while (first <= last) {
+		uint64_t *page = GetPage(coverage, first >> kSubFontCoveragePageBits);
+		uint32_t word = (first >> 6) & 3, bitFirst = first & 63;
+		uint32_t bitLast = (last - first > 63 - bitFirst) ? 63 : bitFirst + (last - first);
+		uint64_t mask = (bitLast == 63 ? ~0ULL : (1ULL << (bitLast + 1)) - 1) & ~((1ULL << bitFirst) - 1);
+
+		coverage->characterCount += __builtin_popcountll(mask & ~page[word]);
+		page[word] |= mask;
+		first += bitLast - bitFirst + 1;
+	}
+}
+
+#pragma mark Subtables
+
+//! Segments of BMP characters; the usual subtable.
+static bool ReadFormat4(SubFontCoverage *coverage, const uint8_t *t, size_t length)
+{
+	if (length < 14) return false;
+
+	size_t segCount = ReadU16(t + 6) / 2;
+	const uint8_t *ends = t + 14, *starts = ends + segCount * 2 + 2, *deltas = starts + segCount * 2, *rangeOffsets = deltas + segCount * 2;
+
+	if (14 + segCount * 8 + 2 > length) return false;
+
+	for (size_t i = 0; i < segCount; i++) {
+		uint32_t end = ReadU16(ends + i * 2), start = ReadU16(starts + i * 2);
+		uint16_t delta = ReadU16(deltas + i * 2), rangeOffset = ReadU16(rangeOffsets + i * 2);
+
+		// the final segment just maps U+FFFF to .notdef
+		if (end == 0xFFFF) end = 0xFFFE;
+		if (start > end) continue;
+
+		if (!rangeOffset) {
+			// only the character that wraps around to glyph 0 is missing
+			uint32_t missing = (uint16_t)(0x10000 - delta);
+
+			if (missing < start || missing > end) AddRange(coverage, start, end);
+			else {
+				if (missing > start) AddRange(coverage, start, missing - 1);
+				if (missing < end) AddRange(coverage, missing + 1, end);
+			}
+			continue;
+		}
+
+		for (uint32_t c = start; c <= end; c++) {
+			size_t glyphOffset = (rangeOffsets + i * 2 - t) + rangeOffset + (c - start) * 2;
+
+			if (glyphOffset + 2 > length) break;
+			if (ReadU16(t + glyphOffset)) AddCharacter(coverage, c);
+		}
+	}
+
+	return true;
+}
+
+//! One dense run of BMP characters.
+static bool ReadFormat6(SubFontCoverage *coverage, const uint8_t *t, size_t length)
+{
+	if (length < 10) return false;
+
+	uint32_t first = ReadU16(t + 6), count = ReadU16(t + 8);
+
+	if (10 + count * 2 > length) return false;
+
+	for (uint32_t i = 0; i < count; i++) {
+		if (ReadU16(t + 10 + i * 2)) AddCharacter(coverage, first + i);
+	}
+
+	return true;
+}
+
+//! Groups of characters anywhere in Unicode, mapped to consecutive glyphs.
+static bool ReadFormat12(SubFontCoverage *coverage, const uint8_t *t, size_t length)
+{
+	if (length < 16) return false;
+
+	uint32_t groupCount = ReadU32(t + 12);
+
+	if (groupCount > (length - 16) / 12) return false;
+
+	for (uint32_t i = 0; i < groupCount; i++) {
+		const uint8_t *g = t + 16 + i * 12;
+		uint32_t start = ReadU32(g), end = ReadU32(g + 4), glyph = ReadU32(g + 8);
+
+		if (start > end || start > kMaxCharacter) continue;
+		if (!glyph) {
+			if (start == end) continue;
+			start++;
+		}
+		AddRange(coverage, start, end);
+	}
+
+	return true;
+}
+
+//! Symbol fonts put their characters at U+F0xx; Windows also lets U+00xx reach them.
+static void AddSymbolAliases(SubFontCoverage *coverage)
+{
+	uint16_t index = coverage->pageIndex[0xF000 >> kSubFontCoveragePageBits];
+	uint64_t symbols[kPageWords];
+
+	if (!index) return;
+	memcpy(symbols, coverage->pages[index - 1], sizeof(symbols));
+
+	for (uint32_t c = 0; c < 256; c++) {
+		if ((symbols[c >> 6] >> (c & 63)) & 1) AddCharacter(coverage, c);
+	}
+}
+
+#pragma mark -
+
+//! How much a subtable is preferred, or 0 if it isn't usable.
+static int SubtableScore(uint16_t platform, uint16_t encoding, uint16_t format)
+{
+	bool unicode = platform == 0 || (platform == 3 && (encoding == 1 || encoding == 10));
+
+	if (unicode && format == 12) return 4;
+	if (unicode && (format == 4 || format == 6)) return 3;
+	if (platform == 3 && encoding == 0 && (format == 4 || format == 6)) return 1;
+	return 0;
+}
+
+SubFontCoverage *SubFontCoverageCreateWithCmap(const uint8_t *cmap, size_t length)
+{
+	const uint8_t *best = NULL;
+	size_t bestLength = 0;
+	int bestScore = 0;
+	bool symbol = false;
+
+	if (!cmap || length < 4) return NULL;
+
+	uint16_t tableCount = ReadU16(cmap + 2);
+
+	for (uint16_t i = 0; i < tableCount && 4 + (size_t)(i + 1) * 8 <= length; i++) {
+		const uint8_t *record = cmap + 4 + i * 8;
+		uint16_t platform = ReadU16(record), encoding = ReadU16(record + 2);
+		uint32_t offset = ReadU32(record + 4);
+
+		if ((size_t)offset + 4 > length) continue;
+
+		uint16_t format = ReadU16(cmap + offset);
+		int score = SubtableScore(platform, encoding, format);
+
+		if (score > bestScore) {
+			best = cmap + offset;
+			bestLength = length - offset;
+			bestScore = score;
+			symbol = platform == 3 && encoding == 0;
+		}
+	}
+
+	if (!best) return NULL;
+
+	SubFontCoverage *coverage = calloc(1, sizeof(SubFontCoverage));
+	bool read;
+
+	switch (ReadU16(best)) {
+		case 4: read = ReadFormat4(coverage, best, bestLength); break;
+		case 6: read = ReadFormat6(coverage, best, bestLength); break;
+		case 12: read = ReadFormat12(coverage, best, bestLength); break;
+		default: read = false; break;
+	}
+
+	if (!read) {
+		SubFontCoverageDestroy(coverage);
+		return NULL;
+	}
+
+	if (symbol) AddSymbolAliases(coverage);
+	return coverage;
+}
+
+void SubFontCoverageDestroy(SubFontCoverage *coverage)
+{
+	if (!coverage) return;
+	free(coverage->pages);
+	free(coverage);
+}
+
+bool SubFontCoverageHasCharacter(const SubFontCoverage *coverage, uint32_t c)
+{
+	uint16_t index;
+
+	if (c > kMaxCharacter) return false;
+	index = coverage->pageIndex[c >> kSubFontCoveragePageBits];
+	return index && ((coverage->pages[index - 1][(c >> 6) & 3] >> (c & 63)) & 1);
+}
+
+bool SubFontCoverageHasPage(const SubFontCoverage *coverage, uint32_t page)
+{
+	return page < kSubFontCoveragePageCount && coverage->pageIndex[page];
+}
+
+size_t SubFontCoverageGetCharacterCount(const SubFontCoverage *coverage)
+{
+	return coverage->characterCount;
+}
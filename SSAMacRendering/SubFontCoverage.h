@@ -0,0 +1,48 @@
+//
+//  SubFontCoverage.h
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+#ifndef SubFontCoverage_h
+#define SubFontCoverage_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+/*
+ * Which characters a font has glyphs for, read from its cmap table.
+ *
+ * Unicode is split into pages of 256 characters. Each page the font has any
+ * characters in gets a 256-bit set, so a lookup is an index load and a bit test.
+ * Coverage never changes once created, so it can be read from any thread.
+ */
+
+typedef struct SubFontCoverage SubFontCoverage;
+
+#define kSubFontCoveragePageBits 8
+//! Number of pages up to U+10FFFF.
+#define kSubFontCoveragePageCount (0x110000 >> kSubFontCoveragePageBits)
+
+/**
+ * Reads a raw cmap table. Uses the best Unicode subtable (formats 4, 6 or 12), or a
+ * symbol one, whose characters are also counted at U+0000-00FF as Windows does.
+ * Returns NULL if there's no subtable it understands, e.g. a Mac Roman only font.
+ */
+extern SubFontCoverage *SubFontCoverageCreateWithCmap(const uint8_t *cmap, size_t length);
+extern void SubFontCoverageDestroy(SubFontCoverage *coverage);
+
+extern bool SubFontCoverageHasCharacter(const SubFontCoverage *coverage, uint32_t c);
+//! Whether the font has any character in \c page, which is a character shifted right by kSubFontCoveragePageBits.
+extern bool SubFontCoverageHasPage(const SubFontCoverage *coverage, uint32_t page);
+extern size_t SubFontCoverageGetCharacterCount(const SubFontCoverage *coverage);
+
+__END_DECLS
+
+#endif /* SubFontCoverage_h */
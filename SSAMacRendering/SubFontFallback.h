@@ -0,0 +1,30 @@
+//
+//  SubFontFallback.h
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * @brief Picks fonts for the characters a span's font doesn't have, so CoreText doesn't search its cascade list on every render.
+ *
+ * @discussion Each font's cmap is read into a \c SubFontCoverage once per process. For each span font and
+ * 256-character page of Unicode, the fonts of its cascade list that have anything in the page are kept in order,
+ * so a character's font is found with a bit test per candidate. Those chains, and the fonts made from them,
+ * are kept as long as the object, which lives as long as the script's renderer.
+ *
+ * Fonts without a cmap that can be read are left to CoreText's own fallback. Safe to use from several threads.
+ */
+@interface SubFontFallback : NSObject
+
+/// Sets a fallback font, at the same size and transform, on each run of characters that the run's font doesn't have.
+- (void)applyToAttributedString:(NSMutableAttributedString *)str;
+
+@end
+
+NS_ASSUME_NONNULL_END
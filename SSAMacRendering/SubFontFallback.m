@@ -0,0 +1,267 @@
+//
+//  SubFontFallback.m
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+#include <CoreText/CoreText.h>
+#import "SubFontFallback.h"
+#include "SubFontCoverage.h"
+#import "SubUtilities.h"
+
+//! A font's coverage, shared by every size and transform of it.
+@interface SubFontCoverageInfo : NSObject {
+@public;
+	NSString *name;
+	CTFontDescriptorRef descriptor;
+	SubFontCoverage *coverage; //!< NULL if the cmap couldn't be read
+}
+@end
+
+@implementation SubFontCoverageInfo
+
+- (void)dealloc
+{
+	if (descriptor) CFRelease(descriptor);
+	SubFontCoverageDestroy(coverage);
+}
+
+@end
+
+//! Returns the coverage of \c font, reading its cmap the first time any size of it is seen in the process.
+static SubFontCoverageInfo *CoverageForFont(CTFontRef font)
+{
+	static NSMutableDictionary<NSString*, SubFontCoverageInfo*> *coverages;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		coverages = [[NSMutableDictionary alloc] init];
+	});
+
+	NSString *name = CFBridgingRelease(CTFontCopyPostScriptName(font));
+	SubFontCoverageInfo *info;
+
+	if (!name) return nil;
+
+	@synchronized (coverages) {
+		info = coverages[name];
+	}
+	if (info) return info;
+
+	NSData *cmap = CFBridgingRelease(CTFontCopyTable(font, kCTFontTableCmap, kCTFontTableOptionNoOptions));
+
+	info = [[SubFontCoverageInfo alloc] init];
+	info->name = name;
+	info->descriptor = CTFontCopyFontDescriptor(font);
+	info->coverage = SubFontCoverageCreateWithCmap([cmap bytes], [cmap length]);
+
+	@synchronized (coverages) {
+		// another thread may have read it meanwhile
+		SubFontCoverageInfo *other = coverages[name];
+
+		if (other) return other;
+		coverages[name] = info;
+	}
+
+	return info;
+}
+
+//! Characters that belong with the one before them, like combining marks and variation selectors.
+static BOOL ExtendsCluster(UTF32Char c)
+{
+	static CFCharacterSetRef nonBase;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		nonBase = CFCharacterSetGetPredefined(kCFCharacterSetNonBase);
+	});
+
+	return c == 0x200D || (c >= 0xFE00 && c <= 0xFE0F) || (c >= 0x1F3FB && c <= 0x1F3FF) || (c >= 0xE0100 && c <= 0xE01EF) ||
+		CFCharacterSetIsLongCharacterMember(nonBase, c);
+}
+
+//! One span font's fallbacks, and which of them have anything in each page, worked out as pages come up.
+@interface SubFontChains : NSObject {
+@public;
+	SubFontCoverageInfo *primary;
+	NSArray<SubFontCoverageInfo*> *cascade; //!< nil until a character is missing from the primary font
+	NSMutableDictionary<NSNumber*, NSArray<SubFontCoverageInfo*>*> *pages;
+}
+@end
+
+@implementation SubFontChains
+@end
+
+//! How many span fonts to keep fallback fonts for. Each size and transform of a font is a separate span font.
+#define kSubFallbackFontCacheSize 64
+
+@implementation SubFontFallback
+{
+	// everything is guarded by @synchronized(self)
+	NSMutableDictionary<NSString*, SubFontChains*> *chains; //!< by PostScript name
+	NSCache<id, NSMutableDictionary<NSString*, id>*> *fonts; //!< fallback fonts made for recently used span fonts, by fallback name
+}
+
+- (instancetype)init
+{
+	if (self = [super init]) {
+		chains = [[NSMutableDictionary alloc] init];
+		fonts = [[NSCache alloc] init];
+		fonts.countLimit = kSubFallbackFontCacheSize;
+	}
+
+	return self;
+}
+
+- (SubFontChains *)chainsForFont:(CTFontRef)font
+{
+	NSString *name = CFBridgingRelease(CTFontCopyPostScriptName(font));
+	SubFontChains *fontChains;
+
+	if (!name) return nil;
+
+	@synchronized (self) {
+		fontChains = chains[name];
+		if (!fontChains) {
+			fontChains = [[SubFontChains alloc] init];
+			fontChains->primary = CoverageForFont(font);
+			fontChains->pages = [[NSMutableDictionary alloc] init];
+			chains[name] = fontChains;
+		}
+	}
+
+	return fontChains;
+}
+
+//! The fallbacks of \c font with any character in \c page, in cascade order.
+- (NSArray<SubFontCoverageInfo*> *)chain:(SubFontChains *)fontChains page:(uint32_t)page font:(CTFontRef)font
+{
+	@synchronized (self) {
+		NSArray<SubFontCoverageInfo*> *chain = fontChains->pages[@(page)];
+
+		if (chain) return chain;
+
+		if (!fontChains->cascade) {
+			CFArrayRef list = CTFontCopyDefaultCascadeListForLanguages(font, (__bridge CFArrayRef)[NSLocale preferredLanguages]);
+			NSMutableArray *cascade = [NSMutableArray array];
+
+			for (CFIndex i = 0; list && i < CFArrayGetCount(list); i++) {
+				CTFontRef f = CTFontCreateWithFontDescriptor(CFArrayGetValueAtIndex(list, i), 0, NULL);
+				SubFontCoverageInfo *info = CoverageForFont(f);
+
+				if (info && info->coverage && info != fontChains->primary) [cascade addObject:info];
+				CFRelease(f);
+			}
+
+			if (list) CFRelease(list);
+			fontChains->cascade = cascade;
+		}
+
+		NSMutableArray *pageChain = [NSMutableArray array];
+
+		for (SubFontCoverageInfo *info in fontChains->cascade) {
+			if (SubFontCoverageHasPage(info->coverage, page)) [pageChain addObject:info];
+		}
+
+		fontChains->pages[@(page)] = pageChain;
+		return pageChain;
+	}
+}
+
+//! \c fallback at the size, transform, and if it has them, bold and italic of \c font.
+- (id)font:(SubFontCoverageInfo *)fallback like:(CTFontRef)font
+{
+	id key = (__bridge id)font, made;
+
+	@synchronized (self) {
+		made = [fonts objectForKey:key][fallback->name];
+	}
+	if (made) return made;
+
+	CGAffineTransform matrix = CTFontGetMatrix(font);
+	CTFontRef f = CTFontCreateWithFontDescriptor(fallback->descriptor, CTFontGetSize(font), &matrix);
+	CTFontSymbolicTraits traits = CTFontGetSymbolicTraits(font) & (kCTFontTraitBold | kCTFontTraitItalic);
+
+	if (traits) {
+		CTFontRef styled = CTFontCreateCopyWithSymbolicTraits(f, 0, NULL, traits, traits);
+
+		if (styled) {
+			CFRelease(f);
+			f = styled;
+		}
+	}
+
+	made = CFBridgingRelease(f);
+
+	@synchronized (self) {
+		NSMutableDictionary<NSString*, id> *byName = [fonts objectForKey:key];
+
+		if (!byName) {
+			byName = [NSMutableDictionary dictionary];
+			[fonts setObject:byName forKey:key];
+		}
+		byName[fallback->name] = made;
+	}
+
+	return made;
+}
+
+- (void)applyToString:(NSMutableAttributedString *)str characters:(const unichar *)chars range:(NSRange)range font:(CTFontRef)font
+{
+	SubFontChains *fontChains = [self chainsForFont:font];
+	const SubFontCoverage *primary = fontChains ? fontChains->primary->coverage : NULL;
+	NSUInteger i = range.location, end = NSMaxRange(range), runStart = i;
+	SubFontCoverageInfo *runFallback = nil;
+	NSArray<SubFontCoverageInfo*> *chain = nil;
+	uint32_t chainPage = UINT32_MAX;
+
+	if (!primary) return;
+
+	while (i < end) {
+		NSUInteger start = i;
+		UTF32Char c = chars[i++];
+		SubFontCoverageInfo *fallback = nil;
+
+		if (CFStringIsSurrogateHighCharacter(c) && i < end && CFStringIsSurrogateLowCharacter(chars[i]))
+			c = CFStringGetLongCharacterForSurrogatePair(c, chars[i++]);
+
+		if (runFallback && ExtendsCluster(c)) {
+			fallback = runFallback;
+		} else if (c >= 0x20 && !SubFontCoverageHasCharacter(primary, c)) {
+			if ((c >> kSubFontCoveragePageBits) != chainPage) {
+				chainPage = c >> kSubFontCoveragePageBits;
+				chain = [self chain:fontChains page:chainPage font:font];
+			}
+
+			for (SubFontCoverageInfo *info in chain) {
+				if (SubFontCoverageHasCharacter(info->coverage, c)) {
+					fallback = info;
+					break;
+				}
+			}
+		}
+
+		if (fallback != runFallback) {
+			if (runFallback) [str addAttribute:(NSString*)kCTFontAttributeName value:[self font:runFallback like:font] range:NSMakeRange(runStart, start - runStart)];
+			runFallback = fallback;
+			runStart = start;
+		}
+	}
+
+	if (runFallback) [str addAttribute:(NSString*)kCTFontAttributeName value:[self font:runFallback like:font] range:NSMakeRange(runStart, end - runStart)];
+}
+
+- (void)applyToAttributedString:(NSMutableAttributedString *)str
+{
+	SubUnicodeBuffer buffer;
+	const unichar *chars = SubUnicodeBufferBegin(&buffer, [str string]);
+
+	// setting an attribute inside its own range doesn't upset the enumeration
+	[str enumerateAttribute:(NSString*)kCTFontAttributeName inRange:NSMakeRange(0, buffer.length) options:0 usingBlock:^(id font, NSRange range, BOOL *stop) {
+		if (font) [self applyToString:str characters:chars range:range font:(__bridge CTFontRef)font];
+	}];
+
+	SubUnicodeBufferEnd(&buffer);
+}
+
+@end
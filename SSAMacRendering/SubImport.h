@@ -36,10 +36,13 @@ NS_ASSUME_NONNULL_BEGIN
 	NSString *line;
 	NSUInteger begin_time, end_time;
 	NSInteger num; //!< line number, used only by SubSerializer
+	NSArray<NSNumber*> *eventBeginTimes;
 }
 @property (readonly, copy) NSString *line;
 @property NSUInteger beginTime;
 @property NSUInteger endTime;
+//! For a packet, when each of its lines' events started, in the same units and order. \c nil if not known.
+@property (copy, nullable) NSArray<NSNumber*> *eventBeginTimes;
 @property NSInteger num; //!< line number, used only by SubSerializer
 
 - (instancetype)initWithLine:(NSString*)l start:(NSUInteger)s end:(NSUInteger)e;
@@ -78,24 +81,39 @@ NS_ASSUME_NONNULL_BEGIN
 - (instancetype)initWithTime:(long)time offset:(long)offset;
 @end
 
+/**
+ * @brief One language of a VobSub .idx file.
+ *
+ * @discussion Samples are kept as packed arrays of times and .sub file offsets.
+ * They should be added in time order, as <code>-indexOfSampleAtTime:</code> binary searches them.
+ */
 @interface VobSubTrack : NSObject <NSFastEnumeration>
 {
 @private
 	NSData			*privateData;
 	NSString		*language;
 	NSInteger		index;
-	NSMutableArray<VobSubSample*>	*samples;
+	NSMutableData	*sampleTimes;	//!< int64_t milliseconds
+	NSMutableData	*sampleOffsets;	//!< int64_t
+	NSArray<VobSubSample*>	*samples;
 }
 
 @property (copy, readonly) NSData *privateData;
 @property (copy) NSString *language;
 @property NSInteger index;
+//! Built on first use after samples are added, and kept until the next one is.
 @property (copy, readonly) NSArray<VobSubSample*> *samples;
+@property (readonly) NSUInteger sampleCount;
 
 - (instancetype)initWithPrivateData:(NSData *)idxPrivateData language:(NSString *)lang andIndex:(int)trackIndex;
 - (void)addSample:(VobSubSample *)sample;
 - (void)addSampleTime:(long)time offset:(long)offset;
 
+/// Raises \c NSRangeException if \c index isn't below \c sampleCount.
+- (void)getTime:(nullable long *)time offset:(nullable long *)offset ofSampleAtIndex:(NSUInteger)index;
+/// Returns the index of the last sample starting at or before \c time, or \c NSNotFound if there isn't one.
+- (NSUInteger)indexOfSampleAtTime:(long)time;
+
 @end
 
 __BEGIN_DECLS
@@ -107,6 +125,8 @@ void SubLoadSRTFromPath(NSString *path, SubSerializer *ss);
 void SubLoadSRTFromURL(NSURL *path, SubSerializer *ss);
 void SubLoadSMIFromPath(NSString *path, SubSerializer *ss, int subCount);
 void SubLoadSMIFromURL(NSURL *path, SubSerializer *ss, int subCount);
+//! Reads every track of a VobSub .idx file. The tracks' private data is the .idx header, as stored in Matroska.
+NSArray<VobSubTrack*> *_Nullable VobSubLoadIndexFromURL(NSURL *idxURL);
 
 __END_DECLS
 
@@ -28,26 +28,30 @@
 #import "SubParsing.h"
 #import "SubRenderer.h"
 #import "SubUtilities.h"
+#include "VobSub.h"
 
 //#define SS_DEBUG
 
 #pragma mark C
 
-static NSString *MatroskaPacketizeLine(NSDictionary<NSString*,NSString*> *sub, NSInteger n)
+static NSString *MatroskaPacketizeEvent(const unichar *chars, const SubSSAEvent *ev, NSInteger n)
 {
-	NSString *name = [sub objectForKey:@"Name"];
-	if (!name) name = [sub objectForKey:@"Actor"];
+	static const unichar comma = ',';
+	NSRange layer = ev->fields[kSubEventFieldLayer];
+	CFMutableStringRef str = CFStringCreateMutable(NULL, 0);
 	
-	return [NSString stringWithFormat:@"%ld,%d,%@,%@,%@,%@,%@,%@,%@\n",
-		(long)(n+1),
-		[[sub objectForKey:@"Layer"] intValue],
-		[sub objectForKey:@"Style"],
-		name,
-		[sub objectForKey:@"MarginL"],
-		[sub objectForKey:@"MarginR"],
-		[sub objectForKey:@"MarginV"],
-		[sub objectForKey:@"Effect"],
-		[sub objectForKey:@"Text"]];
+	CFStringAppendFormat(str, NULL, CFSTR("%ld,%d"), (long)(n+1), SubParseIntCharacters(chars + layer.location, layer.length));
+	
+	// Style, Name, MarginL, MarginR, MarginV, Effect, Text
+	for (int f = kSubEventFieldStyle; f < kSubEventFieldCount; f++) {
+		NSRange r = ev->fields[f];
+		CFStringAppendCharacters(str, &comma, 1);
+		CFStringAppendCharacters(str, chars + r.location, r.length);
+	}
+	
+	CFStringAppendCString(str, "\n", kCFStringEncodingASCII);
+	
+	return CFBridgingRelease(str);
 }
 
 static int ParseSubTime(const char *time, int secondScale, BOOL hasSign)
@@ -71,24 +75,53 @@ static int ParseSubTime(const char *time, int secondScale, BOOL hasSign)
 	return timeval * sign;
 }
 
+// ParseSubTime() without the UTF-8 round trip, for event times in a parsed script.
+static int ParseSubTimeCharacters(const unichar *time, NSRange range, int secondScale)
+{
+	const unichar *p = time + range.location, *pe = p + range.length;
+	unsigned parts[4] = {0};
+	int part = 0;
+	
+	while (p < pe && (*p == ' ' || *p == '\t')) p++;
+	
+	for (; part < 4; part++) {
+		const unichar *digits = p;
+		
+		while (p < pe && *p >= '0' && *p <= '9') parts[part] = parts[part] * 10 + (*p++ - '0');
+		if (p == digits) return 0;
+		if (part == 3) break;
+		if (p == pe) return 0;
+		if (part < 2 ? *p != ':' : (*p != ',' && *p != '.' && *p != ':')) return 0;
+		p++;
+	}
+	
+	unsigned timeval = parts[0] * 60 * 60 + parts[1] * 60 + parts[2];
+	return secondScale * timeval + parts[3];
+}
+
 static NSString *SubLoadSSAFromData(NSString *ssa, SubSerializer *ss)
 {
 	NSDictionary<NSString*,NSString*> *headers;
-	NSArray<NSDictionary<NSString*,NSString*>*> *subs;
+	NSData *eventData;
+	SubUnicodeBuffer ssaBuffer;
+	const unichar *chars = SubUnicodeBufferBegin(&ssaBuffer, ssa);
 	
-	SubParseSSAFile(ssa, &headers, NULL, &subs);
+	SubParseSSAFileEventsCharacters(chars, ssaBuffer.length, &headers, NULL, &eventData);
 	
-	NSInteger numlines = [subs count];
+	const SubSSAEvent *events = (const SubSSAEvent *)[eventData bytes];
+	NSInteger numlines = [eventData length] / sizeof(SubSSAEvent);
 	
 	for (NSInteger i = 0; i < numlines; i++) {
-		NSDictionary<NSString*,NSString*> *sub = [subs objectAtIndex:i];
-		SubLine *sl = [[SubLine alloc] initWithLine:MatroskaPacketizeLine(sub, i)
-											  start:ParseSubTime([[sub objectForKey:@"Start"] UTF8String],100,NO)
-												end:ParseSubTime([[sub objectForKey:@"End"] UTF8String],100,NO)];
+		const SubSSAEvent *ev = &events[i];
+		SubLine *sl = [[SubLine alloc] initWithLine:MatroskaPacketizeEvent(chars, ev, i)
+											  start:ParseSubTimeCharacters(chars, ev->fields[kSubEventFieldStart], 100)
+												end:ParseSubTimeCharacters(chars, ev->fields[kSubEventFieldEnd], 100)];
 		
 		[ss addLine:sl];
 	}
 	
+	SubUnicodeBufferEnd(&ssaBuffer);
+	
 	return [ssa substringToIndex:[ssa rangeOfString:@"[Events]" options:NSLiteralSearch].location];
 }
 
@@ -542,6 +575,7 @@ void SubLoadSMIFromURL(NSURL *path, SubSerializer *ss, int subCount)
 	
 canOutput:
 	NSMutableString *str = [NSMutableString stringWithString:first.line];
+	NSMutableArray<NSNumber*> *eventTimes = [NSMutableArray arrayWithObject:@(first.beginTime)];
 	NSUInteger begin_time = last_end_time, end_time = first.endTime;
 	int deleted = 0;
 		
@@ -555,8 +589,10 @@ canOutput:
 		if (l.beginTime > begin_time)
 			end_time = MIN(end_time, l.beginTime);
 		
-		if (l.beginTime <= begin_time)
+		if (l.beginTime <= begin_time) {
 			[str appendString:l.line];
+			[eventTimes addObject:@(l.beginTime)];
+		}
 	}
 	
 	for (i = 0; i < nlines; i++) {
@@ -568,7 +604,10 @@ canOutput:
 		}
 	}
 	
-	return [[SubLine alloc] initWithLine:str start:begin_time end:end_time];
+	SubLine *packet = [[SubLine alloc] initWithLine:str start:begin_time end:end_time];
+	
+	packet.eventBeginTimes = eventTimes;
+	return packet;
 }
 
 -(SubLine*)getSerializedPacket
@@ -613,6 +652,7 @@ canOutput:
 @synthesize beginTime = begin_time;
 @synthesize endTime = end_time;
 @synthesize num;
+@synthesize eventBeginTimes;
 
 -(instancetype)initWithLine:(NSString*)l start:(NSUInteger)s end:(NSUInteger)e
 {
@@ -665,12 +705,23 @@ canOutput:
 
 - (NSArray*)samples
 {
-	return [NSArray arrayWithArray:samples];
+	if (!samples) {
+		NSUInteger count = [self sampleCount];
+		const int64_t *times = (const int64_t *)[sampleTimes bytes], *offsets = (const int64_t *)[sampleOffsets bytes];
+		NSMutableArray *array = [[NSMutableArray alloc] initWithCapacity:count];
+		
+		for (NSUInteger i = 0; i < count; i++)
+			[array addObject:[[VobSubSample alloc] initWithTime:(long)times[i] offset:(long)offsets[i]]];
+		
+		samples = [array copy];
+	}
+	
+	return samples;
 }
 
 - (NSUInteger)countByEnumeratingWithState:(NSFastEnumerationState *)state objects:(id __unsafe_unretained [])buffer count:(NSUInteger)len
 {
-	return [samples countByEnumeratingWithState:state objects:buffer count:len];
+	return [self.samples countByEnumeratingWithState:state objects:buffer count:len];
 }
 
 - (id)initWithPrivateData:(NSData *)idxPrivateData language:(NSString *)lang andIndex:(int)trackIndex
@@ -682,24 +733,79 @@ canOutput:
 	self.privateData = idxPrivateData;
 	self.language = lang;
 	self.index = trackIndex;
-	samples = [[NSMutableArray alloc] init];
+	sampleTimes = [[NSMutableData alloc] init];
+	sampleOffsets = [[NSMutableData alloc] init];
 	
 	return self;
 }
 
+- (NSUInteger)sampleCount
+{
+	return [sampleTimes length] / sizeof(int64_t);
+}
+
 - (void)addSample:(VobSubSample *)sample
 {
-	[samples addObject:sample];
+	[self addSampleTime:sample.timeStamp offset:sample.fileOffset];
 }
 
 - (void)addSampleTime:(long)time offset:(long)offset
 {
-	VobSubSample *sample = [[VobSubSample alloc] initWithTime:time offset:offset];
-	[self addSample:sample];
+	int64_t t = time, o = offset;
+	
+	[sampleTimes appendBytes:&t length:sizeof(t)];
+	[sampleOffsets appendBytes:&o length:sizeof(o)];
+	samples = nil;
+}
+
+- (void)getTime:(long *)time offset:(long *)offset ofSampleAtIndex:(NSUInteger)i
+{
+	if (i >= [self sampleCount])
+		[NSException raise:NSRangeException format:@"Sample index %lu beyond count %lu", (unsigned long)i, (unsigned long)[self sampleCount]];
+	
+	if (time) *time = (long)((const int64_t *)[sampleTimes bytes])[i];
+	if (offset) *offset = (long)((const int64_t *)[sampleOffsets bytes])[i];
+}
+
+- (NSUInteger)indexOfSampleAtTime:(long)time
+{
+	long i = VobSubIndexTrackFind((const int64_t *)[sampleTimes bytes], [self sampleCount], time);
+	return i < 0 ? NSNotFound : i;
 }
 
 @end
 
+NSArray<VobSubTrack*> *VobSubLoadIndexFromURL(NSURL *idxURL)
+{
+	NSData *data = [NSData dataWithContentsOfURL:idxURL options:NSDataReadingMappedIfSafe error:NULL];
+	VobSubIndex idx;
+	
+	if (!data) return nil;
+	
+	if (!VobSubIndexParse((const char *)[data bytes], [data length], &idx)) {
+		Codecprintf(NULL, "VobSub index %s has no size or palette\n", [[idxURL path] fileSystemRepresentation]);
+		VobSubIndexFree(&idx);
+		return nil;
+	}
+	
+	NSData *header = [data subdataWithRange:NSMakeRange(0, idx.headerLength)];
+	NSMutableArray<VobSubTrack*> *tracks = [NSMutableArray arrayWithCapacity:idx.trackCount];
+	
+	for (size_t i = 0; i < idx.trackCount; i++) {
+		const VobSubIndexTrack *t = &idx.tracks[i];
+		NSString *lang = [[NSString alloc] initWithBytes:t->language length:strnlen(t->language, 2) encoding:NSASCIIStringEncoding];
+		VobSubTrack *track = [[VobSubTrack alloc] initWithPrivateData:header language:lang ? lang : @"" andIndex:t->index];
+		
+		for (size_t j = 0; j < t->count; j++)
+			[track addSampleTime:(long)t->times[j] offset:(long)t->offsets[j]];
+		
+		[tracks addObject:track];
+	}
+	
+	VobSubIndexFree(&idx);
+	return tracks;
+}
+
 #pragma mark C++ Wrappers
 
 CXXSubSerializer::CXXSubSerializer() : retainCount(1)
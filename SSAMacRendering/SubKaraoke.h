@@ -0,0 +1,60 @@
+//
+//  SubKaraoke.h
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreGraphics/CoreGraphics.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+typedef NS_ENUM(uint8_t, SubKaraokeKind) {
+	kSubKaraokeSwitch = 0,	//!< \\k: changes from the secondary to the primary color when the syllable starts.
+	kSubKaraokeSweep,		//!< \\kf and \\K: the primary color sweeps across the syllable from left to right.
+	kSubKaraokeOutline		//!< \\ko: like \\k, but the outline isn't drawn until the syllable starts.
+};
+
+//! One karaoke syllable. Offsets are into the div's text, times are milliseconds from the start of the event.
+typedef struct SubKaraokeSyllable {
+	NSUInteger start, end;
+	int32_t beginTime, endTime;
+	SubKaraokeKind kind;
+} SubKaraokeSyllable;
+
+/**
+ * @brief The karaoke syllables of one div, compiled from its \\k tags when the line is parsed.
+ *
+ * @discussion A syllable starts at the text after its tag block and runs to the next syllable.
+ * Text before the first karaoke tag isn't part of any syllable.
+ */
+@interface SubKaraokeTimeline : NSObject
+
+@property (readonly) NSUInteger syllableCount;
+//! The sum of every syllable's duration, in milliseconds.
+@property (readonly) int32_t duration;
+
+- (SubKaraokeSyllable)syllableAtIndex:(NSUInteger)index;
+
+/// Returns the index of the last syllable that has started at \c time, or \c NSNotFound if none have.
+- (NSUInteger)indexOfSyllableAtTime:(NSInteger)time;
+/// Returns the index of the syllable containing the text at \c offset, or \c NSNotFound if it isn't in one.
+- (NSUInteger)indexOfSyllableAtOffset:(NSUInteger)offset;
+
+/// How much of a syllable is highlighted at \c time, from 0 to 1. Switch and outline syllables are always 0 or 1.
+- (CGFloat)fillOfSyllableAtIndex:(NSUInteger)index time:(NSInteger)time;
+
+#pragma mark Building
+
+/// Adds a syllable starting where the previous one ends. \c duration is in centiseconds, as in the tag.
+- (void)addSyllableOfKind:(SubKaraokeKind)kind duration:(int)duration;
+/// Sets the start offset of every syllable added since the last call, once the end of their tag block is known.
+- (void)startPendingSyllablesAtOffset:(NSUInteger)offset;
+/// Closes the last syllable at the end of the text.
+- (void)finishAtOffset:(NSUInteger)offset;
+
+@end
+
+NS_ASSUME_NONNULL_END
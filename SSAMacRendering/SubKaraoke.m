@@ -0,0 +1,125 @@
+//
+//  SubKaraoke.m
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+#import "SubKaraoke.h"
+
+@implementation SubKaraokeTimeline
+{
+	NSMutableData *syllableData;
+	NSUInteger pendingStart;
+	int32_t duration;
+}
+@synthesize duration;
+
+- (instancetype)init
+{
+	if (self = [super init]) {
+		syllableData = [[NSMutableData alloc] init];
+	}
+
+	return self;
+}
+
+- (NSUInteger)syllableCount
+{
+	return [syllableData length] / sizeof(SubKaraokeSyllable);
+}
+
+- (SubKaraokeSyllable)syllableAtIndex:(NSUInteger)index
+{
+	return ((const SubKaraokeSyllable *)[syllableData bytes])[index];
+}
+
+- (NSUInteger)indexOfSyllableAtTime:(NSInteger)time
+{
+	const SubKaraokeSyllable *syllables = [syllableData bytes];
+	NSUInteger lo = 0, hi = [self syllableCount];
+
+	// first syllable beginning after time
+	while (lo < hi) {
+		NSUInteger mid = lo + (hi - lo) / 2;
+
+		if (syllables[mid].beginTime <= time) lo = mid + 1;
+		else hi = mid;
+	}
+
+	return lo ? lo - 1 : NSNotFound;
+}
+
+- (NSUInteger)indexOfSyllableAtOffset:(NSUInteger)offset
+{
+	const SubKaraokeSyllable *syllables = [syllableData bytes];
+	NSUInteger lo = 0, hi = [self syllableCount];
+
+	while (lo < hi) {
+		NSUInteger mid = lo + (hi - lo) / 2;
+
+		if (syllables[mid].start <= offset) lo = mid + 1;
+		else hi = mid;
+	}
+
+	// empty syllables share their start with the next one, so the last match is the one holding the text
+	if (!lo || offset >= syllables[lo - 1].end) return NSNotFound;
+	return lo - 1;
+}
+
+- (CGFloat)fillOfSyllableAtIndex:(NSUInteger)index time:(NSInteger)time
+{
+	SubKaraokeSyllable syl = [self syllableAtIndex:index];
+
+	if (time < syl.beginTime) return 0;
+	if (time >= syl.endTime) return 1;
+	if (syl.kind != kSubKaraokeSweep) return 1;
+	return (CGFloat)(time - syl.beginTime) / (syl.endTime - syl.beginTime);
+}
+
+- (void)addSyllableOfKind:(SubKaraokeKind)kind duration:(int)cs
+{
+	SubKaraokeSyllable syl = {0};
+
+	syl.kind = kind;
+	syl.beginTime = duration;
+	duration += MAX(cs, 0) * 10;
+	syl.endTime = duration;
+
+	[syllableData appendBytes:&syl length:sizeof(syl)];
+}
+
+- (void)startPendingSyllablesAtOffset:(NSUInteger)offset
+{
+	SubKaraokeSyllable *syllables = [syllableData mutableBytes];
+	NSUInteger count = [self syllableCount];
+
+	for (NSUInteger i = pendingStart; i < count; i++) syllables[i].start = syllables[i].end = offset;
+	pendingStart = count;
+}
+
+- (void)finishAtOffset:(NSUInteger)offset
+{
+	SubKaraokeSyllable *syllables = [syllableData mutableBytes];
+	NSUInteger count = [self syllableCount];
+
+	[self startPendingSyllablesAtOffset:offset];
+	for (NSUInteger i = 0; i < count; i++) {
+		syllables[i].end = (i + 1 < count) ? syllables[i + 1].start : offset;
+	}
+}
+
+- (NSString *)description
+{
+	NSMutableString *tmp = [NSMutableString stringWithFormat:@"karaoke with %lu syllables:", (unsigned long)[self syllableCount]];
+
+	for (NSUInteger i = 0; i < [self syllableCount]; i++) {
+		SubKaraokeSyllable syl = [self syllableAtIndex:i];
+		[tmp appendFormat:@" [%lu,%lu) %d-%d", (unsigned long)syl.start, (unsigned long)syl.end, syl.beginTime, syl.endTime];
+	}
+
+	return tmp;
+}
+
+@end
@@ -0,0 +1,421 @@
+//
+//  SubMaskEffects.c
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "SubMaskEffects.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+//! 255 * (2 * 128 + 1) is the largest window sum that fits in 16 bits.
+#define kMaxBoxRadius 128
+
+#pragma mark Row kernels
+
+//! dst = max(dst, src)
+static void MaxRow(uint8_t *dst, const uint8_t *src, int count)
+{
+	int i = 0;
+
+#if defined(__AVX2__)
+	for (; i + 32 <= count; i += 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(dst + i)), b = _mm256_loadu_si256((const __m256i *)(src + i));
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_max_epu8(a, b));
+	}
+#elif defined(__SSE2__)
+	for (; i + 16 <= count; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(dst + i)), b = _mm_loadu_si128((const __m128i *)(src + i));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_max_epu8(a, b));
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 16 <= count; i += 16)
+		vst1q_u8(dst + i, vmaxq_u8(vld1q_u8(dst + i), vld1q_u8(src + i)));
+#endif
+
+	for (; i < count; i++)
+		if (src[i] > dst[i]) dst[i] = src[i];
+}
+
+//! dst[i] = max(line[i], line[i+1], line[i+2])
+static void Max3Row(uint8_t *dst, const uint8_t *line, int count)
+{
+	int i = 0;
+
+#if defined(__AVX2__)
+	for (; i + 32 <= count; i += 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(line + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(line + i + 1));
+		__m256i c = _mm256_loadu_si256((const __m256i *)(line + i + 2));
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_max_epu8(_mm256_max_epu8(a, b), c));
+	}
+#elif defined(__SSE2__)
+	for (; i + 16 <= count; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(line + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(line + i + 1));
+		__m128i c = _mm_loadu_si128((const __m128i *)(line + i + 2));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_max_epu8(_mm_max_epu8(a, b), c));
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 16 <= count; i += 16)
+		vst1q_u8(dst + i, vmaxq_u8(vmaxq_u8(vld1q_u8(line + i), vld1q_u8(line + i + 1)), vld1q_u8(line + i + 2)));
+#endif
+
+	for (; i < count; i++) {
+		uint8_t m = line[i];
+		if (line[i+1] > m) m = line[i+1];
+		if (line[i+2] > m) m = line[i+2];
+		dst[i] = m;
+	}
+}
+
+//! dst = (a + 2b + c) / 4, rounded the way two rounding byte averages are, so every path gives the same result.
+static void Smooth121Row(uint8_t *dst, const uint8_t *a, const uint8_t *b, const uint8_t *c, int count)
+{
+	int i = 0;
+
+#if defined(__AVX2__)
+	for (; i + 32 <= count; i += 32) {
+		__m256i ac = _mm256_avg_epu8(_mm256_loadu_si256((const __m256i *)(a + i)), _mm256_loadu_si256((const __m256i *)(c + i)));
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_avg_epu8(ac, _mm256_loadu_si256((const __m256i *)(b + i))));
+	}
+#elif defined(__SSE2__)
+	for (; i + 16 <= count; i += 16) {
+		__m128i ac = _mm_avg_epu8(_mm_loadu_si128((const __m128i *)(a + i)), _mm_loadu_si128((const __m128i *)(c + i)));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_avg_epu8(ac, _mm_loadu_si128((const __m128i *)(b + i))));
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 16 <= count; i += 16)
+		vst1q_u8(dst + i, vrhaddq_u8(vrhaddq_u8(vld1q_u8(a + i), vld1q_u8(c + i)), vld1q_u8(b + i)));
+#endif
+
+	for (; i < count; i++) {
+		unsigned ac = (a[i] + c[i] + 1) >> 1;
+		dst[i] = (ac + b[i] + 1) >> 1;
+	}
+}
+
+//! sums += row
+static void AddRow16(uint16_t *sums, const uint8_t *row, int count)
+{
+	int i = 0;
+
+#if defined(__AVX2__)
+	for (; i + 16 <= count; i += 16) {
+		__m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(row + i)));
+		_mm256_storeu_si256((__m256i *)(sums + i), _mm256_add_epi16(_mm256_loadu_si256((const __m256i *)(sums + i)), v));
+	}
+#elif defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= count; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(row + i));
+		__m128i lo = _mm_loadu_si128((const __m128i *)(sums + i)), hi = _mm_loadu_si128((const __m128i *)(sums + i + 8));
+		_mm_storeu_si128((__m128i *)(sums + i), _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero)));
+		_mm_storeu_si128((__m128i *)(sums + i + 8), _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero)));
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 16 <= count; i += 16) {
+		uint8x16_t v = vld1q_u8(row + i);
+		vst1q_u16(sums + i, vaddw_u8(vld1q_u16(sums + i), vget_low_u8(v)));
+		vst1q_u16(sums + i + 8, vaddw_u8(vld1q_u16(sums + i + 8), vget_high_u8(v)));
+	}
+#endif
+
+	for (; i < count; i++) sums[i] += row[i];
+}
+
+//! sums -= row
+static void SubRow16(uint16_t *sums, const uint8_t *row, int count)
+{
+	int i = 0;
+
+#if defined(__AVX2__)
+	for (; i + 16 <= count; i += 16) {
+		__m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(row + i)));
+		_mm256_storeu_si256((__m256i *)(sums + i), _mm256_sub_epi16(_mm256_loadu_si256((const __m256i *)(sums + i)), v));
+	}
+#elif defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= count; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(row + i));
+		__m128i lo = _mm_loadu_si128((const __m128i *)(sums + i)), hi = _mm_loadu_si128((const __m128i *)(sums + i + 8));
+		_mm_storeu_si128((__m128i *)(sums + i), _mm_sub_epi16(lo, _mm_unpacklo_epi8(v, zero)));
+		_mm_storeu_si128((__m128i *)(sums + i + 8), _mm_sub_epi16(hi, _mm_unpackhi_epi8(v, zero)));
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 16 <= count; i += 16) {
+		uint8x16_t v = vld1q_u8(row + i);
+		vst1q_u16(sums + i, vsubw_u8(vld1q_u16(sums + i), vget_low_u8(v)));
+		vst1q_u16(sums + i + 8, vsubw_u8(vld1q_u16(sums + i + 8), vget_high_u8(v)));
+	}
+#endif
+
+	for (; i < count; i++) sums[i] -= row[i];
+}
+
+//! dst = sums * mul / 65536
+static void DivideRow16(uint8_t *dst, const uint16_t *sums, uint16_t mul, int count)
+{
+	int i = 0;
+
+#if defined(__AVX2__)
+	const __m256i m = _mm256_set1_epi16((short)mul);
+	for (; i + 32 <= count; i += 32) {
+		__m256i lo = _mm256_mulhi_epu16(_mm256_loadu_si256((const __m256i *)(sums + i)), m);
+		__m256i hi = _mm256_mulhi_epu16(_mm256_loadu_si256((const __m256i *)(sums + i + 16)), m);
+		// packing works within 128-bit lanes, so put the quadwords back in order
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8));
+	}
+#elif defined(__SSE2__)
+	const __m128i m = _mm_set1_epi16((short)mul);
+	for (; i + 16 <= count; i += 16) {
+		__m128i lo = _mm_mulhi_epu16(_mm_loadu_si128((const __m128i *)(sums + i)), m);
+		__m128i hi = _mm_mulhi_epu16(_mm_loadu_si128((const __m128i *)(sums + i + 8)), m);
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+	}
+#elif defined(__ARM_NEON)
+	const uint16x4_t m = vdup_n_u16(mul);
+	for (; i + 8 <= count; i += 8) {
+		uint16x8_t s = vld1q_u16(sums + i);
+		uint16x4_t lo = vshrn_n_u32(vmull_u16(vget_low_u16(s), m), 16);
+		uint16x4_t hi = vshrn_n_u32(vmull_u16(vget_high_u16(s), m), 16);
+		vst1_u8(dst + i, vmovn_u16(vcombine_u16(lo, hi)));
+	}
+#endif
+
+	for (; i < count; i++) dst[i] = (uint8_t)(((uint32_t)sums[i] * mul) >> 16);
+}
+
+#pragma mark Blur
+
+/*
+ * Dividing by the window size n is a multiply by ceil(65536 / n) and a shift.
+ * Rounding up means a full window of 255 still comes out as 255, and for
+ * n <= 257 the error is too small to reach the next integer.
+ */
+static uint16_t BoxMultiplier(int n)
+{
+	return (uint16_t)((65536 + n - 1) / n);
+}
+
+typedef struct BoxScratch {
+	uint8_t *line;		//!< one row with radius pixels of zeros on each side
+	uint8_t *copy;		//!< the unblurred rows, packed
+	uint16_t *sums;		//!< column sums
+} BoxScratch;
+
+static BoxScratch BoxScratchCreate(int width, int height)
+{
+	BoxScratch s;
+
+	s.line = malloc(width + 2 * kMaxBoxRadius);
+	s.copy = malloc((size_t)width * height);
+	s.sums = malloc(width * sizeof(uint16_t));
+	return s;
+}
+
+static void BoxScratchFree(BoxScratch *s)
+{
+	free(s->line);
+	free(s->copy);
+	free(s->sums);
+}
+
+static void BoxBlur(uint8_t *mask, int width, int height, ptrdiff_t stride, int rx, int ry, BoxScratch *s)
+{
+	if (rx > kMaxBoxRadius) rx = kMaxBoxRadius;
+	if (ry > kMaxBoxRadius) ry = kMaxBoxRadius;
+
+	// horizontal: a running sum over each row
+	if (rx > 0) {
+		uint16_t mul = BoxMultiplier(2 * rx + 1);
+
+		memset(s->line, 0, rx);
+		memset(s->line + rx + width, 0, rx);
+
+		for (int y = 0; y < height; y++) {
+			uint8_t *row = mask + y * stride;
+			uint32_t sum = 0;
+
+			memcpy(s->line + rx, row, width);
+			for (int x = 0; x < 2 * rx; x++) sum += s->line[x];
+
+			for (int x = 0; x < width; x++) {
+				sum += s->line[x + 2 * rx];
+				row[x] = (uint8_t)((sum * mul) >> 16);
+				sum -= s->line[x];
+			}
+		}
+	}
+
+	// vertical: a running sum over each column, a whole row at a time
+	if (ry > 0) {
+		uint16_t mul = BoxMultiplier(2 * ry + 1);
+
+		for (int y = 0; y < height; y++) memcpy(s->copy + (size_t)y * width, mask + y * stride, width);
+		memset(s->sums, 0, width * sizeof(uint16_t));
+
+		for (int y = 0; y < ry && y < height; y++) AddRow16(s->sums, s->copy + (size_t)y * width, width);
+
+		for (int y = 0; y < height; y++) {
+			if (y + ry < height) AddRow16(s->sums, s->copy + (size_t)(y + ry) * width, width);
+			DivideRow16(mask + y * stride, s->sums, mul, width);
+			if (y - ry >= 0) SubRow16(s->sums, s->copy + (size_t)(y - ry) * width, width);
+		}
+	}
+}
+
+void SubMaskBoxBlur(uint8_t *mask, int width, int height, ptrdiff_t stride, int radiusX, int radiusY)
+{
+	if (width <= 0 || height <= 0 || (radiusX <= 0 && radiusY <= 0)) return;
+
+	BoxScratch s = BoxScratchCreate(width, height);
+	BoxBlur(mask, width, height, stride, radiusX, radiusY, &s);
+	BoxScratchFree(&s);
+}
+
+//! Three boxes of width n have a variance of 3 * (n^2 - 1) / 12.
+static int GaussianBoxRadius(double sigma)
+{
+	if (sigma <= 0) return 0;
+
+	int r = (int)lround((sqrt(4 * sigma * sigma + 1) - 1) / 2);
+	return r < kMaxBoxRadius ? r : kMaxBoxRadius;
+}
+
+void SubMaskGaussianBlur(uint8_t *mask, int width, int height, ptrdiff_t stride, double sigma)
+{
+	int r = GaussianBoxRadius(sigma);
+
+	if (width <= 0 || height <= 0 || sigma <= 0) return;
+
+	// too small for a box; one [1 2 1] pass has a standard deviation of about 0.7
+	if (r == 0) {
+		SubMaskBlurEdges(mask, width, height, stride, 1);
+		return;
+	}
+
+	BoxScratch s = BoxScratchCreate(width, height);
+	for (int i = 0; i < 3; i++) BoxBlur(mask, width, height, stride, r, r, &s);
+	BoxScratchFree(&s);
+}
+
+void SubMaskBlurEdges(uint8_t *mask, int width, int height, ptrdiff_t stride, int iterations)
+{
+	if (width <= 0 || height <= 0 || iterations <= 0) return;
+
+	uint8_t *line = calloc(width + 2, 1), *prev = malloc(width), *cur = malloc(width), *zero = calloc(width, 1);
+
+	for (int i = 0; i < iterations; i++) {
+		for (int y = 0; y < height; y++) {
+			uint8_t *row = mask + y * stride;
+
+			memcpy(line + 1, row, width);
+			Smooth121Row(row, line, line + 1, line + 2, width);
+		}
+
+		// prev keeps the unsmoothed row above, since that one has already been overwritten
+		memset(prev, 0, width);
+		for (int y = 0; y < height; y++) {
+			uint8_t *row = mask + y * stride, *tmp;
+			const uint8_t *next = (y + 1 < height) ? row + stride : zero;
+
+			memcpy(cur, row, width);
+			Smooth121Row(row, prev, cur, next, width);
+			tmp = prev; prev = cur; cur = tmp;
+		}
+	}
+
+	free(line);
+	free(prev);
+	free(cur);
+	free(zero);
+}
+
+#pragma mark Outlines
+
+void SubMaskDilate(const uint8_t *src, uint8_t *dst, int width, int height, ptrdiff_t stride, double radiusX, double radiusY)
+{
+	int rx = radiusX > 0 ? (int)lround(radiusX) : 0, ry = radiusY > 0 ? (int)lround(radiusY) : 0;
+
+	if (width <= 0 || height <= 0) return;
+
+	if (!rx && !ry) {
+		for (int y = 0; y < height; y++) memcpy(dst + y * stride, src + y * stride, width);
+		return;
+	}
+
+	uint8_t *hmax = malloc((size_t)width * height), *line = calloc(width + 2, 1);
+	int *halfWidth = malloc((ry + 1) * sizeof(int));
+
+	// the ellipse's half width on each row away from the center
+	for (int dy = 0; dy <= ry; dy++) {
+		double t = dy / (ry + 0.5);
+		halfWidth[dy] = (int)lround(rx * sqrt(fmax(0, 1 - t * t)));
+	}
+
+	for (int y = 0; y < height; y++) {
+		memcpy(hmax + (size_t)y * width, src + y * stride, width);
+		memset(dst + y * stride, 0, width);
+	}
+
+	/*
+	 * hmax holds the max over a window of 2k+1 pixels of each row. Growing the window by
+	 * one pixel on each side is a max of three neighbors, and each row of the ellipse
+	 * with half width k takes a max with hmax shifted up or down by its distance.
+	 */
+	for (int k = 0; k <= rx; k++) {
+		if (k > 0) {
+			for (int y = 0; y < height; y++) {
+				uint8_t *row = hmax + (size_t)y * width;
+
+				memcpy(line + 1, row, width);
+				Max3Row(row, line, width);
+			}
+		}
+
+		for (int dy = -ry; dy <= ry; dy++) {
+			if (halfWidth[abs(dy)] != k) continue;
+
+			int y0 = dy < 0 ? -dy : 0, y1 = dy > 0 ? height - dy : height;
+			for (int y = y0; y < y1; y++) MaxRow(dst + y * stride, hmax + (size_t)(y + dy) * width, width);
+		}
+	}
+
+	free(hmax);
+	free(line);
+	free(halfWidth);
+}
+
+int SubMaskEffectPadding(double bordX, double bordY, double blur, int blurEdges)
+{
+	double bord = fmax(fmax(bordX, bordY), 0);
+	int r = GaussianBoxRadius(blur);
+
+	if (blur > 0 && r == 0) r = 1;
+	return (int)lround(bord) + 3 * r + (blurEdges > 0 ? blurEdges : 0);
+}
+
+void SubMaskApplyEffects(const SubMaskEffectParams *params, uint8_t *fill, uint8_t *outline, int width, int height, ptrdiff_t stride)
+{
+	uint8_t *outer = fill;
+
+	if (outline && (params->bordX > 0 || params->bordY > 0)) {
+		SubMaskDilate(fill, outline, width, height, stride, params->bordX, params->bordY);
+		outer = outline;
+	}
+
+	SubMaskBlurEdges(outer, width, height, stride, params->blurEdges);
+	SubMaskGaussianBlur(outer, width, height, stride, params->blur);
+}
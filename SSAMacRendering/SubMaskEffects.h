@@ -0,0 +1,68 @@
+//
+//  SubMaskEffects.h
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+#ifndef SubMaskEffects_h
+#define SubMaskEffects_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+/*
+ * Effects on 8-bit alpha masks of rendered glyphs or divs.
+ *
+ * Pixels outside the mask count as 0, and nothing is drawn outside it, so callers
+ * should leave SubMaskEffectPadding() pixels of empty border around the text.
+ * The inner loops use AVX2, SSE2 or NEON when the compiler targets them.
+ */
+
+//! The effect tags of one span, in mask pixels.
+typedef struct SubMaskEffectParams {
+	double bordX, bordY;	//!< Outline radii.
+	double blur;			//!< \blur standard deviation.
+	int blurEdges;			//!< \be passes.
+} SubMaskEffectParams;
+
+//! How much empty border a mask needs for the effects not to be clipped.
+extern int SubMaskEffectPadding(double bordX, double bordY, double blur, int blurEdges);
+
+/**
+ * Makes the outline mask from the fill mask, then blurs whichever of the two is outermost,
+ * as VSFilter does: the outline if there is one, otherwise the fill.
+ * \c outline may be NULL if the outline isn't drawn.
+ */
+extern void SubMaskApplyEffects(const SubMaskEffectParams *params, uint8_t *fill, uint8_t *outline, int width, int height, ptrdiff_t stride);
+
+/**
+ * \be: smooths the mask \c iterations times with a 3x3 [1 2 1] kernel.
+ */
+extern void SubMaskBlurEdges(uint8_t *mask, int width, int height, ptrdiff_t stride, int iterations);
+
+/**
+ * Box blur with a (2 * radiusX + 1) by (2 * radiusY + 1) window, done as a horizontal
+ * running sum and a vertical one. Radii are clamped to 128.
+ */
+extern void SubMaskBoxBlur(uint8_t *mask, int width, int height, ptrdiff_t stride, int radiusX, int radiusY);
+
+/**
+ * \blur: approximates a Gaussian blur with standard deviation \c sigma by three box blurs.
+ */
+extern void SubMaskGaussianBlur(uint8_t *mask, int width, int height, ptrdiff_t stride, double sigma);
+
+/**
+ * \bord, \xbord and \ybord: grows \c src by an ellipse with the given radii into \c dst,
+ * which is the mask the outline is drawn from. Radii are rounded to whole pixels.
+ * \c src and \c dst have the same size and stride and must not overlap.
+ */
+extern void SubMaskDilate(const uint8_t *src, uint8_t *dst, int width, int height, ptrdiff_t stride, double radiusX, double radiusY);
+
+__END_DECLS
+
+#endif /* SubMaskEffects_h */
@@ -21,6 +21,7 @@
 
 #import <Cocoa/Cocoa.h>
 #import <SSAMacRendering/SubContext.h>
+#import <SSAMacRendering/SubKaraoke.h>
 
 __BEGIN_DECLS
 NS_ASSUME_NONNULL_BEGIN
@@ -55,9 +56,12 @@ typedef struct SubRenderFade {
 	NSString *text;
 	SubStyle *styleLine;
 	NSArray<SubRenderSpan*>  *spans;
+	SubKaraokeTimeline *karaoke;
 
 	CGFloat posX, posY;
 	int marginL, marginR, marginV, layer;
+	NSInteger readOrder;
+	NSInteger eventBeginTime;
 	SubAlignmentH alignH;
 	SubAlignmentV alignV;
 	SubLineWrap wrapStyle;
@@ -71,12 +75,18 @@ typedef struct SubRenderFade {
 @property (copy, nullable) NSString *text;
 @property (strong, nullable) SubStyle *styleLine;
 @property (copy, nullable) NSArray<SubRenderSpan*> *spans;
+//! The line's \\k syllables, or \c nil if it has none.
+@property (strong, nullable) SubKaraokeTimeline *karaoke;
 @property CGFloat posX;
 @property CGFloat posY;
 @property int leftMargin;
 @property int rightMargin;
 @property int verticalMargin;
 @property int layer;
+//! The event's ReadOrder field, which identifies it across packets. -1 for SRT and SAMI.
+@property NSInteger readOrder;
+//! When the div's event starts, in the packet's time units, or -1 if the packet didn't say.
+@property NSInteger eventBeginTime;
 @property SubAlignmentH alignH;
 @property SubAlignmentV alignV;
 @property SubLineWrap wrapStyle;
@@ -101,13 +111,48 @@ typedef struct SubRenderFade {
 
 extern SubRGBAColor SubParseSSAColor(unsigned rgb);
 extern SubRGBAColor SubParseSSAColorString(NSString *c);
+//! Same as \c SubParseSSAColorString, reading the color straight from UTF-16 code units.
+extern SubRGBAColor SubParseSSAColorCharacters(const unichar *c, NSUInteger length);
 
 extern UInt8 SubASSFromSSAAlignment(UInt8 a);
 extern void  SubParseASSAlignment(UInt8 a, SubAlignmentH *alignH, SubAlignmentV *alignV) NS_REFINED_FOR_SWIFT;
 extern BOOL  SubParseFontVerticality(NSString *_Nonnull __autoreleasing* _Nonnull fontname) NS_REFINED_FOR_SWIFT;
 	
+//! The [Events] columns SSAMacRendering uses. SSA's \c Marked column is ignored, and \c Actor is read as \c Name.
+typedef NS_ENUM(uint8_t, SubSSAEventField) {
+	kSubEventFieldLayer,
+	kSubEventFieldStart,
+	kSubEventFieldEnd,
+	kSubEventFieldStyle,
+	kSubEventFieldName,
+	kSubEventFieldMarginL,
+	kSubEventFieldMarginR,
+	kSubEventFieldMarginV,
+	kSubEventFieldEffect,
+	kSubEventFieldText,
+	kSubEventFieldCount
+};
+
+//! One Dialogue line, split using the script's \c Format: line. Each field is a range of the script's characters; missing fields are empty.
+typedef struct SubSSAEvent {
+	NSRange fields[kSubEventFieldCount];
+} SubSSAEvent;
+
+/*!
+ * @brief Parses an SSA/ASS script.
+ *
+ * @discussion Styles and events are split according to the script's \c Format: lines,
+ * falling back to the standard columns if there isn't one. Dictionary keys are the
+ * standard column names whatever case the script used.
+ */
 extern void  SubParseSSAFile(NSString *ssa, NSDictionary<NSString*,NSString*> *_Nonnull*_Nonnull headers, NSArray<NSDictionary<NSString*,NSString*>*> *_Nonnull*_Nullable styles, NSArray<NSDictionary<NSString*,NSString*>*> *_Nonnull*_Nullable subs) NS_REFINED_FOR_SWIFT;
+//! Same as \c SubParseSSAFile, but events come back packed as \c SubSSAEvent structs instead of one dictionary each.
+extern void  SubParseSSAFileEvents(NSString *ssa, NSDictionary<NSString*,NSString*> *_Nonnull*_Nonnull headers, NSArray<NSDictionary<NSString*,NSString*>*> *_Nonnull*_Nullable styles, NSData *_Nonnull*_Nonnull events) NS_REFINED_FOR_SWIFT;
+//! Same as \c SubParseSSAFileEvents, for callers that already have the script's characters and use them for the event ranges.
+extern void  SubParseSSAFileEventsCharacters(const unichar *ssa, NSUInteger length, NSDictionary<NSString*,NSString*> *_Nonnull*_Nonnull headers, NSArray<NSDictionary<NSString*,NSString*>*> *_Nonnull*_Nullable styles, NSData *_Nonnull*_Nonnull events) NS_REFINED_FOR_SWIFT;
 extern NSArray<SubRenderDiv*> *SubParsePacket(NSString *packet, SubContext *context, id<SubRenderer> _Nullable delegate);
+//! Same as \c SubParsePacket, also giving each div the begin time of its line. \c eventBeginTimes has one entry per line of \c packet, like <code>-[SubLine eventBeginTimes]</code>.
+extern NSArray<SubRenderDiv*> *SubParsePacketWithEventTimes(NSString *packet, NSArray<NSNumber*> *_Nullable eventBeginTimes, SubContext *context, id<SubRenderer> _Nullable delegate);
 
 NS_ASSUME_NONNULL_END
 __END_DECLS
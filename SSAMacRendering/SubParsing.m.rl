@@ -61,20 +61,45 @@ SubRGBAColor SubParseSSAColor(unsigned rgb)
 	return (SubRGBAColor){r/255.,g/255.,b/255.,a/255.};
 }
 
-SubRGBAColor SubParseSSAColorString(NSString *c)
+SubRGBAColor SubParseSSAColorCharacters(const unichar *c, NSUInteger length)
 {
-	const char *c_ = [c UTF8String];
-	unsigned int rgb;
+	const unichar *p = c, *pe = c + length;
+	unsigned int rgb = 0;
 	
-	if (c_[0] == '&') {
-		rgb = (unsigned int)strtoul(&c_[2],NULL,16);
+	if (length > 2 && c[0] == '&') {
+		// &HAABBGGRR
+		rgb = SubParseHexCharacters(c + 2, length - 2);
 	} else {
-		rgb = (unsigned int)strtol(c_,NULL,0);
+		// strtol base 0: decimal, 0x hex or 0 octal
+		BOOL negative = NO;
+		unsigned base = 10;
+		
+		while (p < pe && (*p == ' ' || *p == '\t')) p++;
+		if (p < pe && (*p == '-' || *p == '+')) negative = *p++ == '-';
+		
+		if (pe - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+			rgb = SubParseHexCharacters(p + 2, pe - (p + 2));
+		} else {
+			if (p < pe && *p == '0') base = 8;
+			for (; p < pe && *p >= '0' && *p < '0' + base; p++)
+				rgb = rgb * base + (*p - '0');
+		}
+		
+		if (negative) rgb = -rgb;
 	}
 	
 	return SubParseSSAColor(rgb);
 }
 
+SubRGBAColor SubParseSSAColorString(NSString *c)
+{
+	unichar buf[32];
+	NSUInteger length = MIN([c length], sizeof(buf) / sizeof(unichar));
+	
+	[c getCharacters:buf range:NSMakeRange(0, length)];
+	return SubParseSSAColorCharacters(buf, length);
+}
+
 UInt8 SubASSFromSSAAlignment(UInt8 a)
 {
     int h = 1, v = 0;
@@ -130,12 +155,15 @@ BOOL SubParseFontVerticality(NSString **fontname)
 @synthesize text;
 @synthesize styleLine;
 @synthesize spans;
+@synthesize karaoke;
 @synthesize posX;
 @synthesize posY;
 @synthesize leftMargin = marginL;
 @synthesize rightMargin = marginR;
 @synthesize verticalMargin = marginV;
 @synthesize layer;
+@synthesize readOrder;
+@synthesize eventBeginTime;
 @synthesize alignH;
 @synthesize alignV;
 @synthesize wrapStyle;
@@ -162,6 +190,8 @@ BOOL SubParseFontVerticality(NSString **fontname)
 		text      = nil;
 		styleLine = nil;
 		marginL   = marginR = marginV = layer = 0;
+		readOrder = -1;
+		eventBeginTime = -1;
 		spans     = nil;
 		scale = 0;
 		
@@ -180,30 +210,98 @@ BOOL SubParseFontVerticality(NSString **fontname)
 
 extern BOOL IsScriptASS(NSDictionary *headers);
 
-static NSArray<NSDictionary<NSString*,NSString*>*> *SplitByFormat(NSString *format, NSArray<NSString*> *lines)
+static NSString *const kSubStyleFieldNames[] = {
+	@"Name", @"Fontname", @"Fontsize", @"PrimaryColour", @"SecondaryColour", @"TertiaryColour",
+	@"OutlineColour", @"BackColour", @"ShadowColour", @"Bold", @"Italic", @"Underline", @"Strikeout",
+	@"ScaleX", @"ScaleY", @"Spacing", @"Angle", @"BorderStyle", @"Outline", @"Shadow", @"Alignment",
+	@"MarginL", @"MarginR", @"MarginV", @"AlphaLevel", @"Encoding"
+};
+
+static NSString *const kSubEventFieldNames[kSubEventFieldCount] = {
+	@"Layer", @"Start", @"End", @"Style", @"Name", @"MarginL", @"MarginR", @"MarginV", @"Effect", @"Text"
+};
+
+//! Maps a Format: column to the name the rest of the code looks for, ignoring case and spelling.
+static NSString *SubCanonicalFieldName(NSString *column, NSString *const *known, size_t nknown)
 {
-	NSArray *formarray = SubSplitStringIgnoringWhitespace(format,@",");
-	NSInteger numlines = [lines count], numfields = [formarray count];
-	NSMutableArray *ar = [NSMutableArray arrayWithCapacity:numlines];
+	if ([column caseInsensitiveCompare:@"Actor"] == NSOrderedSame) column = @"Name";
+	column = [column stringByReplacingOccurrencesOfString:@"Color" withString:@"Colour" options:NSCaseInsensitiveSearch range:NSMakeRange(0, [column length])];
+	
+	for (size_t i = 0; i < nknown; i++)
+		if ([column caseInsensitiveCompare:known[i]] == NSOrderedSame) return known[i];
 	
-	for (NSString *s in lines) {
-		NSArray *splitline = SubSplitStringWithCount(s, @",", numfields);
+	return column;
+}
+
+static NSArray<NSString*> *SubCompileFormat(NSString *format, NSString *const *known, size_t nknown)
+{
+	NSArray<NSString*> *columns = SubSplitStringIgnoringWhitespace(format, @",");
+	NSMutableArray<NSString*> *compiled = [NSMutableArray arrayWithCapacity:[columns count]];
+	
+	for (NSString *column in columns)
+		[compiled addObject:SubCanonicalFieldName(column, known, nknown)];
+	
+	return compiled;
+}
+
+static NSArray<NSDictionary<NSString*,NSString*>*> *SplitByFormat(NSArray<NSString*> *columns, const unichar *ssa, NSData *rowData)
+{
+	const NSRange *rows = [rowData bytes];
+	NSInteger numrows = [rowData length] / sizeof(NSRange), numfields = [columns count];
+	NSMutableArray *ar = [NSMutableArray arrayWithCapacity:numrows];
+	NSRange fields[MAX(numfields, 1)];
+	
+	if (!numfields) return ar;
+	
+	for (NSInteger i = 0; i < numrows; i++) {
+		if (!SubSplitCharacters(ssa, rows[i], ',', numfields, fields)) continue;
 		
-		if ([splitline count] != numfields) continue;
-		[ar addObject:[NSDictionary dictionaryWithObjects:splitline
-												  forKeys:formarray]];
+		NSMutableDictionary *row = [NSMutableDictionary dictionaryWithCapacity:numfields];
+		for (NSInteger j = 0; j < numfields; j++)
+			[row setObject:[[NSString alloc] initWithCharacters:ssa + fields[j].location length:fields[j].length] forKey:[columns objectAtIndex:j]];
+		[ar addObject:row];
 	}
 	
 	return ar;
 }
 
-void SubParseSSAFile(NSString *ssastr, NSDictionary<NSString*,NSString*> **headers, NSArray<NSDictionary<NSString*,NSString*>*> **styles, NSArray<NSDictionary<NSString*,NSString*>*> **subs)
+//! Splits events straight into SubSSAEvent structs through a column-to-field map.
+static NSData *SplitEventsByFormat(NSArray<NSString*> *columns, const unichar *ssa, NSData *rowData)
+{
+	const NSRange *rows = [rowData bytes];
+	NSInteger numrows = [rowData length] / sizeof(NSRange), numfields = [columns count];
+	NSMutableData *events = [NSMutableData dataWithCapacity:numrows * sizeof(SubSSAEvent)];
+	NSRange fields[MAX(numfields, 1)];
+	int map[MAX(numfields, 1)];
+	
+	if (!numfields) return events;
+	
+	for (NSInteger j = 0; j < numfields; j++) {
+		NSString *column = [columns objectAtIndex:j];
+		map[j] = -1;
+		for (int f = 0; f < kSubEventFieldCount; f++)
+			if ([column isEqualToString:kSubEventFieldNames[f]]) map[j] = f;
+	}
+	
+	for (NSInteger i = 0; i < numrows; i++) {
+		SubSSAEvent ev = {0};
+		
+		if (!SubSplitCharacters(ssa, rows[i], ',', numfields, fields)) continue;
+		
+		for (NSInteger j = 0; j < numfields; j++)
+			if (map[j] >= 0) ev.fields[map[j]] = fields[j];
+		
+		[events appendBytes:&ev length:sizeof(ev)];
+	}
+	
+	return events;
+}
+
+//! Collects the script's headers, plus the Style: and Dialogue: lines as character ranges.
+static void SubParseSSAFileRows(const unichar *ssa, NSInteger len, NSDictionary<NSString*,NSString*> **headers, NSArray<NSString*> **styleColumns, NSData **styleRows, NSArray<NSString*> **eventColumns, NSData **eventRows)
 {
-	NSInteger len = [ssastr length];
-	NSData *ssaData;
-	const unichar *ssa = SubUnicodeForString(ssastr, &ssaData);
 	NSMutableDictionary *headerdict = [NSMutableDictionary dictionary];
-	NSMutableArray *stylearr = [NSMutableArray array], *eventarr = [NSMutableArray array], *cur_array=NULL;
+	NSMutableData *stylerows = [NSMutableData data], *eventrows = [NSMutableData data], *cur_rows=NULL;
 	NSCharacterSet *wcs = [NSCharacterSet whitespaceCharacterSet];
 	NSString *str=NULL, *styleformat=NULL, *eventformat=NULL;
 	BOOL is_ass = NO;
@@ -211,7 +309,7 @@ void SubParseSSAFile(NSString *ssastr, NSDictionary<NSString*,NSString*> **heade
 	const unichar *p = ssa, *pe = ssa + len, *strbegin = p;
 	int cs=0;
 	
-#define send() [[NSString alloc] initWithCharactersNoCopy:(unichar*)strbegin length:p-strbegin freeWhenDone:NO]
+#define send() [[NSString alloc] initWithCharacters:strbegin length:p-strbegin]
 	
 	%%{
 		alphtype unsigned short;
@@ -219,16 +317,26 @@ void SubParseSSAFile(NSString *ssastr, NSDictionary<NSString*,NSString*> **heade
 		action sstart {strbegin = p;}
 		action setheaderval {[headerdict setObject:send() forKey:str];}
 		action savestr {str = send();}
-		action csvlineend {[cur_array addObject:[send() stringByTrimmingCharactersInSet:wcs]];}
+		action csvlineend {
+			const unichar *rowend = p;
+			while (rowend > strbegin && [wcs characterIsMember:rowend[-1]]) rowend--;
+			NSRange row = NSMakeRange(strbegin - ssa, rowend - strbegin);
+			[cur_rows appendBytes:&row length:sizeof(row)];
+		}
+		action setformat {
+			NSString *format = [send() stringByTrimmingCharactersInSet:wcs];
+			if (cur_rows == stylerows) styleformat = format;
+			else eventformat = format;
+		}
 		action setupstyles {
-			cur_array=stylearr;
+			cur_rows=stylerows;
 			is_ass = IsScriptASS(headerdict);
 			styleformat = is_ass ?
 				@"Name, Fontname, Fontsize, PrimaryColour, SecondaryColour, OutlineColour, BackColour, Bold, Italic, Underline, StrikeOut, ScaleX, ScaleY, Spacing, Angle, BorderStyle, Outline, Shadow, Alignment, MarginL, MarginR, MarginV, Encoding"
 			   :@"Name, Fontname, Fontsize, PrimaryColour, SecondaryColour, TertiaryColour, BackColour, Bold, Italic, BorderStyle, Outline, Shadow, Alignment, MarginL, MarginR, MarginV, AlphaLevel, Encoding";
 		}
 		action setupevents {
-			cur_array=eventarr;
+			cur_rows=eventrows;
 			eventformat = is_ass ?
 				@"Layer, Start, End, Style, Name, MarginL, MarginR, MarginV, Effect, Text"
 			   :@"Marked, Start, End, Style, Name, MarginL, MarginR, MarginV, Effect, Text";
@@ -244,10 +352,12 @@ void SubParseSSAFile(NSString *ssastr, NSDictionary<NSString*,NSString*> **heade
 		headerline = (keyvalueline | comment | str) :> nl;
 		header = "[" [Ss] "cript " [Ii] "nfo]" ws* nl headerline*;
 		
-		styleline = (("Style:" ws* %sstart str %csvlineend) | str) :> nl;
+		formatline = "Format:" ws* %sstart str %setformat;
+		
+		styleline = (("Style:" ws* %sstart str %csvlineend) | formatline | str) :> nl;
 		styles = ("[" [Vv] "4" "+"? " " [Ss] "tyles]") %setupstyles ws* nl styleline*;
 		
-		event_txt = (("Dialogue:" ws* %sstart str %csvlineend %/csvlineend) | str);
+		event_txt = (("Dialogue:" ws* %sstart str %csvlineend %/csvlineend) | formatline | str);
 		event = event_txt :> nl;
 			
 		lines = "[" [Ee] "vents]" %setupevents ws* nl event*;
@@ -259,32 +369,82 @@ void SubParseSSAFile(NSString *ssastr, NSDictionary<NSString*,NSString*> **heade
 	%%write exec;
 	%%write eof;
 
-	ssaData = nil;
-
 	*headers = headerdict;
-	if (styles) *styles = SplitByFormat(styleformat, stylearr);
-	if (subs) *subs = SplitByFormat(eventformat, eventarr);
+	if (styleColumns) {
+		*styleColumns = SubCompileFormat(styleformat, kSubStyleFieldNames, sizeof(kSubStyleFieldNames)/sizeof(kSubStyleFieldNames[0]));
+		*styleRows = stylerows;
+	}
+	if (eventColumns) {
+		*eventColumns = SubCompileFormat(eventformat, kSubEventFieldNames, kSubEventFieldCount);
+		*eventRows = eventrows;
+	}
+}
+
+void SubParseSSAFile(NSString *ssastr, NSDictionary<NSString*,NSString*> **headers, NSArray<NSDictionary<NSString*,NSString*>*> **styles, NSArray<NSDictionary<NSString*,NSString*>*> **subs)
+{
+	NSData *styleRows, *eventRows;
+	NSArray<NSString*> *styleColumns, *eventColumns;
+	SubUnicodeBuffer buffer;
+	const unichar *ssa = SubUnicodeBufferBegin(&buffer, ssastr);
+	
+	SubParseSSAFileRows(ssa, buffer.length, headers, styles ? &styleColumns : NULL, &styleRows, subs ? &eventColumns : NULL, &eventRows);
+	
+	if (styles) *styles = SplitByFormat(styleColumns, ssa, styleRows);
+	if (subs) *subs = SplitByFormat(eventColumns, ssa, eventRows);
+	
+	SubUnicodeBufferEnd(&buffer);
+}
+
+void SubParseSSAFileEventsCharacters(const unichar *ssa, NSUInteger length, NSDictionary<NSString*,NSString*> **headers, NSArray<NSDictionary<NSString*,NSString*>*> **styles, NSData **events)
+{
+	NSData *styleRows, *eventRows;
+	NSArray<NSString*> *styleColumns, *eventColumns;
+	
+	SubParseSSAFileRows(ssa, length, headers, styles ? &styleColumns : NULL, &styleRows, &eventColumns, &eventRows);
+	
+	if (styles) *styles = SplitByFormat(styleColumns, ssa, styleRows);
+	*events = SplitEventsByFormat(eventColumns, ssa, eventRows);
+}
+
+void SubParseSSAFileEvents(NSString *ssastr, NSDictionary<NSString*,NSString*> **headers, NSArray<NSDictionary<NSString*,NSString*>*> **styles, NSData **events)
+{
+	SubUnicodeBuffer buffer;
+	const unichar *ssa = SubUnicodeBufferBegin(&buffer, ssastr);
+	
+	SubParseSSAFileEventsCharacters(ssa, buffer.length, headers, styles, events);
+	SubUnicodeBufferEnd(&buffer);
 }
 
 %%machine SSAtag;
 %%write data;
 
 NSArray *SubParsePacket(NSString *packet, SubContext *context, id<SubRenderer> delegate)
+{
+	return SubParsePacketWithEventTimes(packet, nil, context, delegate);
+}
+
+NSArray *SubParsePacketWithEventTimes(NSString *packet, NSArray<NSNumber*> *eventBeginTimes, SubContext *context, id<SubRenderer> delegate)
 {
 	packet = SubStandardizeStringNewlines(packet);
 	NSArray *lines = (context->scriptType == kSubTypeSRT) ? [NSArray arrayWithObject:[packet substringToIndex:[packet length]-1]] : [packet componentsSeparatedByString:@"\n"];
 	size_t line_count = [lines count];
 	NSMutableArray *divs = [NSMutableArray arrayWithCapacity:line_count];
+	NSUInteger time_count = [eventBeginTimes count];
 	NSInteger i;
 	
 	for (i = 0; i < line_count; i++) {
-		NSString *inputText = [lines objectAtIndex:(context->collisions == kSubCollisionsReverse) ? (line_count - i - 1) : i];
+		NSUInteger lineIndex = (context->collisions == kSubCollisionsReverse) ? (line_count - i - 1) : i;
+		NSString *inputText = [lines objectAtIndex:lineIndex];
+		SubUnicodeBuffer linebuffer;
+		const unichar *linebuf = SubUnicodeBufferBegin(&linebuffer, inputText);
+		size_t linelen = linebuffer.length;
 		SubRenderDiv *div = [[SubRenderDiv alloc] init];
 		NSMutableString *text = [[NSMutableString alloc] init];
 		NSMutableArray *spans = [[NSMutableArray alloc] init];
 		
 		div->text  = text;
 		div->spans = spans;
+		if (lineIndex < time_count) div->eventBeginTime = [[eventBeginTimes objectAtIndex:lineIndex] integerValue];
 		
 		if (context->scriptType == kSubTypeSRT) {
 			div->styleLine = context->defaultStyle;
@@ -294,15 +454,21 @@ NSArray *SubParsePacket(NSString *packet, SubContext *context, id<SubRenderer> d
 			div->layer = 0;
 			div->wrapStyle = kSubLineWrapTopWider;
 		} else {
-			NSArray *fields = SubSplitStringWithCount(inputText, @",", 9);
-			if ([fields count] < 9) continue;
-			div->layer = [[fields objectAtIndex:1] intValue];
-			div->styleLine = [context styleForName:[fields objectAtIndex:2]];
-			div->marginL = [[fields objectAtIndex:4] intValue];
-			div->marginR = [[fields objectAtIndex:5] intValue];
-			div->marginV = [[fields objectAtIndex:6] intValue];
-			inputText = [fields objectAtIndex:8];
-			if ([inputText length] == 0) continue;
+			// ReadOrder, Layer, Style, Name, MarginL, MarginR, MarginV, Effect, Text
+			NSRange fields[9];
+			if (!SubSplitCharacters(linebuf, NSMakeRange(0, linelen), ',', 9, fields) || fields[8].length == 0) {
+				SubUnicodeBufferEnd(&linebuffer);
+				continue;
+			}
+			div->readOrder = SubParseIntCharacters(linebuf + fields[0].location, fields[0].length);
+			div->layer = SubParseIntCharacters(linebuf + fields[1].location, fields[1].length);
+			div->styleLine = [context styleForCharacters:linebuf + fields[2].location length:fields[2].length];
+			div->marginL = SubParseIntCharacters(linebuf + fields[4].location, fields[4].length);
+			div->marginR = SubParseIntCharacters(linebuf + fields[5].location, fields[5].length);
+			div->marginV = SubParseIntCharacters(linebuf + fields[6].location, fields[6].length);
+			// the text is parsed in place instead of being copied out and converted again
+			linebuf += fields[8].location;
+			linelen = fields[8].length;
 			
 			if (div->marginL == 0) div->marginL = div->styleLine->marginL;
 			if (div->marginR == 0) div->marginR = div->styleLine->marginR;
@@ -316,13 +482,11 @@ NSArray *SubParsePacket(NSString *packet, SubContext *context, id<SubRenderer> d
 		
 #undef send
 #define send()  [[NSString alloc] initWithCharactersNoCopy:(unichar*)outputbegin length:p-outputbegin freeWhenDone:NO]
-#define psend() [[NSString alloc] initWithCharactersNoCopy:(unichar*)parambegin length:p-parambegin freeWhenDone:NO]
+#define psend() [[NSString alloc] initWithCharacters:parambegin length:p-parambegin]
 #define tag(tagt, p) [delegate spanChangedTag:tag_##tagt span:current_span div:div param:&(p)]
+#define karaoke(kind) if (!div->karaoke) div->karaoke = [SubKaraokeTimeline new]; [div->karaoke addSyllableOfKind:kind duration:intnum]
 				
 		{
-			size_t linelen = [inputText length];
-			NSData *linebufData;
-			const unichar *linebuf = SubUnicodeForString(inputText, &linebufData);
 			const unichar *p = linebuf, *pe = linebuf + linelen, *outputbegin = p, *parambegin=p, *last_tag_start=p;
 			const unichar *pb = p;
 			int cs = 0;
@@ -342,7 +506,10 @@ NSArray *SubParsePacket(NSString *packet, SubContext *context, id<SubRenderer> d
 				action strikeout {tag(s, intnum);}
 				action outlinesize {tag(bord, floatnum);}
 				action shadowdist {tag(shad, floatnum);}
-				action bluredge {tag(be, intnum);}
+				action bluredge {tag(be, floatnum);}
+				action blur {tag(blur, floatnum);}
+				action outlinesizex {tag(xbord, floatnum);}
+				action outlinesizey {tag(ybord, floatnum);}
 				action fontname {tag(fn, strval);}
 				action fontsize {tag(fs, floatnum);}
 				action scalex {tag(fscx, floatnum);}
@@ -363,14 +530,17 @@ NSArray *SubParsePacket(NSString *packet, SubContext *context, id<SubRenderer> d
 				action stylerevert {tag(r, strval);}
 				action drawingmode {tag(p, floatnum);}
 				action drawingoffset {tag(pbo, floatnum);}
+				action karaokeswitch {karaoke(kSubKaraokeSwitch);}
+				action karaokesweep {karaoke(kSubKaraokeSweep);}
+				action karaokeoutline {karaoke(kSubKaraokeOutline);}
 
 				action paramset {parambegin=p;}
-				action setintnum {intnum = [psend() intValue];}
-				action sethexnum {intnum = (int)strtoul([psend() UTF8String], NULL, 16);}
-				action setfloatnum {floatnum = [psend() floatValue];}
+				action setintnum {intnum = SubParseIntCharacters(parambegin, p-parambegin);}
+				action sethexnum {intnum = (int)SubParseHexCharacters(parambegin, p-parambegin);}
+				action setfloatnum {floatnum = SubParseFloatCharacters(parambegin, p-parambegin);}
 				action setstringval {strval = psend();}
 				action nullstring {strval = @"";}
-				action setpos {curX=curY=0; sscanf([psend() UTF8String], "(%lf,%lf", &curX, &curY);}
+				action setpos {SubParseCoordinateCharacters(parambegin, p-parambegin, &curX, &curY);}
 
 				action ssaalign {
 					if (!setAlignForDiv) {
@@ -428,8 +598,8 @@ NSArray *SubParsePacket(NSString *packet, SubContext *context, id<SubRenderer> d
 							|"s" flag %strikeout
 							|"bord" floatnum %outlinesize
 							|"shad" floatnum %shadowdist
-							|"be" floatnum
-							|"blur" floatnum
+							|"be" floatnum %bluredge
+							|"blur" floatnum %blur
 							|"fax" floatnum
 							|"fay" floatnum
 							|"fn" string %fontname
@@ -452,7 +622,9 @@ NSArray *SubParsePacket(NSString *packet, SubContext *context, id<SubRenderer> d
 							|"4a" color %shadowa
 							|"a" intnum %ssaalign
 							|"an" intnum %align
-							|[kK] [fo]? intnum
+							|"k" intnum %karaokeswitch
+							|("K" | [kK] "f") intnum %karaokesweep
+							|[kK] "o" intnum %karaokeoutline
 							|"q" intnum %wrapstyle
 							|"r" string %stylerevert
 							|"pos" pos %position
@@ -464,8 +636,8 @@ NSArray *SubParsePacket(NSString *packet, SubContext *context, id<SubRenderer> d
 							|"i"? "clip" parens
 							|"p" floatnum %drawingmode
 							|"pbo" floatnum %drawingoffset
-							|"xbord" floatnum
-							|"ybord" floatnum
+							|"xbord" floatnum %outlinesizex
+							|"ybord" floatnum %outlinesizey
 							|"xshad" floatnum
 							|"yshad" floatnum
 					   );
@@ -515,6 +687,7 @@ NSArray *SubParsePacket(NSString *packet, SubContext *context, id<SubRenderer> d
 					chars_deleted += (p - last_tag_start);
 					
 					current_span->offset = (p - pb) - chars_deleted;
+					if (div->karaoke) [div->karaoke startPendingSyllablesAtOffset:current_span->offset];
 					outputbegin = p;
 					
 					p--;
@@ -532,7 +705,8 @@ NSArray *SubParsePacket(NSString *packet, SubContext *context, id<SubRenderer> d
 			%%write eof;
 
 			if (!reachedEnd) Codecprintf(NULL, "parse error: %s\n", [inputText UTF8String]);
-			linebufData = nil;
+			[div->karaoke finishAtOffset:[text length]];
+			SubUnicodeBufferEnd(&linebuffer);
 			[divs addObject:div];
 		}
 		
@@ -0,0 +1,53 @@
+//
+//  SubPreroll.h
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreGraphics/CoreGraphics.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+typedef void (^SubPrerollProgressHandler)(double fractionCompleted);
+
+/**
+ * @brief Warms font and glyph caches for a whole script ahead of playback.
+ *
+ * @discussion A preroll scans every event in the script and counts the characters
+ * drawn with each font, following <code>\\fn</code>, <code>\\b</code>, <code>\\i</code>
+ * and <code>\\r</code> overrides. It then resolves each font, fills the
+ * <code>GetWinCTFontSizeScale</code> cache and has CoreText build metrics and glyph
+ * images, most frequent characters first.
+ *
+ * All of this happens on a background queue. Nothing it produces needs to be handed
+ * to a renderer: the caches it fills are shared by the whole process.
+ */
+@interface SubPreroll : NSObject
+
+- (instancetype)init UNAVAILABLE_ATTRIBUTE;
+/// \c script is a complete SSA/ASS script. \c height is the video height glyphs will be drawn at.
+- (instancetype)initWithScript:(NSString *)script videoHeight:(CGFloat)height NS_DESIGNATED_INITIALIZER;
+
+/**
+ * @brief Starts prerolling on a background queue.
+ *
+ * @discussion Both handlers are called on that queue. \c finished is \c NO if the preroll was cancelled.
+ * Does nothing if the preroll was already started.
+ */
+- (void)startWithProgressHandler:(nullable SubPrerollProgressHandler)progress completionHandler:(nullable void (^)(BOOL finished))completion;
+
+/// Stops the preroll as soon as possible. The completion handler is still called.
+- (void)cancel;
+/// Blocks until a started preroll has finished or been cancelled.
+- (void)waitUntilFinished;
+
+@property (readonly, getter=isCancelled) BOOL cancelled;
+/// Number of distinct fonts (name, bold, italic) the script uses. Valid once the preroll is finished.
+@property (readonly) NSUInteger fontCount;
+
+@end
+
+NS_ASSUME_NONNULL_END
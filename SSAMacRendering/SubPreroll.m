@@ -0,0 +1,429 @@
+//
+//  SubPreroll.m
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+#include <stdatomic.h>
+#include <CoreText/CoreText.h>
+#import "SubPreroll.h"
+#import "SubContext.h"
+#import "SubParsing.h"
+#import "SubUtilities.h"
+#include "CommonUtils.h"
+
+//! Glyphs are drawn and measured this many at a time, checking for cancellation in between.
+#define kSubPrerollGlyphBatch 256
+
+#pragma mark Character histograms
+
+//! Counts of each codepoint drawn with a font. An open-addressed table; empty slots have a zero count.
+typedef struct SubCharHistogram {
+	uint32_t *chars, *counts;
+	size_t capacity, used;
+} SubCharHistogram;
+
+static void HistogramInsert(SubCharHistogram *h, uint32_t c, uint32_t count)
+{
+	size_t mask = h->capacity - 1, i = (c * 2654435761U) & mask;
+
+	while (h->counts[i] && h->chars[i] != c) i = (i + 1) & mask;
+
+	if (!h->counts[i]) {
+		h->chars[i] = c;
+		h->used++;
+	}
+	h->counts[i] += count;
+}
+
+static void HistogramAdd(SubCharHistogram *h, uint32_t c)
+{
+	if ((h->used + 1) * 2 > h->capacity) {
+		SubCharHistogram old = *h;
+
+		h->capacity = old.capacity ? old.capacity * 2 : 64;
+		h->used = 0;
+		h->chars = calloc(h->capacity, sizeof(uint32_t));
+		h->counts = calloc(h->capacity, sizeof(uint32_t));
+
+		for (size_t i = 0; i < old.capacity; i++)
+			if (old.counts[i]) HistogramInsert(h, old.chars[i], old.counts[i]);
+
+		free(old.chars);
+		free(old.counts);
+	}
+
+	HistogramInsert(h, c, 1);
+}
+
+typedef struct SubCharCount {
+	uint32_t c, count;
+} SubCharCount;
+
+static int CompareCharCounts(const void *a, const void *b)
+{
+	const SubCharCount *ca = a, *cb = b;
+
+	if (ca->count != cb->count) return ca->count > cb->count ? -1 : 1;
+	return ca->c < cb->c ? -1 : (ca->c > cb->c);
+}
+
+//! Returns the histogram's characters, most frequent first. The caller frees the result.
+static SubCharCount *HistogramCopySorted(const SubCharHistogram *h)
+{
+	SubCharCount *sorted = malloc(MAX(h->used, 1) * sizeof(SubCharCount));
+	size_t n = 0;
+
+	for (size_t i = 0; i < h->capacity; i++)
+		if (h->counts[i]) sorted[n++] = (SubCharCount){h->chars[i], h->counts[i]};
+
+	qsort(sorted, n, sizeof(SubCharCount), CompareCharCounts);
+	return sorted;
+}
+
+#pragma mark -
+
+//! One font a script draws with, and what it draws.
+@interface SubPrerollFont : NSObject {
+@public;
+	NSString *name;
+	BOOL bold, italic;
+	CGFloat size;
+	SubCharHistogram histogram;
+}
+@end
+
+@implementation SubPrerollFont
+-(void)dealloc
+{
+	free(histogram.chars);
+	free(histogram.counts);
+}
+@end
+
+@implementation SubPreroll
+{
+	NSString *script;
+	CGFloat videoHeight;
+	SubContext *context;
+	NSMutableDictionary<NSString*,SubPrerollFont*> *fonts;
+	dispatch_group_t group;
+	atomic_bool cancelled, started;
+
+	SubPrerollProgressHandler progressHandler;
+	int lastPercent;
+	double phaseStart, phaseWeight;
+	NSUInteger phaseDone, phaseTotal;
+}
+
+- (instancetype)initWithScript:(NSString *)s videoHeight:(CGFloat)height
+{
+	if (self = [super init]) {
+		script = [s copy];
+		videoHeight = height;
+		fonts = [[NSMutableDictionary alloc] init];
+		group = dispatch_group_create();
+		atomic_init(&cancelled, false);
+		atomic_init(&started, false);
+		lastPercent = -1;
+	}
+
+	return self;
+}
+
+- (BOOL)isCancelled
+{
+	return atomic_load(&cancelled);
+}
+
+- (void)cancel
+{
+	atomic_store(&cancelled, true);
+}
+
+- (void)waitUntilFinished
+{
+	dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+}
+
+- (NSUInteger)fontCount
+{
+	return [fonts count];
+}
+
+- (void)startWithProgressHandler:(SubPrerollProgressHandler)progress completionHandler:(void (^)(BOOL))completion
+{
+	if (atomic_exchange(&started, true)) return;
+
+	progressHandler = [progress copy];
+
+	dispatch_group_async(group, dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+		BOOL finished;
+
+		@autoreleasepool {
+			finished = [self run];
+		}
+
+		self->progressHandler = nil;
+		if (completion) completion(finished);
+	});
+}
+
+//! Reports progress, at most once per percent.
+- (void)reportProgress:(double)fraction
+{
+	int percent = (int)(fraction * 100);
+	
+	if (percent != lastPercent) {
+		lastPercent = percent;
+		if (progressHandler) progressHandler(fraction);
+	}
+}
+
+//! Starts a part of the work that covers \c weight of the whole, starting at \c start.
+- (void)beginPhaseAt:(double)start weight:(double)weight total:(NSUInteger)total
+{
+	phaseStart = start;
+	phaseWeight = weight;
+	phaseDone = 0;
+	phaseTotal = total;
+}
+
+- (void)advance:(NSUInteger)work
+{
+	phaseDone += work;
+	[self reportProgress:phaseStart + phaseWeight * MIN(phaseDone, phaseTotal) / (double)MAX(phaseTotal, 1)];
+}
+
+- (SubPrerollFont *)fontNamed:(NSString *)name bold:(BOOL)bold italic:(BOOL)italic size:(CGFloat)size
+{
+	SubParseFontVerticality(&name);
+
+	NSString *key = [NSString stringWithFormat:@"%@/%d%d/%g", name, bold, italic, size];
+	SubPrerollFont *font = [fonts objectForKey:key];
+
+	if (!font) {
+		font = [[SubPrerollFont alloc] init];
+		font->name = name;
+		font->bold = bold;
+		font->italic = italic;
+		font->size = size;
+		[fonts setObject:font forKey:key];
+	}
+
+	return font;
+}
+
+- (SubPrerollFont *)fontForStyle:(SubStyle *)style
+{
+	return [self fontNamed:style->fontname bold:style->weight == 1 || style->weight >= 700 italic:style->italic size:style->size];
+}
+
+#pragma mark Scanning
+
+//! Follows the font-changing tags in one override block.
+- (SubPrerollFont *)scanTags:(const unichar *)p length:(NSUInteger)len font:(SubPrerollFont *)font eventFont:(SubPrerollFont *)eventFont styleFonts:(NSArray<SubPrerollFont*> *)styleFonts drawing:(BOOL *)drawing
+{
+	NSUInteger i = 0;
+
+	while (i < len) {
+		if (p[i++] != '\\') continue;
+
+		NSUInteger argEnd = i;
+		while (argEnd < len && p[argEnd] != '\\') argEnd++;
+
+		unichar t = (i < len) ? p[i] : 0, next = (i + 1 < len) ? p[i+1] : 0;
+
+		if (t == 'f' && next == 'n') {
+			NSString *name = [[NSString stringWithCharacters:p + i + 2 length:argEnd - i - 2] stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+			if (![name length]) name = eventFont->name;
+			font = [self fontNamed:name bold:font->bold italic:font->italic size:font->size];
+		} else if (t == 'r') {
+			NSInteger styleID = [context styleIDForCharacters:p + i + 1 length:argEnd - i - 1];
+			font = (styleID != NSNotFound) ? [styleFonts objectAtIndex:styleID] : eventFont;
+		} else if ((t == 'b' || t == 'i' || t == 'p') && next >= '0' && next <= '9') {
+			int value = SubParseIntCharacters(p + i + 1, argEnd - i - 1);
+
+			if (t == 'b')
+				font = [self fontNamed:font->name bold:value == 1 || value >= 700 italic:font->italic size:font->size];
+			else if (t == 'i')
+				font = [self fontNamed:font->name bold:font->bold italic:value != 0 size:font->size];
+			else
+				*drawing = value != 0;
+		}
+
+		i = argEnd;
+	}
+
+	return font;
+}
+
+- (void)scanEvent:(const unichar *)p length:(NSUInteger)len font:(SubPrerollFont *)eventFont styleFonts:(NSArray<SubPrerollFont*> *)styleFonts
+{
+	SubPrerollFont *font = eventFont;
+	BOOL drawing = NO;
+	NSUInteger i = 0;
+
+	while (i < len) {
+		unichar c = p[i];
+
+		if (c == '{') {
+			NSUInteger close = i + 1;
+			while (close < len && p[close] != '}') close++;
+
+			if (close < len) {
+				font = [self scanTags:p + i + 1 length:close - i - 1 font:font eventFont:eventFont styleFonts:styleFonts drawing:&drawing];
+				i = close + 1;
+				continue;
+			}
+		} else if (c == '\\' && i + 1 < len && (p[i+1] == 'N' || p[i+1] == 'n' || p[i+1] == 'h')) {
+			if (p[i+1] == 'h' && !drawing) HistogramAdd(&font->histogram, 0xA0);
+			i += 2;
+			continue;
+		}
+
+		i++;
+		if (drawing || c <= ' ') continue;
+
+		uint32_t codepoint = c;
+		if (CFStringIsSurrogateHighCharacter(c) && i < len && CFStringIsSurrogateLowCharacter(p[i]))
+			codepoint = CFStringGetLongCharacterForSurrogatePair(c, p[i++]);
+
+		HistogramAdd(&font->histogram, codepoint);
+	}
+}
+
+#pragma mark Warming
+
+- (BOOL)warmFont:(SubPrerollFont *)f inContext:(CGContextRef)c
+{
+	CTFontRef base = CTFontCreateWithName((__bridge CFStringRef)f->name, 0, NULL);
+	CTFontSymbolicTraits traits = (f->bold ? kCTFontBoldTrait : 0) | (f->italic ? kCTFontItalicTrait : 0);
+	CTFontRef styled = traits ? CTFontCreateCopyWithSymbolicTraits(base, 0, NULL, traits, kCTFontBoldTrait | kCTFontItalicTrait) : NULL;
+	CTFontRef unsized = styled ? styled : base;
+	CGFloat sizeScale = GetWinCTFontSizeScale(unsized);
+	CGFloat screenScale = context->resY ? videoHeight / context->resY : 1;
+	CTFontRef font = CTFontCreateCopyWithAttributes(unsized, f->size * sizeScale * screenScale, NULL, NULL);
+	SubCharCount *chars = HistogramCopySorted(&f->histogram);
+	size_t count = f->histogram.used;
+	BOOL finished = YES;
+
+	CTFontGetAscent(font);
+	CTFontGetDescent(font);
+
+	for (size_t start = 0; start < count; start += kSubPrerollGlyphBatch) {
+		UniChar unichars[kSubPrerollGlyphBatch * 2];
+		CGGlyph glyphs[kSubPrerollGlyphBatch * 2];
+		CGPoint positions[kSubPrerollGlyphBatch * 2] = {{0}};
+		CFIndex n = 0;
+
+		if (atomic_load(&cancelled)) {
+			finished = NO;
+			break;
+		}
+
+		for (size_t i = start; i < MIN(start + kSubPrerollGlyphBatch, count); i++) {
+			uint32_t cp = chars[i].c;
+
+			if (cp > 0xFFFF) {
+				CFStringGetSurrogatePairForLongCharacter(cp, &unichars[n]);
+				n += 2;
+			} else unichars[n++] = cp;
+		}
+
+		if (!CTFontGetGlyphsForCharacters(font, unichars, glyphs, n)) {
+			// some characters aren't in this font; have CoreText find the fallbacks now
+			CFStringRef str = CFStringCreateWithCharactersNoCopy(NULL, unichars, n, kCFAllocatorNull);
+
+			for (CFIndex i = 0; i < n; i++) {
+				if (glyphs[i] || CFStringIsSurrogateLowCharacter(unichars[i])) continue;
+				CFIndex length = CFStringIsSurrogateHighCharacter(unichars[i]) ? 2 : 1;
+				CTFontRef fallback = CTFontCreateForString(font, str, CFRangeMake(i, length));
+				CFRelease(fallback);
+			}
+
+			CFRelease(str);
+		}
+
+		CTFontGetAdvancesForGlyphs(font, kCTFontOrientationDefault, glyphs, NULL, n);
+		CTFontGetBoundingRectsForGlyphs(font, kCTFontOrientationDefault, glyphs, NULL, n);
+		CTFontDrawGlyphs(font, glyphs, positions, n, c);
+
+		[self advance:MIN(kSubPrerollGlyphBatch, count - start)];
+	}
+
+	free(chars);
+	CFRelease(font);
+	if (styled) CFRelease(styled);
+	CFRelease(base);
+
+	return finished;
+}
+
+- (BOOL)run
+{
+	NSDictionary<NSString*,NSString*> *headers;
+	NSArray<NSDictionary<NSString*,NSString*>*> *styles;
+	NSData *eventData;
+	SubUnicodeBuffer scriptBuffer;
+	const unichar *chars = SubUnicodeBufferBegin(&scriptBuffer, script);
+
+	SubParseSSAFileEventsCharacters(chars, scriptBuffer.length, &headers, &styles, &eventData);
+	context = [[SubContext alloc] initWithScriptType:kSubTypeSSA headers:headers styles:styles delegate:nil];
+
+	const SubSSAEvent *events = [eventData bytes];
+	NSUInteger eventCount = [eventData length] / sizeof(SubSSAEvent);
+	NSArray<SubStyle*> *styleList = [context styleList];
+	NSMutableArray<SubPrerollFont*> *styleFonts = [NSMutableArray arrayWithCapacity:[styleList count]];
+	SubPrerollFont *defaultFont = [self fontForStyle:context->defaultStyle];
+
+	for (SubStyle *style in styleList)
+		[styleFonts addObject:[self fontForStyle:style]];
+
+	// scanning is cheap next to the glyph work, so it only gets a fifth of the progress bar
+	[self beginPhaseAt:0 weight:.2 total:eventCount];
+
+	for (NSUInteger i = 0; i < eventCount; i++) {
+		NSRange styleName = events[i].fields[kSubEventFieldStyle], text = events[i].fields[kSubEventFieldText];
+
+		if (atomic_load(&cancelled)) {
+			SubUnicodeBufferEnd(&scriptBuffer);
+			return NO;
+		}
+
+		NSInteger styleID = [context styleIDForCharacters:chars + styleName.location length:styleName.length];
+		SubPrerollFont *font = (styleID != NSNotFound) ? [styleFonts objectAtIndex:styleID] : defaultFont;
+		
+		[self scanEvent:chars + text.location length:text.length font:font styleFonts:styleFonts];
+		[self advance:1];
+	}
+
+	SubUnicodeBufferEnd(&scriptBuffer);
+
+	NSUInteger glyphCount = 0;
+	for (SubPrerollFont *f in [fonts objectEnumerator])
+		glyphCount += f->histogram.used;
+	[self beginPhaseAt:.2 weight:.8 total:glyphCount];
+
+	CGColorSpaceRef csp = CGColorSpaceCreateDeviceGray();
+	CGContextRef c = CGBitmapContextCreate(NULL, 64, 64, 8, 0, csp, kCGImageAlphaNone);
+	BOOL finished = YES;
+
+	CGColorSpaceRelease(csp);
+
+	for (SubPrerollFont *f in [fonts objectEnumerator]) {
+		if (![self warmFont:f inContext:c]) {
+			finished = NO;
+			break;
+		}
+	}
+
+	CGContextRelease(c);
+
+	if (finished) [self reportProgress:1];
+	return finished;
+}
+
+@end
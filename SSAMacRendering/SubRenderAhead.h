@@ -0,0 +1,97 @@
+//
+//  SubRenderAhead.h
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreGraphics/CoreGraphics.h>
+#import <SSAMacRendering/SubImport.h>
+#import <SSAMacRendering/SubTimeline.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class SubCoreTextRenderer;
+
+//! Anything packets can be read from in display order.
+@protocol SubPacketSource <NSObject>
+/// Same contract as <code>-[SubSerializer getSerializedPacket]</code>.
+- (nullable SubLine *)getSerializedPacket;
+@optional
+/// Moves the read cursor to the packet displayed at \c time.
+- (void)seekToTime:(NSUInteger)time;
+//! Packet times are in units of <code>1/timeScale</code> seconds.
+@property (readonly) NSUInteger timeScale;
+@end
+
+@interface SubSerializer (SubPacketSource) <SubPacketSource>
+@end
+
+@interface SubTimeline (SubPacketSource) <SubPacketSource>
+@end
+
+typedef struct SubRenderAheadStatistics {
+	NSUInteger rendered;		//!< Packets drawn, ahead of time or not.
+	NSUInteger reused;			//!< Packets whose image was taken from an earlier packet with the same text.
+	NSUInteger hits;			//!< Packets that were ready when first asked for.
+	NSUInteger late;			//!< Packets that had to be drawn while the caller waited.
+	NSUInteger dropped;			//!< Packets drawn ahead but passed without ever being asked for.
+	NSUInteger redrawn;			//!< Karaoke packets drawn again for the time asked for.
+	double lateSeconds;			//!< Total time callers waited for late packets.
+	double worstLateSeconds;
+} SubRenderAheadStatistics;
+
+/**
+ * @brief Draws upcoming packets on a background queue so they're ready by the time they're shown.
+ *
+ * @discussion Packets are read from the source in order and drawn at \c size into images, which
+ * are handed out by time with <code>-copyImageAtTime:</code>. At most \c lookahead packets and
+ * \c maxCacheBytes of images are kept ahead of the last time asked for; the queue stops reading
+ * once either is reached and carries on as packets are passed. Packets with the same text reuse one image.
+ *
+ * Times are in the source's units. The renderer and the source belong to the render-ahead
+ * once it's created, and must not be used anywhere else.
+ *
+ * Packets with karaoke are drawn ahead as of their begin time. Asking for one at any other
+ * time draws it again on the spot, with each line highlighted as of its own event's start.
+ */
+@interface SubRenderAhead : NSObject
+
+- (instancetype)init UNAVAILABLE_ATTRIBUTE;
+- (instancetype)initWithRenderer:(SubCoreTextRenderer *)renderer source:(id<SubPacketSource>)source size:(CGSize)size NS_DESIGNATED_INITIALIZER;
+
+//! Output size. Changing it throws away everything drawn so far.
+@property (nonatomic) CGSize size;
+//! How many packets to keep drawn ahead. Defaults to 8.
+@property (nonatomic) NSUInteger lookahead;
+//! The most memory the drawn images may take. Defaults to 64 MB.
+@property (nonatomic) size_t maxCacheBytes;
+//! Source time units per second, for timing karaoke. Taken from the source if it has a \c timeScale, otherwise 100 as SSA uses.
+@property (nonatomic) NSUInteger timeScale;
+
+/// Starts drawing ahead. Does nothing if already started.
+- (void)start;
+/// Stops drawing ahead and waits for the packet being drawn, if any.
+- (void)stop;
+
+/**
+ * @brief Returns the image for the packet shown at \c time, or \c NULL if nothing is shown.
+ *
+ * @discussion Packets ending at or before \c time are dropped from the cache. If the packet
+ * hasn't been drawn yet, it's drawn before returning and counted as late.
+ */
+- (nullable CGImageRef)copyImageAtTime:(NSUInteger)time CF_RETURNS_RETAINED;
+
+/**
+ * Throws away everything drawn so far, resets the renderer and carries on from \c time.
+ * Sources that can't seek are read forward past \c time, so only seeking forward works with them.
+ */
+- (void)seekToTime:(NSUInteger)time;
+
+@property (readonly) SubRenderAheadStatistics statistics;
+
+@end
+
+NS_ASSUME_NONNULL_END
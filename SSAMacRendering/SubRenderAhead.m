@@ -0,0 +1,565 @@
+//
+//  SubRenderAhead.m
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+#include <stdatomic.h>
+#import "SubRenderAhead.h"
+#import "SubCoreTextRenderer.h"
+#import "Codecprintf.h"
+
+#define kSubRenderAheadDefaultLookahead 8
+#define kSubRenderAheadDefaultCacheBytes (64 * 1024 * 1024)
+#define kSubRenderAheadDefaultTimeScale 100
+
+@implementation SubSerializer (SubPacketSource)
+@end
+
+@implementation SubTimeline (SubPacketSource)
+@end
+
+//! One packet read from the source, and its image once it's drawn.
+@interface SubRenderAheadFrame : NSObject {
+@public;
+	SubLine *line;
+	CGImageRef image; //!< NULL for blank packets
+	size_t bytes; //!< the size of \c image, even if another frame has it too
+	NSUInteger drawnTime; //!< the time karaoke is highlighted for in \c image
+	BOOL drawn, shown;
+	BOOL karaoke; //!< the image depends on the time, so it's never shared
+}
+@end
+
+@implementation SubRenderAheadFrame
+
+- (void)dealloc
+{
+	CGImageRelease(image);
+}
+
+@end
+
+static BOOL IsBlankPacket(NSString *packet)
+{
+	return [[packet stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]] length] == 0;
+}
+
+//! Whether \c packet may have \\k tags. A false positive only costs redrawing it.
+static BOOL HasKaraoke(NSString *packet)
+{
+	return [packet rangeOfString:@"\\k" options:NSCaseInsensitiveSearch].location != NSNotFound;
+}
+
+@implementation SubRenderAhead
+{
+	SubCoreTextRenderer *renderer;
+	id<SubPacketSource> source;
+	dispatch_queue_t queue; //!< the only place the renderer and source are used
+	CGColorSpaceRef colorSpace;
+	atomic_bool fillScheduled;
+
+	// everything below is guarded by @synchronized(self)
+	NSMutableArray<SubRenderAheadFrame*> *frames; //!< in display order
+	CFMutableBagRef imageUses; //!< each frame's image, once per frame holding it
+	size_t cacheBytes; //!< the size of the distinct images in \c imageUses
+	NSUInteger generation; //!< bumped whenever drawn images are thrown away
+	NSUInteger seekCount, sourceSeekCount; //!< seeks asked for and seeks the source has done
+	NSUInteger skipUntil;
+	BOOL running, exhausted;
+	SubRenderAheadStatistics stats;
+}
+@synthesize size;
+@synthesize lookahead;
+@synthesize maxCacheBytes;
+@synthesize timeScale;
+
+- (instancetype)initWithRenderer:(SubCoreTextRenderer *)r source:(id<SubPacketSource>)s size:(CGSize)sz
+{
+	if (self = [super init]) {
+		renderer = r;
+		source = s;
+		size = sz;
+		lookahead = kSubRenderAheadDefaultLookahead;
+		maxCacheBytes = kSubRenderAheadDefaultCacheBytes;
+		timeScale = [s respondsToSelector:@selector(timeScale)] ? [s timeScale] : 0;
+		if (!timeScale) timeScale = kSubRenderAheadDefaultTimeScale;
+		queue = dispatch_queue_create("SubRenderAhead", dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_USER_INITIATED, 0));
+		colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+		frames = [[NSMutableArray alloc] init];
+		imageUses = CFBagCreateMutable(NULL, 0, NULL);
+		atomic_init(&fillScheduled, false);
+	}
+
+	return self;
+}
+
+- (void)dealloc
+{
+	CGColorSpaceRelease(colorSpace);
+	CFRelease(imageUses);
+}
+
+#pragma mark Cache size
+
+//! Counts \c bytes unless another frame already holds \c image. Must be called inside @synchronized(self).
+- (void)addImage:(CGImageRef)image bytes:(size_t)bytes
+{
+	if (!image) return;
+
+	if (!CFBagContainsValue(imageUses, image)) cacheBytes += bytes;
+	CFBagAddValue(imageUses, image);
+}
+
+//! Stops counting \c bytes once no frame holds \c image. Must be called inside @synchronized(self).
+- (void)removeImage:(CGImageRef)image bytes:(size_t)bytes
+{
+	if (!image) return;
+
+	CFBagRemoveValue(imageUses, image);
+	if (!CFBagContainsValue(imageUses, image)) cacheBytes -= bytes;
+}
+
+//! Must be called inside @synchronized(self).
+- (void)removeAllImages
+{
+	CFBagRemoveAllValues(imageUses);
+	cacheBytes = 0;
+}
+
+#pragma mark Settings
+
+- (CGSize)size
+{
+	@synchronized (self) {
+		return size;
+	}
+}
+
+- (void)setSize:(CGSize)sz
+{
+	@synchronized (self) {
+		if (CGSizeEqualToSize(sz, size)) return;
+
+		size = sz;
+		generation++;
+		[self removeAllImages];
+
+		// keep the packets, since the source can't give them again
+		for (SubRenderAheadFrame *frame in frames) {
+			CGImageRelease(frame->image);
+			frame->image = NULL;
+			frame->bytes = 0;
+			frame->drawn = NO;
+		}
+	}
+
+	[self scheduleFill];
+}
+
+- (NSUInteger)lookahead
+{
+	@synchronized (self) {
+		return lookahead;
+	}
+}
+
+- (void)setLookahead:(NSUInteger)l
+{
+	@synchronized (self) {
+		lookahead = MAX(l, 1);
+	}
+
+	[self scheduleFill];
+}
+
+- (size_t)maxCacheBytes
+{
+	@synchronized (self) {
+		return maxCacheBytes;
+	}
+}
+
+- (void)setMaxCacheBytes:(size_t)m
+{
+	@synchronized (self) {
+		maxCacheBytes = m;
+	}
+
+	[self scheduleFill];
+}
+
+- (NSUInteger)timeScale
+{
+	@synchronized (self) {
+		return timeScale;
+	}
+}
+
+- (void)setTimeScale:(NSUInteger)t
+{
+	@synchronized (self) {
+		timeScale = MAX(t, 1);
+	}
+}
+
+- (SubRenderAheadStatistics)statistics
+{
+	@synchronized (self) {
+		return stats;
+	}
+}
+
+#pragma mark Drawing
+
+- (void)start
+{
+	@synchronized (self) {
+		running = YES;
+	}
+
+	[self scheduleFill];
+}
+
+- (void)stop
+{
+	@synchronized (self) {
+		running = NO;
+	}
+
+	dispatch_sync(queue, ^{});
+}
+
+//! Whether the queue should draw another packet. Must be called inside @synchronized(self).
+- (BOOL)needsFill
+{
+	if (!running) return NO;
+
+	for (SubRenderAheadFrame *frame in frames) {
+		if (!frame->drawn) return YES;
+	}
+
+	return !exhausted && [frames count] < lookahead && cacheBytes < maxCacheBytes;
+}
+
+//! Draws one packet at a time, so late packets and seeks never wait behind a whole batch.
+- (void)scheduleFill
+{
+	if (atomic_exchange(&fillScheduled, true)) return;
+
+	dispatch_async(queue, ^{
+		BOOL more;
+
+		atomic_store(&self->fillScheduled, false);
+		@synchronized (self) {
+			more = [self needsFill];
+		}
+
+		if (more) {
+			@autoreleasepool {
+				more = [self drawNextPacket];
+			}
+			if (more) [self scheduleFill];
+		}
+	});
+}
+
+//! Reads the next packet from the source, skipping ones that end before a seek. Runs on the queue.
+- (SubLine *)readPacket
+{
+	SubLine *line;
+	NSUInteger skip;
+
+	@synchronized (self) {
+		// a seek is still waiting on the queue, and what the source gives now would be thrown away
+		if (seekCount != sourceSeekCount) return nil;
+		skip = skipUntil;
+	}
+
+	do {
+		line = [source getSerializedPacket];
+	} while (line && line.endTime <= skip);
+
+	if (!line) {
+		@synchronized (self) {
+			exhausted = YES;
+		}
+	}
+
+	return line;
+}
+
+//! Draws \c line, with karaoke as of \c time if \c karaoke is set. Runs on the queue.
+- (CGImageRef)createImageOfLine:(SubLine *)line karaoke:(BOOL)karaoke time:(NSUInteger)time size:(CGSize)sz bytes:(size_t *)bytes
+{
+	NSUInteger scale = self.timeScale;
+	size_t width = sz.width, height = sz.height;
+	CGContextRef c = CGBitmapContextCreate(NULL, width, height, 8, width * 4, colorSpace, kCGImageAlphaPremultipliedFirst | kCGBitmapByteOrder32Host);
+	CGImageRef image = NULL;
+
+	if (!c) {
+		Codecprintf(NULL, "Couldn't create a %zux%zu context to draw ahead into\n", width, height);
+		return NULL;
+	}
+
+	@try {
+		if (karaoke) [renderer renderPacket:line.line eventBeginTimes:line.eventBeginTimes inContext:c size:sz time:time timeScale:scale];
+		else [renderer renderPacket:line.line inContext:c size:sz];
+		image = CGBitmapContextCreateImage(c);
+		*bytes = CGBitmapContextGetBytesPerRow(c) * height;
+	}
+	@catch (NSException *e) {
+		NSLog(@"Caught exception during rendering - %@", e);
+	}
+
+	CGContextRelease(c);
+	return image;
+}
+
+//! Draws \c frame at the current size, or shares an image already drawn for the same text. Runs on the queue.
+- (void)drawFrame:(SubRenderAheadFrame *)frame
+{
+	NSString *packet = frame->line.line;
+	CGImageRef image = NULL;
+	NSUInteger gen;
+	NSUInteger time = frame->line.beginTime;
+	CGSize sz;
+	size_t bytes = 0;
+	BOOL reused = NO;
+
+	@synchronized (self) {
+		gen = generation;
+		sz = size;
+
+		for (SubRenderAheadFrame *other in frames) {
+			if (other != frame && !frame->karaoke && other->drawn && [other->line.line isEqualToString:packet]) {
+				image = CGImageRetain(other->image);
+				bytes = other->bytes;
+				reused = YES;
+				break;
+			}
+		}
+	}
+
+	if (!reused && !IsBlankPacket(packet)) {
+		image = [self createImageOfLine:frame->line karaoke:frame->karaoke time:time size:sz bytes:&bytes];
+	}
+
+	@synchronized (self) {
+		if (gen == generation && !frame->drawn && [frames indexOfObjectIdenticalTo:frame] != NSNotFound) {
+			frame->image = image;
+			frame->bytes = bytes;
+			frame->drawnTime = time;
+			frame->drawn = YES;
+			[self addImage:image bytes:bytes];
+			if (reused) stats.reused++;
+			else if (image) stats.rendered++;
+			image = NULL;
+		}
+	}
+
+	CGImageRelease(image);
+}
+
+//! Draws a karaoke frame again as of \c time, replacing its image. Runs on the queue.
+- (void)redrawFrame:(SubRenderAheadFrame *)frame atTime:(NSUInteger)time
+{
+	CGImageRef image;
+	NSUInteger gen;
+	CGSize sz;
+	size_t bytes = 0;
+
+	@synchronized (self) {
+		gen = generation;
+		sz = size;
+	}
+
+	image = [self createImageOfLine:frame->line karaoke:YES time:time size:sz bytes:&bytes];
+
+	@synchronized (self) {
+		if (gen == generation && frame->drawn && [frames indexOfObjectIdenticalTo:frame] != NSNotFound) {
+			CGImageRef old = frame->image;
+
+			[self removeImage:old bytes:frame->bytes];
+			[self addImage:image bytes:bytes];
+			frame->image = image;
+			frame->bytes = bytes;
+			frame->drawnTime = time;
+			stats.redrawn++;
+			image = old;
+		}
+	}
+
+	CGImageRelease(image);
+}
+
+//! Draws the first packet not drawn yet, reading a new one if there isn't any. Runs on the queue.
+- (BOOL)drawNextPacket
+{
+	SubRenderAheadFrame *frame = nil;
+
+	@synchronized (self) {
+		for (SubRenderAheadFrame *f in frames) {
+			if (!f->drawn) {
+				frame = f;
+				break;
+			}
+		}
+	}
+
+	if (!frame) {
+		SubLine *line = [self readPacket];
+
+		if (!line) return NO;
+
+		frame = [[SubRenderAheadFrame alloc] init];
+		frame->line = line;
+		frame->karaoke = HasKaraoke(line.line);
+
+		@synchronized (self) {
+			// read from before a seek that came in meanwhile
+			if (seekCount != sourceSeekCount) return NO;
+			[frames addObject:frame];
+		}
+	}
+
+	[self drawFrame:frame];
+	return YES;
+}
+
+#pragma mark Playback
+
+//! Drops frames that end at or before \c time. Must be called inside @synchronized(self).
+- (void)dropFramesBefore:(NSUInteger)time
+{
+	NSUInteger count = 0;
+
+	for (SubRenderAheadFrame *frame in frames) {
+		if (frame->line.endTime > time) break;
+
+		if (frame->drawn && !frame->shown) stats.dropped++;
+		[self removeImage:frame->image bytes:frame->bytes];
+		count++;
+	}
+
+	if (count) [frames removeObjectsInRange:NSMakeRange(0, count)];
+}
+
+//! Must be called inside @synchronized(self).
+- (SubRenderAheadFrame *)frameAtTime:(NSUInteger)time
+{
+	for (SubRenderAheadFrame *frame in frames) {
+		if (frame->line.beginTime > time) break;
+		if (frame->line.endTime > time) return frame;
+	}
+
+	return nil;
+}
+
+- (CGImageRef)copyImageAtTime:(NSUInteger)time
+{
+	__block CGImageRef image = NULL;
+	__block BOOL found = NO;
+
+	@synchronized (self) {
+		SubRenderAheadFrame *frame;
+
+		exhausted = NO; // the source may have been given more lines since it last ran dry
+		[self dropFramesBefore:time];
+		frame = [self frameAtTime:time];
+
+		if (frame && frame->drawn && (!frame->karaoke || frame->drawnTime == time)) {
+			if (!frame->shown) stats.hits++;
+			frame->shown = YES;
+			image = CGImageRetain(frame->image);
+			found = YES;
+		}
+	}
+
+	if (found) {
+		[self scheduleFill];
+		return image;
+	}
+
+	CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+
+	dispatch_sync(queue, ^{
+		for (;;) {
+			SubRenderAheadFrame *frame;
+			BOOL redraw = NO;
+
+			@autoreleasepool {
+				@synchronized (self) {
+					[self dropFramesBefore:time];
+					frame = [self frameAtTime:time];
+
+					// drawn, but with karaoke as of another time
+					if (frame && frame->drawn && frame->karaoke && frame->drawnTime != time) redraw = YES;
+					else if (frame && frame->drawn) {
+						if (!frame->shown) {
+							double wait = CFAbsoluteTimeGetCurrent() - start;
+
+							self->stats.late++;
+							self->stats.lateSeconds += wait;
+							self->stats.worstLateSeconds = MAX(self->stats.worstLateSeconds, wait);
+						}
+						frame->shown = YES;
+						image = CGImageRetain(frame->image);
+						return;
+					}
+
+					// nothing is shown at this time
+					if (!frame && [self->frames count] && ((SubRenderAheadFrame *)[self->frames lastObject])->line.beginTime > time) return;
+				}
+
+				if (redraw) [self redrawFrame:frame atTime:time];
+				else if (frame) [self drawFrame:frame];
+				else if (![self drawNextPacket]) return;
+			}
+		}
+	});
+
+	[self scheduleFill];
+	return image;
+}
+
+- (void)seekToTime:(NSUInteger)time
+{
+	NSUInteger seek;
+
+	@synchronized (self) {
+		generation++;
+		seek = ++seekCount;
+		[frames removeAllObjects];
+		[self removeAllImages];
+		skipUntil = time;
+		exhausted = NO;
+	}
+
+	dispatch_async(queue, ^{
+		// lines on screen after the seek shouldn't dodge ones from before it
+		[self->renderer reset];
+
+		if ([self->source respondsToSelector:@selector(seekToTime:)]) {
+			[self->source seekToTime:time];
+		}
+
+		@synchronized (self) {
+			self->sourceSeekCount = seek;
+		}
+	});
+
+	[self scheduleFill];
+}
+
+- (NSString *)description
+{
+	@synchronized (self) {
+		return [NSString stringWithFormat:@"%@ %lu packets ahead (%zu bytes), %lu drawn, %lu late", [super description],
+				(unsigned long)[frames count], cacheBytes, (unsigned long)stats.rendered, (unsigned long)stats.late];
+	}
+}
+
+@end
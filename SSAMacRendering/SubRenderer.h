@@ -42,6 +42,7 @@ typedef NS_ENUM(int, SubSSATagName) {
 	tag_fry, tag_frz, tag_1c, tag_2c, tag_3c, tag_4c, tag_alpha,
 	tag_1a, tag_2a, tag_3a, tag_4a, tag_r, tag_p,
 	tag_t, tag_pbo, tag_fad, tag_fade,
+	tag_blur, tag_xbord, tag_ybord,
 };
 
 @protocol SubRenderer <NSObject>
@@ -75,9 +76,61 @@ extern SubRendererRef __nullable SubRendererCreate(bool isSSA,  char * _Nullable
 extern SubRendererRef __nullable SubRendererCreateCF(bool isSSA, __nullable CFStringRef header, int width, int height) CF_RETURNS_RETAINED;
 extern void SubRendererPrerollFromHeader(char * _Nullable header, int headerLen);
 extern void SubRendererPrerollFromCFHeader(CFStringRef _Nullable header);
+
+//This is actually a SubPreroll
+typedef struct CF_BRIDGED_TYPE(id) __SubPrerollPtr *SubPrerollRef CF_SWIFT_NAME(SubPrerollRef);
+typedef void (*SubPrerollProgressCallback)(void * _Nullable refcon, double fractionCompleted);
+
+//! Starts prerolling a whole SSA/ASS script on a background thread. \c progress is called on that thread.
+extern SubPrerollRef __nullable SubRendererPrerollScriptAsync(CFStringRef script, int height, SubPrerollProgressCallback _Nullable progress, void * _Nullable refcon) CF_RETURNS_RETAINED;
+extern void SubRendererPrerollCancel(SubPrerollRef p);
+//! Cancels the preroll and waits for it to stop, so \c progress won't be called after this returns.
+extern void SubRendererPrerollDispose(CF_CONSUMED SubPrerollRef p) CF_SWIFT_UNAVAILABLE("Release is called automatically");
 extern void SubRendererRenderPacket(SubRendererRef s, CGContextRef c, CFStringRef str, int cWidth, int cHeight);
+//! Like \c SubRendererRenderPacket, highlighting karaoke lines as of \c karaokeTime milliseconds into the event. Only right for packets with one karaoke event.
+extern void SubRendererRenderPacketAtKaraokeTime(SubRendererRef s, CGContextRef c, CFStringRef str, int cWidth, int cHeight, int karaokeTime);
+/**
+ * Like \c SubRendererRenderPacket, highlighting each karaoke line as of \c time into its own event.
+ * \c time is in units of <code>1/timeScale</code> seconds, like the packet's times, and \c eventBeginTimes
+ * holds a \c CFNumber per line of the packet with when its event began, as <code>-[SubLine eventBeginTimes]</code> does.
+ */
+extern void SubRendererRenderPacketAtTime(SubRendererRef s, CGContextRef c, CFStringRef str, CFArrayRef __nullable eventBeginTimes, int cWidth, int cHeight, long time, unsigned timeScale);
+//! Call after seeking. See <code>-[SubCoreTextRenderer reset]</code>.
+extern void SubRendererReset(SubRendererRef s);
 extern void SubRendererDispose(CF_CONSUMED SubRendererRef s) CF_SWIFT_UNAVAILABLE("Release is called automatically");
 
+//! Which layer of a subtitle a SubRenderImage is. Images of one div are listed shadow first.
+typedef CF_ENUM(uint8_t, SubRenderImageKind) {
+	kSubRenderImageShadow,
+	kSubRenderImageOutline,
+	kSubRenderImageFill
+};
+
+//! One tightly bounded piece of a rendered packet: an 8-bit coverage mask drawn in a single color.
+typedef struct SubRenderImage {
+	int x, y;					//!< Top left corner, in pixels from the top left of the output. Always inside it.
+	int width, height;
+	ptrdiff_t stride;
+	uint32_t color;				//!< 0xRRGGBBAA in sRGB, not premultiplied. AA is the opacity to draw the mask with.
+	SubRenderImageKind kind;
+	const uint8_t *alpha;		//!< \c height rows of \c stride bytes, the top one first.
+} SubRenderImage;
+
+//This is actually a SubRenderImageList
+typedef struct CF_BRIDGED_TYPE(id) __SubRenderImageListPtr *SubRenderImageListRef CF_SWIFT_NAME(SubRenderImageListRef);
+
+/**
+ * Renders a packet as a back to front list of images covering only its ink, instead of into a bitmap.
+ * Pass -1 as \c karaokeTime to leave karaoke unhighlighted.
+ */
+extern SubRenderImageListRef __nullable SubRendererCreateImageList(SubRendererRef s, CFStringRef str, int cWidth, int cHeight, int karaokeTime) CF_RETURNS_RETAINED;
+//! Same as \c SubRendererCreateImageList, timing karaoke as \c SubRendererRenderPacketAtTime does.
+extern SubRenderImageListRef __nullable SubRendererCreateImageListAtTime(SubRendererRef s, CFStringRef str, CFArrayRef __nullable eventBeginTimes, int cWidth, int cHeight, long time, unsigned timeScale) CF_RETURNS_RETAINED;
+extern size_t SubRenderImageListGetCount(SubRenderImageListRef l);
+//! The images, valid until the list is disposed. Several images may share one mask.
+extern const SubRenderImage *__nullable SubRenderImageListGetImages(SubRenderImageListRef l);
+extern void SubRenderImageListDispose(CF_CONSUMED SubRenderImageListRef l) CF_SWIFT_UNAVAILABLE("Release is called automatically");
+
 CF_ASSUME_NONNULL_END
 
 __END_DECLS
@@ -10,6 +10,7 @@
 #import <CoreGraphics/CoreGraphics.h>
 #import "SubRenderer.h"
 #import "SubCoreTextRenderer.h"
+#import "SubPreroll.h"
 
 void SubRendererRenderPacket(SubRendererRef s, CGContextRef c, CFStringRef str, int cWidth, int cHeight)
 {
@@ -23,6 +24,75 @@ void SubRendererRenderPacket(SubRendererRef s, CGContextRef c, CFStringRef str,
 	}
 }
 
+void SubRendererRenderPacketAtKaraokeTime(SubRendererRef s, CGContextRef c, CFStringRef str, int cWidth, int cHeight, int karaokeTime)
+{
+	@autoreleasepool {
+		@try {
+			[(__bridge SubCoreTextRenderer*)s renderPacket:(__bridge NSString*)str inContext:c size:CGSizeMake(cWidth, cHeight) karaokeTime:karaokeTime];
+		}
+		@catch (NSException *e) {
+			NSLog(@"Caught exception during rendering - %@", e);
+		}
+	}
+}
+
+void SubRendererRenderPacketAtTime(SubRendererRef s, CGContextRef c, CFStringRef str, CFArrayRef eventBeginTimes, int cWidth, int cHeight, long time, unsigned timeScale)
+{
+	@autoreleasepool {
+		@try {
+			[(__bridge SubCoreTextRenderer*)s renderPacket:(__bridge NSString*)str eventBeginTimes:(__bridge NSArray*)eventBeginTimes inContext:c size:CGSizeMake(cWidth, cHeight) time:time timeScale:timeScale];
+		}
+		@catch (NSException *e) {
+			NSLog(@"Caught exception during rendering - %@", e);
+		}
+	}
+}
+
+SubRenderImageListRef SubRendererCreateImageList(SubRendererRef s, CFStringRef str, int cWidth, int cHeight, int karaokeTime)
+{
+	@autoreleasepool {
+		SubRenderImageListRef l = NULL;
+		@try {
+			l = (SubRenderImageListRef)CFBridgingRetain([(__bridge SubCoreTextRenderer*)s imagesForPacket:(__bridge NSString*)str size:CGSizeMake(cWidth, cHeight) karaokeTime:karaokeTime]);
+		}
+		@catch (NSException *e) {
+			NSLog(@"Caught exception during rendering - %@", e);
+		}
+		return l;
+	}
+}
+
+SubRenderImageListRef SubRendererCreateImageListAtTime(SubRendererRef s, CFStringRef str, CFArrayRef eventBeginTimes, int cWidth, int cHeight, long time, unsigned timeScale)
+{
+	@autoreleasepool {
+		SubRenderImageListRef l = NULL;
+		@try {
+			l = (SubRenderImageListRef)CFBridgingRetain([(__bridge SubCoreTextRenderer*)s imagesForPacket:(__bridge NSString*)str eventBeginTimes:(__bridge NSArray*)eventBeginTimes size:CGSizeMake(cWidth, cHeight) time:time timeScale:timeScale]);
+		}
+		@catch (NSException *e) {
+			NSLog(@"Caught exception during rendering - %@", e);
+		}
+		return l;
+	}
+}
+
+size_t SubRenderImageListGetCount(SubRenderImageListRef l)
+{
+	return [(__bridge SubRenderImageList*)l count];
+}
+
+const SubRenderImage *SubRenderImageListGetImages(SubRenderImageListRef l)
+{
+	return [(__bridge SubRenderImageList*)l images];
+}
+
+void SubRenderImageListDispose(SubRenderImageListRef l)
+{
+	@autoreleasepool {
+		CFRelease(l);
+	}
+}
+
 void SubRendererPrerollFromCFHeader(CFStringRef header)
 {
 	id<SubRenderer> s = [[SubCoreTextRenderer alloc] initWithScriptType:header ? kSubTypeSSA : kSubTypeSRT header:(__bridge NSString *)(header) videoWidth:640 videoHeight:480];
@@ -60,6 +130,41 @@ void SubRendererPrerollFromHeader(char *header, int headerLen)
 	}
 }
 
+SubPrerollRef SubRendererPrerollScriptAsync(CFStringRef script, int height, SubPrerollProgressCallback progress, void *refcon)
+{
+	@autoreleasepool {
+		SubPreroll *p = [[SubPreroll alloc] initWithScript:(__bridge NSString *)script videoHeight:height];
+		
+		[p startWithProgressHandler:progress ? ^(double fractionCompleted) {
+			progress(refcon, fractionCompleted);
+		} : nil completionHandler:nil];
+		
+		return (SubPrerollRef)CFBridgingRetain(p);
+	}
+}
+
+void SubRendererPrerollCancel(SubPrerollRef p)
+{
+	[(__bridge SubPreroll *)p cancel];
+}
+
+void SubRendererPrerollDispose(SubPrerollRef p)
+{
+	@autoreleasepool {
+		SubPreroll *preroll = CFBridgingRelease(p);
+		
+		[preroll cancel];
+		[preroll waitUntilFinished];
+	}
+}
+
+void SubRendererReset(SubRendererRef s)
+{
+	@autoreleasepool {
+		[(__bridge SubCoreTextRenderer*)s reset];
+	}
+}
+
 void SubRendererDispose(SubRendererRef s)
 {
 	@autoreleasepool {
@@ -0,0 +1,265 @@
+//
+//  SubShapeCache.c
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "SubShapeCache.h"
+
+#define kSubShapeCacheSharedBytes (8 * 1024 * 1024)
+
+/*
+ * Entries are chained in a hash table and in a most recently used list.
+ * The key and the glyph arrays live in the same allocation as the entry.
+ * An evicted entry that a caller still holds is unlinked and freed on its last release.
+ */
+typedef struct SubShapeEntry {
+	SubShapedRun run;	//!< first, so a run pointer is an entry pointer
+	struct SubShapeEntry *hashNext, *lruPrev, *lruNext;
+	uint64_t hash;
+	size_t bytes;
+	unsigned refCount;	//!< one for being in the cache, one per caller
+
+	SubShapeKey key;	//!< face and text point into the entry
+} SubShapeEntry;
+
+struct SubShapeCache {
+	pthread_mutex_t lock;
+	SubShapeEntry **buckets;
+	size_t bucketCount;
+	SubShapeEntry *lruHead, *lruTail;
+	size_t maxBytes;
+	SubShapeCacheStatistics stats;
+};
+
+//! FNV-1a over the key's fields.
+static uint64_t HashKey(const SubShapeKey *key)
+{
+	uint64_t h = 14695981039346656037ULL;
+	double nums[4] = {key->size, key->scaleX, key->scaleY, key->tracking};
+
+#define hash_bytes(p, n) do { const uint8_t *b = (const uint8_t *)(p); for (size_t i = 0; i < (n); i++) { h ^= b[i]; h *= 1099511628211ULL; } } while (0)
+	hash_bytes(key->face, strlen(key->face));
+	hash_bytes(nums, sizeof(nums));
+	hash_bytes(&key->rightToLeft, sizeof(key->rightToLeft));
+	hash_bytes(key->text, key->length * sizeof(uint16_t));
+#undef hash_bytes
+
+	return h;
+}
+
+static bool KeysEqual(const SubShapeKey *a, const SubShapeKey *b)
+{
+	return a->length == b->length && a->size == b->size && a->scaleX == b->scaleX && a->scaleY == b->scaleY &&
+		a->tracking == b->tracking && a->rightToLeft == b->rightToLeft && !strcmp(a->face, b->face) &&
+		!memcmp(a->text, b->text, a->length * sizeof(uint16_t));
+}
+
+SubShapeCache *SubShapeCacheCreate(size_t maxBytes)
+{
+	SubShapeCache *cache = calloc(1, sizeof(SubShapeCache));
+
+	pthread_mutex_init(&cache->lock, NULL);
+	cache->bucketCount = 256;
+	cache->buckets = calloc(cache->bucketCount, sizeof(SubShapeEntry *));
+	cache->maxBytes = maxBytes;
+	return cache;
+}
+
+static pthread_once_t sharedOnce = PTHREAD_ONCE_INIT;
+static SubShapeCache *sharedCache;
+
+static void CreateSharedCache(void)
+{
+	sharedCache = SubShapeCacheCreate(kSubShapeCacheSharedBytes);
+}
+
+SubShapeCache *SubShapeCacheGetShared(void)
+{
+	pthread_once(&sharedOnce, CreateSharedCache);
+	return sharedCache;
+}
+
+#pragma mark Lists
+
+static void LRURemove(SubShapeCache *cache, SubShapeEntry *e)
+{
+	if (e->lruPrev) e->lruPrev->lruNext = e->lruNext;
+	else cache->lruHead = e->lruNext;
+	if (e->lruNext) e->lruNext->lruPrev = e->lruPrev;
+	else cache->lruTail = e->lruPrev;
+	e->lruPrev = e->lruNext = NULL;
+}
+
+static void LRUPushFront(SubShapeCache *cache, SubShapeEntry *e)
+{
+	e->lruPrev = NULL;
+	e->lruNext = cache->lruHead;
+	if (cache->lruHead) cache->lruHead->lruPrev = e;
+	else cache->lruTail = e;
+	cache->lruHead = e;
+}
+
+static SubShapeEntry **FindSlot(SubShapeCache *cache, const SubShapeKey *key, uint64_t hash)
+{
+	SubShapeEntry **slot = &cache->buckets[hash & (cache->bucketCount - 1)];
+
+	while (*slot && ((*slot)->hash != hash || !KeysEqual(&(*slot)->key, key))) slot = &(*slot)->hashNext;
+	return slot;
+}
+
+static void Grow(SubShapeCache *cache)
+{
+	size_t count = cache->bucketCount * 2;
+	SubShapeEntry **buckets = calloc(count, sizeof(SubShapeEntry *));
+
+	for (size_t i = 0; i < cache->bucketCount; i++) {
+		SubShapeEntry *e = cache->buckets[i], *next;
+
+		for (; e; e = next) {
+			next = e->hashNext;
+			e->hashNext = buckets[e->hash & (count - 1)];
+			buckets[e->hash & (count - 1)] = e;
+		}
+	}
+
+	free(cache->buckets);
+	cache->buckets = buckets;
+	cache->bucketCount = count;
+}
+
+//! Takes \c e out of the cache. It's freed now, or when its last caller releases it.
+static void Evict(SubShapeCache *cache, SubShapeEntry *e)
+{
+	*FindSlot(cache, &e->key, e->hash) = e->hashNext;
+	LRURemove(cache, e);
+	cache->stats.runCount--;
+	cache->stats.bytes -= e->bytes;
+	if (!--e->refCount) free(e);
+}
+
+#pragma mark -
+
+const SubShapedRun *SubShapeCacheCopyRun(SubShapeCache *cache, const SubShapeKey *key)
+{
+	uint64_t hash = HashKey(key);
+	SubShapeEntry *e;
+
+	pthread_mutex_lock(&cache->lock);
+	e = *FindSlot(cache, key, hash);
+	if (e) {
+		e->refCount++;
+		LRURemove(cache, e);
+		LRUPushFront(cache, e);
+		cache->stats.hits++;
+	} else {
+		cache->stats.misses++;
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	return e ? &e->run : NULL;
+}
+
+//! Makes an entry holding copies of the key and run in one allocation.
+static SubShapeEntry *CreateEntry(const SubShapeKey *key, const SubShapedRun *run, uint64_t hash)
+{
+	size_t faceLen = strlen(key->face) + 1, n = run->glyphCount;
+	size_t bytes = sizeof(SubShapeEntry) + key->length * sizeof(uint16_t) + n * (sizeof(float) + sizeof(uint32_t) + sizeof(uint16_t)) + faceLen;
+	SubShapeEntry *e = calloc(1, bytes);
+	// widest alignment first
+	float *advances = (float *)(e + 1);
+	uint32_t *clusters = (uint32_t *)(advances + n);
+	uint16_t *glyphs = (uint16_t *)(clusters + n), *text = glyphs + n;
+	char *face = (char *)(text + key->length);
+
+	memcpy(advances, run->advances, n * sizeof(float));
+	memcpy(clusters, run->clusters, n * sizeof(uint32_t));
+	memcpy(glyphs, run->glyphs, n * sizeof(uint16_t));
+	memcpy(text, key->text, key->length * sizeof(uint16_t));
+	memcpy(face, key->face, faceLen);
+
+	e->run = *run;
+	e->run.advances = advances;
+	e->run.clusters = clusters;
+	e->run.glyphs = glyphs;
+	e->key = *key;
+	e->key.text = text;
+	e->key.face = face;
+	e->hash = hash;
+	e->bytes = bytes;
+	return e;
+}
+
+const SubShapedRun *SubShapeCacheAddRun(SubShapeCache *cache, const SubShapeKey *key, const SubShapedRun *run)
+{
+	uint64_t hash = HashKey(key);
+	SubShapeEntry *e = CreateEntry(key, run, hash), **slot;
+
+	pthread_mutex_lock(&cache->lock);
+	slot = FindSlot(cache, key, hash);
+
+	if (*slot) {
+		free(e);
+		e = *slot;
+		e->refCount++;
+		LRURemove(cache, e);
+		LRUPushFront(cache, e);
+	} else {
+		e->refCount = 2;
+		*slot = e;
+		LRUPushFront(cache, e);
+		cache->stats.runCount++;
+		cache->stats.bytes += e->bytes;
+
+		while (cache->stats.bytes > cache->maxBytes && cache->lruTail != e) {
+			Evict(cache, cache->lruTail);
+			cache->stats.evictions++;
+		}
+
+		if (cache->stats.runCount > cache->bucketCount) Grow(cache);
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	return &e->run;
+}
+
+void SubShapeCacheReleaseRun(SubShapeCache *cache, const SubShapedRun *run)
+{
+	SubShapeEntry *e = (SubShapeEntry *)run;
+	bool last;
+
+	if (!run) return;
+
+	pthread_mutex_lock(&cache->lock);
+	last = !--e->refCount;
+	pthread_mutex_unlock(&cache->lock);
+
+	if (last) free(e);
+}
+
+SubShapeCacheStatistics SubShapeCacheGetStatistics(SubShapeCache *cache)
+{
+	SubShapeCacheStatistics stats;
+
+	pthread_mutex_lock(&cache->lock);
+	stats = cache->stats;
+	pthread_mutex_unlock(&cache->lock);
+
+	return stats;
+}
+
+void SubShapeCacheDestroy(SubShapeCache *cache)
+{
+	pthread_mutex_lock(&cache->lock);
+	while (cache->lruHead) Evict(cache, cache->lruHead);
+	pthread_mutex_unlock(&cache->lock);
+
+	pthread_mutex_destroy(&cache->lock);
+	free(cache->buckets);
+	free(cache);
+}
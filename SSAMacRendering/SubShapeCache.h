@@ -0,0 +1,82 @@
+//
+//  SubShapeCache.h
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+#ifndef SubShapeCache_h
+#define SubShapeCache_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+/*
+ * A cache of shaped text runs, shared by every renderer in the process.
+ *
+ * It doesn't shape anything itself: a renderer looks a run up, and on a miss shapes
+ * it with whatever it uses (CoreText, HarfBuzz...) and adds the result. Runs are kept
+ * most recently used first until the cache is over its memory limit.
+ * All functions are thread-safe.
+ */
+
+typedef struct SubShapeCache SubShapeCache;
+
+//! What a run was shaped from. Two runs with equal keys must shape the same.
+typedef struct SubShapeKey {
+	const char *face;			//!< Backend-specific name of the font face, e.g. its PostScript name.
+	double size;
+	double scaleX, scaleY;		//!< \fscx and \fscy, 1 for unscaled.
+	double tracking;
+	bool rightToLeft;
+	const uint16_t *text;		//!< UTF-16
+	size_t length;
+} SubShapeKey;
+
+typedef struct SubShapedRun {
+	size_t glyphCount;
+	const uint16_t *glyphs;
+	const float *advances;		//!< Horizontal advance of each glyph.
+	const uint32_t *clusters;	//!< Index in the key's text of the first character each glyph was made from.
+	double width;				//!< Typographic width of the whole run.
+	double ascent, descent, leading;
+	bool fallback;				//!< Some glyphs came from a substituted font, so their IDs aren't in the key's face.
+} SubShapedRun;
+
+//! The process-wide cache, limited to 8 MB.
+extern SubShapeCache *SubShapeCacheGetShared(void);
+
+extern SubShapeCache *SubShapeCacheCreate(size_t maxBytes);
+//! Every run copied from the cache must be released first.
+extern void SubShapeCacheDestroy(SubShapeCache *cache);
+
+/**
+ * Returns the run shaped from \c key, or NULL if it isn't cached.
+ * The run stays valid, even if it's evicted, until it's passed to SubShapeCacheReleaseRun().
+ */
+extern const SubShapedRun *SubShapeCacheCopyRun(SubShapeCache *cache, const SubShapeKey *key);
+
+/**
+ * Copies \c run into the cache under \c key, evicting old runs if needed, and returns the
+ * cached copy, to be released with SubShapeCacheReleaseRun(). If another thread added the
+ * same key first, that run is returned instead.
+ */
+extern const SubShapedRun *SubShapeCacheAddRun(SubShapeCache *cache, const SubShapeKey *key, const SubShapedRun *run);
+
+extern void SubShapeCacheReleaseRun(SubShapeCache *cache, const SubShapedRun *run);
+
+typedef struct SubShapeCacheStatistics {
+	size_t hits, misses, evictions;
+	size_t runCount, bytes;
+} SubShapeCacheStatistics;
+
+extern SubShapeCacheStatistics SubShapeCacheGetStatistics(SubShapeCache *cache);
+
+__END_DECLS
+
+#endif /* SubShapeCache_h */
@@ -0,0 +1,80 @@
+//
+//  SubTimeline.h
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <SSAMacRendering/SubContext.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class SubLine, SubSerializer;
+
+extern NSErrorDomain const SubTimelineErrorDomain;
+
+typedef NS_ERROR_ENUM(SubTimelineErrorDomain, SubTimelineError) {
+	SubTimelineErrorNotATimeline = 1,	//!< Bad magic or byte order.
+	SubTimelineErrorUnsupportedVersion,
+	SubTimelineErrorCorrupt,			//!< A section points outside the file.
+	SubTimelineErrorUnreadableScript	//!< The input script couldn't be loaded.
+};
+
+/**
+ * @brief A precompiled, memory-mapped subtitle timeline.
+ *
+ * @discussion A timeline file holds the script header, every packet that
+ * <code>-[SubSerializer getSerializedPacket]</code> would have returned,
+ * with their event begin times, a UTF-16 string pool for the packet text
+ * and a coarse time index.
+ * Opening one maps the file and does no parsing, so it's meant for
+ * scripts that get opened over and over.
+ *
+ * The packet strings returned by this class point straight into the
+ * mapping and keep it alive, so they stay valid after the timeline is released.
+ */
+@interface SubTimeline : NSObject
+
+- (instancetype)init UNAVAILABLE_ATTRIBUTE;
+- (nullable instancetype)initWithContentsOfURL:(NSURL *)url error:(NSError *_Nullable __autoreleasing *_Nullable)error NS_DESIGNATED_INITIALIZER;
+- (nullable instancetype)initWithData:(NSData *)data error:(NSError *_Nullable __autoreleasing *_Nullable)error NS_DESIGNATED_INITIALIZER;
+
+//! The script header, the same thing <code>SubLoadSSAFromURL</code> returns. \c nil for SRT and SAMI.
+@property (readonly, copy, nullable) NSString *header;
+@property (readonly) SubType scriptType;
+//! Packet times are in units of <code>1/timeScale</code> seconds.
+@property (readonly) NSUInteger timeScale;
+@property (readonly) NSUInteger packetCount;
+
+/// Returns the index of the packet displayed at \c time, or \c NSNotFound if it is past the end.
+- (NSUInteger)indexOfPacketAtTime:(NSUInteger)time;
+- (NSString *)packetTextAtIndex:(NSUInteger)index beginTime:(nullable NSUInteger *)beginTime endTime:(nullable NSUInteger *)endTime;
+- (SubLine *)packetAtIndex:(NSUInteger)index;
+
+#pragma mark Sequential access
+
+/// Moves the read cursor to the packet displayed at \c time.
+- (void)seekToTime:(NSUInteger)time;
+/// Same contract as <code>-[SubSerializer getSerializedPacket]</code>.
+- (nullable SubLine *)getSerializedPacket;
+@property (readonly, getter=isEmpty) BOOL empty;
+
+@end
+
+__BEGIN_DECLS
+
+/**
+ * @brief Marks \c ss as finished and drains it into a timeline file.
+ *
+ * @param timeScale The units the lines were added in: 100 for SSA/ASS, 1000 for SRT and SAMI.
+ */
+extern BOOL SubTimelineWriteToURL(NSURL *url, SubSerializer *ss, NSString *_Nullable header, SubType type, NSUInteger timeScale, NSError *_Nullable __autoreleasing *_Nullable error);
+
+/// Loads a .ass, .ssa, .srt or .smi file and compiles it into a timeline file at \c outURL.
+extern BOOL SubTimelineCompileScript(NSURL *scriptURL, NSURL *outURL, NSError *_Nullable __autoreleasing *_Nullable error);
+
+__END_DECLS
+
+NS_ASSUME_NONNULL_END
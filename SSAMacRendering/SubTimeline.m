@@ -0,0 +1,386 @@
+//
+//  SubTimeline.m
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+#import "SubTimeline.h"
+#import "SubImport.h"
+#include "Codecprintf.h"
+
+NSErrorDomain const SubTimelineErrorDomain = @"com.github.maddthesane.SSAMacRendering.SubTimeline";
+
+#pragma mark File format
+
+/*
+ * All fields are in host byte order; byteOrder lets a reader on the
+ * other endianness reject the file instead of misreading it.
+ * Sections start on 8-byte boundaries. Text is UTF-16 in the pool,
+ * and both offsets and lengths into the pool are in unichars.
+ * Version 2 added each packet's event begin times, for karaoke.
+ */
+
+#define kSubTimelineMagic "SSAT"
+#define kSubTimelineVersion 2
+#define kSubTimelineByteOrder 0xFEFF
+//! Upper bound on time index entries, so a stray huge end time doesn't make a huge file.
+#define kSubTimelineMaxIndexCount (1 << 16)
+
+typedef struct SubTimelineFileHeader {
+	char     magic[4];
+	uint16_t version;
+	uint16_t byteOrder;
+	uint8_t  scriptType;
+	uint8_t  reserved[3];
+	uint32_t timeScale;
+	uint32_t packetCount;
+	uint32_t indexCount;
+	uint32_t indexGranularity;
+	uint32_t headerOffset, headerLength; //!< in the pool; length is UINT32_MAX if there is no header
+	uint32_t packetsOffset;
+	uint32_t indexOffset;
+	uint32_t poolOffset, poolLength;
+	uint32_t eventTimesOffset, eventTimeCount;
+} SubTimelineFileHeader;
+
+typedef struct SubTimelinePacket {
+	uint64_t beginTime, endTime;
+	uint32_t textOffset, textLength;
+	uint32_t eventTimesIndex, eventTimesLength; //!< in the event time section, one per line of the text
+} SubTimelinePacket;
+
+static inline size_t SubTimelineAlign(size_t off)
+{
+	return (off + 7) & ~(size_t)7;
+}
+
+static NSError *SubTimelineMakeError(SubTimelineError code, NSString *desc)
+{
+	return [NSError errorWithDomain:SubTimelineErrorDomain code:code userInfo:@{NSLocalizedDescriptionKey: desc}];
+}
+
+#pragma mark Reading
+
+@implementation SubTimeline
+{
+	NSData *data;
+	const SubTimelineFileHeader *fh;
+	const SubTimelinePacket *packets;
+	const uint32_t *timeIndex;
+	const unichar *pool;
+	const uint64_t *eventTimes;
+	NSUInteger cursor;
+}
+@synthesize header;
+
+- (instancetype)init
+{
+	[self doesNotRecognizeSelector:_cmd];
+	return nil;
+}
+
+- (instancetype)initWithContentsOfURL:(NSURL *)url error:(NSError * _Nullable __autoreleasing *)error
+{
+	NSData *mapped = [[NSData alloc] initWithContentsOfURL:url options:NSDataReadingMappedAlways error:error];
+	if (!mapped) return nil;
+
+	return [self initWithData:mapped error:error];
+}
+
+- (instancetype)initWithData:(NSData *)aData error:(NSError * _Nullable __autoreleasing *)error
+{
+	if (self = [super init]) {
+		NSUInteger len = [aData length];
+		const uint8_t *base = [aData bytes];
+		fh = (const SubTimelineFileHeader *)base;
+
+		if (len < sizeof(SubTimelineFileHeader) || memcmp(fh->magic, kSubTimelineMagic, 4) || fh->byteOrder != kSubTimelineByteOrder) {
+			if (error) *error = SubTimelineMakeError(SubTimelineErrorNotATimeline, @"The file is not a subtitle timeline.");
+			return nil;
+		}
+
+		if (fh->version != kSubTimelineVersion) {
+			if (error) *error = SubTimelineMakeError(SubTimelineErrorUnsupportedVersion, [NSString stringWithFormat:@"Unsupported subtitle timeline version %u.", fh->version]);
+			return nil;
+		}
+
+		uint64_t packetsEnd = (uint64_t)fh->packetsOffset + (uint64_t)fh->packetCount * sizeof(SubTimelinePacket);
+		uint64_t indexEnd   = (uint64_t)fh->indexOffset + (uint64_t)fh->indexCount * sizeof(uint32_t);
+		uint64_t poolEnd    = (uint64_t)fh->poolOffset + (uint64_t)fh->poolLength * sizeof(unichar);
+		uint64_t eventsEnd  = (uint64_t)fh->eventTimesOffset + (uint64_t)fh->eventTimeCount * sizeof(uint64_t);
+		BOOL hasHeader = fh->headerLength != UINT32_MAX;
+
+		if (packetsEnd > len || indexEnd > len || poolEnd > len || eventsEnd > len ||
+			(fh->packetsOffset | fh->indexOffset | fh->poolOffset | fh->eventTimesOffset) & 7 ||
+			!fh->indexGranularity || !fh->timeScale ||
+			(hasHeader && (uint64_t)fh->headerOffset + fh->headerLength > fh->poolLength)) {
+			if (error) *error = SubTimelineMakeError(SubTimelineErrorCorrupt, @"The subtitle timeline is damaged.");
+			return nil;
+		}
+
+		data = aData;
+		packets = (const SubTimelinePacket *)(base + fh->packetsOffset);
+		timeIndex = (const uint32_t *)(base + fh->indexOffset);
+		pool = (const unichar *)(base + fh->poolOffset);
+		eventTimes = (const uint64_t *)(base + fh->eventTimesOffset);
+		cursor = 0;
+
+		if (hasHeader)
+			header = [self copyPoolStringAt:fh->headerOffset length:fh->headerLength];
+	}
+
+	return self;
+}
+
+//! Makes a string backed by the mapping. The deallocator holds the data, not the string contents.
+- (NSString *)copyPoolStringAt:(uint32_t)offset length:(uint32_t)length
+{
+	NSData *keep = data;
+
+	return [[NSString alloc] initWithCharactersNoCopy:(unichar *)(pool + offset) length:length deallocator:^(unichar *bytes, NSUInteger len) {
+		(void)keep;
+	}];
+}
+
+- (SubType)scriptType
+{
+	return fh->scriptType;
+}
+
+- (NSUInteger)timeScale
+{
+	return fh->timeScale;
+}
+
+- (NSUInteger)packetCount
+{
+	return fh->packetCount;
+}
+
+- (NSUInteger)indexOfPacketAtTime:(NSUInteger)time
+{
+	NSUInteger count = fh->packetCount;
+
+	if (!count || time >= packets[count-1].endTime) return NSNotFound;
+
+	// index[b] is the first packet ending after b*granularity, so the answer lies in [index[b], index[b+1]]
+	NSUInteger bucket = time / fh->indexGranularity;
+	NSUInteger lo = 0, hi = count - 1;
+
+	if (bucket < fh->indexCount) {
+		lo = MIN(timeIndex[bucket], hi);
+		if (bucket + 1 < fh->indexCount) hi = MIN(timeIndex[bucket+1], hi);
+	} else if (fh->indexCount)
+		lo = MIN(timeIndex[fh->indexCount-1], hi);
+
+	// packets are contiguous, so their end times increase strictly
+	while (lo < hi) {
+		NSUInteger mid = lo + (hi - lo) / 2;
+
+		if (packets[mid].endTime > time) hi = mid;
+		else lo = mid + 1;
+	}
+
+	return lo;
+}
+
+- (NSString *)packetTextAtIndex:(NSUInteger)index beginTime:(NSUInteger *)beginTime endTime:(NSUInteger *)endTime
+{
+	if (index >= fh->packetCount)
+		[NSException raise:NSRangeException format:@"Packet index %lu beyond count %u", (unsigned long)index, fh->packetCount];
+
+	const SubTimelinePacket *p = &packets[index];
+
+	if (beginTime) *beginTime = (NSUInteger)p->beginTime;
+	if (endTime)   *endTime   = (NSUInteger)p->endTime;
+
+	if ((uint64_t)p->textOffset + p->textLength > fh->poolLength) {
+		Codecprintf(NULL, "Subtitle timeline packet %lu points outside the string pool\n", (unsigned long)index);
+		return @"\n";
+	}
+
+	return [self copyPoolStringAt:p->textOffset length:p->textLength];
+}
+
+- (SubLine *)packetAtIndex:(NSUInteger)index
+{
+	NSUInteger begin, end;
+	NSString *text = [self packetTextAtIndex:index beginTime:&begin endTime:&end];
+	SubLine *sl = [[SubLine alloc] initWithLine:text start:begin end:end];
+	const SubTimelinePacket *p = &packets[index];
+
+	if (p->eventTimesLength && (uint64_t)p->eventTimesIndex + p->eventTimesLength <= fh->eventTimeCount) {
+		NSMutableArray<NSNumber*> *times = [NSMutableArray arrayWithCapacity:p->eventTimesLength];
+
+		for (uint32_t i = 0; i < p->eventTimesLength; i++)
+			[times addObject:@(eventTimes[p->eventTimesIndex + i])];
+		sl.eventBeginTimes = times;
+	}
+
+	return sl;
+}
+
+#pragma mark Sequential access
+
+- (void)seekToTime:(NSUInteger)time
+{
+	NSUInteger index = [self indexOfPacketAtTime:time];
+
+	cursor = index == NSNotFound ? fh->packetCount : index;
+}
+
+- (SubLine *)getSerializedPacket
+{
+	if (cursor >= fh->packetCount) return nil;
+
+	return [self packetAtIndex:cursor++];
+}
+
+- (BOOL)isEmpty
+{
+	return cursor >= fh->packetCount;
+}
+
+- (NSString *)description
+{
+	return [NSString stringWithFormat:@"%u packets, timescale %u, next packet %lu", fh->packetCount, fh->timeScale, (unsigned long)cursor];
+}
+
+@end
+
+#pragma mark Writing
+
+//! Appends \c str to the pool unless an identical string is already there.
+static void SubTimelinePoolAdd(NSMutableData *pool, NSMutableDictionary<NSString*,NSNumber*> *seen, NSString *str, uint32_t *offset, uint32_t *length)
+{
+	NSNumber *existing = [seen objectForKey:str];
+	NSUInteger len = [str length];
+
+	*length = (uint32_t)len;
+
+	if (existing) {
+		*offset = [existing unsignedIntValue];
+		return;
+	}
+
+	NSUInteger poolLen = [pool length] / sizeof(unichar);
+
+	[pool increaseLengthBy:len * sizeof(unichar)];
+	[str getCharacters:(unichar *)[pool mutableBytes] + poolLen range:NSMakeRange(0, len)];
+
+	*offset = (uint32_t)poolLen;
+	[seen setObject:@(poolLen) forKey:str];
+}
+
+BOOL SubTimelineWriteToURL(NSURL *url, SubSerializer *ss, NSString *header, SubType type, NSUInteger timeScale, NSError **error)
+{
+	NSMutableData *packetData = [NSMutableData data], *poolData = [NSMutableData data], *eventData = [NSMutableData data];
+	NSMutableDictionary<NSString*,NSNumber*> *seen = [NSMutableDictionary dictionary];
+	SubTimelineFileHeader fh = {0};
+	SubLine *sl;
+
+	memcpy(fh.magic, kSubTimelineMagic, 4);
+	fh.version = kSubTimelineVersion;
+	fh.byteOrder = kSubTimelineByteOrder;
+	fh.scriptType = type;
+	fh.timeScale = (uint32_t)timeScale;
+	fh.headerLength = UINT32_MAX;
+
+	if (header)
+		SubTimelinePoolAdd(poolData, seen, header, &fh.headerOffset, &fh.headerLength);
+
+	ss.finished = YES;
+
+	while ((sl = [ss getSerializedPacket])) {
+		SubTimelinePacket p = {sl.beginTime, sl.endTime, 0, 0, 0, 0};
+
+		SubTimelinePoolAdd(poolData, seen, sl.line, &p.textOffset, &p.textLength);
+
+		p.eventTimesIndex = (uint32_t)([eventData length] / sizeof(uint64_t));
+		p.eventTimesLength = (uint32_t)[sl.eventBeginTimes count];
+		for (NSNumber *time in sl.eventBeginTimes) {
+			uint64_t t = [time unsignedLongLongValue];
+
+			[eventData appendBytes:&t length:sizeof(t)];
+		}
+		[packetData appendBytes:&p length:sizeof(p)];
+	}
+
+	fh.packetCount = (uint32_t)([packetData length] / sizeof(SubTimelinePacket));
+
+	// one bucket per second, widened if that would make the index too large
+	const SubTimelinePacket *packets = [packetData bytes];
+	uint64_t duration = fh.packetCount ? packets[fh.packetCount-1].endTime : 0;
+	uint64_t granularity = MAX(timeScale, 1);
+
+	while (duration / granularity >= kSubTimelineMaxIndexCount) granularity *= 2;
+
+	fh.indexGranularity = (uint32_t)granularity;
+	fh.indexCount = fh.packetCount ? (uint32_t)(duration / granularity) + 1 : 0;
+
+	NSMutableData *indexData = [NSMutableData dataWithLength:fh.indexCount * sizeof(uint32_t)];
+	uint32_t *timeIndex = [indexData mutableBytes];
+	uint32_t pi = 0;
+
+	for (uint32_t b = 0; b < fh.indexCount; b++) {
+		uint64_t bucketStart = b * granularity;
+
+		while (pi < fh.packetCount && packets[pi].endTime <= bucketStart) pi++;
+		timeIndex[b] = pi;
+	}
+
+	fh.packetsOffset = (uint32_t)SubTimelineAlign(sizeof(fh));
+	fh.indexOffset   = (uint32_t)SubTimelineAlign(fh.packetsOffset + [packetData length]);
+	fh.poolOffset    = (uint32_t)SubTimelineAlign(fh.indexOffset + [indexData length]);
+	fh.poolLength    = (uint32_t)([poolData length] / sizeof(unichar));
+	fh.eventTimesOffset = (uint32_t)SubTimelineAlign(fh.poolOffset + [poolData length]);
+	fh.eventTimeCount   = (uint32_t)([eventData length] / sizeof(uint64_t));
+
+	NSMutableData *file = [NSMutableData dataWithCapacity:fh.eventTimesOffset + [eventData length]];
+
+	[file appendBytes:&fh length:sizeof(fh)];
+	[file setLength:fh.packetsOffset];
+	[file appendData:packetData];
+	[file setLength:fh.indexOffset];
+	[file appendData:indexData];
+	[file setLength:fh.poolOffset];
+	[file appendData:poolData];
+	[file setLength:fh.eventTimesOffset];
+	[file appendData:eventData];
+
+	return [file writeToURL:url options:NSDataWritingAtomic error:error];
+}
+
+BOOL SubTimelineCompileScript(NSURL *scriptURL, NSURL *outURL, NSError **error)
+{
+	SubSerializer *ss = [[SubSerializer alloc] init];
+	NSString *ext = [[scriptURL pathExtension] lowercaseString];
+	NSString *header = nil;
+	SubType type;
+	NSUInteger timeScale;
+
+	if ([ext isEqualToString:@"ass"] || [ext isEqualToString:@"ssa"]) {
+		header = SubLoadSSAFromURL(scriptURL, ss);
+		if (!header) {
+			if (error) *error = SubTimelineMakeError(SubTimelineErrorUnreadableScript, [NSString stringWithFormat:@"Couldn't load \"%@\".", [scriptURL lastPathComponent]]);
+			return NO;
+		}
+		type = [ext isEqualToString:@"ass"] ? kSubTypeASS : kSubTypeSSA;
+		timeScale = 100;
+	} else if ([ext isEqualToString:@"srt"]) {
+		SubLoadSRTFromURL(scriptURL, ss);
+		type = kSubTypeSRT;
+		timeScale = 1000;
+	} else if ([ext isEqualToString:@"smi"] || [ext isEqualToString:@"sami"]) {
+		SubLoadSMIFromURL(scriptURL, ss, 1);
+		type = kSubTypeSMI;
+		timeScale = 1000;
+	} else {
+		if (error) *error = SubTimelineMakeError(SubTimelineErrorUnreadableScript, [NSString stringWithFormat:@"Unknown subtitle type \"%@\".", ext]);
+		return NO;
+	}
+
+	return SubTimelineWriteToURL(outURL, ss, header, type, timeScale, error);
+}
@@ -0,0 +1,117 @@
+//
+//  SubUnicode.c
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+#include "SubUnicode.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#define kReplacementCharacter 0xFFFD
+
+//! Widens the ASCII prefix of \c src. Returns how many bytes it took.
+static size_t WidenASCII(const uint8_t *src, size_t length, uint16_t *dst)
+{
+	size_t i = 0;
+
+#if defined(__AVX2__)
+	for (; i + 32 <= length; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+
+		if (_mm256_movemask_epi8(v)) break;
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)));
+		_mm256_storeu_si256((__m256i *)(dst + i + 16), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)));
+	}
+#elif defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+
+	for (; i + 16 <= length; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+
+		if (_mm_movemask_epi8(v)) break;
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_unpacklo_epi8(v, zero));
+		_mm_storeu_si128((__m128i *)(dst + i + 8), _mm_unpackhi_epi8(v, zero));
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	for (; i + 16 <= length; i += 16) {
+		uint8x16_t v = vld1q_u8(src + i);
+
+		if (vmaxvq_u8(v) >= 0x80) break;
+		vst1q_u16(dst + i, vmovl_u8(vget_low_u8(v)));
+		vst1q_u16(dst + i + 8, vmovl_u8(vget_high_u8(v)));
+	}
+#endif
+
+	for (; i < length && src[i] < 0x80; i++) dst[i] = src[i];
+	return i;
+}
+
+size_t SubUTF8ToUTF16(const uint8_t *src, size_t length, uint16_t *dst)
+{
+	size_t i = 0, o = 0;
+
+	while (i < length) {
+		size_t ascii = WidenASCII(src + i, length - i, dst + o);
+
+		i += ascii;
+		o += ascii;
+		if (i >= length) break;
+
+		uint8_t c = src[i];
+		uint32_t cp, min;
+		int extra;
+
+		if (c >= 0xC2 && c <= 0xDF) {
+			cp = c & 0x1F; extra = 1; min = 0x80;
+		} else if (c >= 0xE0 && c <= 0xEF) {
+			cp = c & 0x0F; extra = 2; min = 0x800;
+		} else if (c >= 0xF0 && c <= 0xF4) {
+			cp = c & 0x07; extra = 3; min = 0x10000;
+		} else {
+			dst[o++] = kReplacementCharacter;
+			i++;
+			continue;
+		}
+
+		if (i + extra >= length) {
+			// truncated at the end of the input
+			dst[o++] = kReplacementCharacter;
+			i++;
+			continue;
+		}
+
+		int k;
+		for (k = 1; k <= extra; k++) {
+			uint8_t cc = src[i + k];
+
+			if ((cc & 0xC0) != 0x80) break;
+			cp = (cp << 6) | (cc & 0x3F);
+		}
+
+		if (k <= extra || cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+			dst[o++] = kReplacementCharacter;
+			i++;
+			continue;
+		}
+
+		if (cp >= 0x10000) {
+			cp -= 0x10000;
+			dst[o++] = 0xD800 | (cp >> 10);
+			dst[o++] = 0xDC00 | (cp & 0x3FF);
+		} else {
+			dst[o++] = cp;
+		}
+		i += extra + 1;
+	}
+
+	return o;
+}
@@ -0,0 +1,27 @@
+//
+//  SubUnicode.h
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+#ifndef SubUnicode_h
+#define SubUnicode_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+/**
+ * Converts UTF-8 to UTF-16. \c dst must have room for \c length code units, which is always enough.
+ * Malformed sequences become U+FFFD, one per bad byte. Returns the number of code units written.
+ * Runs of ASCII are widened 16 or 32 bytes at a time with AVX2, SSE2 or NEON when the compiler targets them.
+ */
+extern size_t SubUTF8ToUTF16(const uint8_t *src, size_t length, uint16_t *dst);
+
+__END_DECLS
+
+#endif /* SubUnicode_h */
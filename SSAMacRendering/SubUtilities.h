@@ -28,6 +28,16 @@ NS_ASSUME_NONNULL_BEGIN
 
 NSArray<NSString*>  *SubSplitStringIgnoringWhitespace(NSString *str, NSString *split);
 NSArray<NSString*>  *SubSplitStringWithCount(NSString *str, NSString *split, NSInteger count);
+//! Like \c SubSplitStringWithCount but fills \c fields with ranges instead of making strings. Returns \c NO if there are fewer than \c count fields.
+BOOL SubSplitCharacters(const unichar *chars, NSRange range, unichar split, NSInteger count, NSRange *fields);
+//! Same result as <code>-[NSString intValue]</code> without making a string.
+int SubParseIntCharacters(const unichar *_Nullable chars, NSUInteger length);
+//! Same result as <code>-[NSString floatValue]</code> for plain decimal numbers, without making a string.
+float SubParseFloatCharacters(const unichar *_Nullable chars, NSUInteger length);
+//! Reads hex digits up to the first non-hex character, like \c strtoul with base 16. Keeps the low 32 bits on overflow.
+unsigned SubParseHexCharacters(const unichar *_Nullable chars, NSUInteger length);
+//! Reads the first two numbers of a <code>(x,y...</code> tag parameter, like \c sscanf with <code>"(%lf,%lf"</code> without making a string. Missing numbers are 0.
+void SubParseCoordinateCharacters(const unichar *_Nullable chars, NSUInteger length, double *x, double *y);
 NSString *_Nullable SubLoadFileWithUnknownEncoding(NSString *path);
 NSString *_Nullable SubLoadURLWithUnknownEncoding(NSURL *path);
 NSString *_Nullable SubLoadDataWithUnknownEncoding(NSData *data);
@@ -38,6 +48,35 @@ NSString *SubStandardizeStringNewlines(NSString *str);
 BOOL SubDifferentiateLatin12(const unsigned char *data, NSInteger length);
 
 const unichar * __nullable SubUnicodeForString(NSString *str, NSData * __nonnull __strong* __nullable datap) CF_DEPRECATED_MAC(10_0, 10_11);
+
+/**
+ * The UTF-16 contents of a string: its own storage when it has some, otherwise a copy in a
+ * buffer that the calling thread reuses once the copy is ended. Buffers can be nested.
+ */
+typedef struct SubUnicodeBuffer {
+	const unichar *_Nullable characters;
+	NSUInteger length;
+	unichar *_Nullable storage;		//!< NULL if the characters are borrowed from the string.
+	size_t capacity;
+} SubUnicodeBuffer;
+
+//! Starts using the characters of \c str. Must be balanced by SubUnicodeBufferEnd() on the same thread.
+extern const unichar *SubUnicodeBufferBegin(SubUnicodeBuffer *buffer, NSString *str);
+//! Like SubUnicodeBufferBegin() for UTF-8 bytes. \c buffer->length is the number of UTF-16 code units.
+extern const unichar *SubUnicodeBufferBeginUTF8(SubUnicodeBuffer *buffer, const char *utf8, size_t length);
+//! Gives the buffer back to the thread. The characters can't be used after this.
+extern void SubUnicodeBufferEnd(SubUnicodeBuffer *buffer);
+
+//! What SubUnicodeBuffer had to copy, on all threads, since the last reset.
+typedef struct SubUnicodeStatistics {
+	uint64_t copies;			//!< Strings or UTF-8 runs that had to be converted.
+	uint64_t bytes;				//!< UTF-16 bytes written by them.
+	uint64_t borrowed;			//!< Strings whose own storage was used.
+} SubUnicodeStatistics;
+
+extern SubUnicodeStatistics SubUnicodeGetStatistics(void);
+//! Call once per frame to get per-frame numbers.
+extern void SubUnicodeResetStatistics(void);
 //extern NSBezierPath *SubParseSubShapesWithString(NSString *aStr) NS_SWIFT_NAME(parseSubShapes(string:));
 extern CGPathRef CreateSubParseSubShapesWithString(NSString *aStr, const CGAffineTransform * __nullable m) CF_RETURNS_RETAINED NS_SWIFT_NAME(parseSubShapes(with:transform:));
 
@@ -22,6 +22,9 @@
 #import "SubUtilities.h"
 #import <UniversalDetector/UniversalDetector.h>
 #import "Codecprintf.h"
+#include "SubUnicode.h"
+#include <pthread.h>
+#include <stdatomic.h>
 
 NSArray *SubSplitStringIgnoringWhitespace(NSString *str, NSString *split)
 {
@@ -59,6 +62,120 @@ NSArray *SubSplitStringWithCount(NSString *str, NSString *split, NSInteger count
 	return ar;
 }
 
+BOOL SubSplitCharacters(const unichar *chars, NSRange range, unichar split, NSInteger count, NSRange *fields)
+{
+	NSUInteger p = range.location, end = NSMaxRange(range);
+	
+	for (NSInteger i = 0; i < count - 1; i++) {
+		NSUInteger start = p;
+		
+		while (p < end && chars[p] != split) p++;
+		if (p == end) return NO;
+		
+		fields[i] = NSMakeRange(start, p - start);
+		p++;
+	}
+	
+	fields[count-1] = NSMakeRange(p, end - p);
+	return YES;
+}
+
+int SubParseIntCharacters(const unichar *chars, NSUInteger length)
+{
+	const unichar *p = chars, *pe = chars + length;
+	int sign = 1;
+	int64_t val = 0;
+	
+	if (!chars) return 0;
+	
+	while (p < pe && (*p == ' ' || *p == '\t' || *p == '\n')) p++;
+	
+	if (p < pe && (*p == '-' || *p == '+')) {
+		if (*p == '-') sign = -1;
+		p++;
+	}
+	
+	while (p < pe && *p >= '0' && *p <= '9') {
+		// anything past INT_MAX is clamped below, so stop adding digits before val can overflow
+		if (val <= INT_MAX) val = val * 10 + (*p - '0');
+		p++;
+	}
+	
+	// saturate like -[NSString intValue]
+	val *= sign;
+	return (int)MAX(MIN(val, (int64_t)INT_MAX), (int64_t)INT_MIN);
+}
+
+float SubParseFloatCharacters(const unichar *chars, NSUInteger length)
+{
+	const unichar *p = chars, *pe = chars + length;
+	float sign = 1;
+	double val = 0, scale = 1;
+	
+	if (!chars) return 0;
+	
+	while (p < pe && (*p == ' ' || *p == '\t' || *p == '\n')) p++;
+	
+	if (p < pe && (*p == '-' || *p == '+')) {
+		if (*p == '-') sign = -1;
+		p++;
+	}
+	
+	while (p < pe && *p >= '0' && *p <= '9') {
+		val = val * 10 + (*p - '0');
+		p++;
+	}
+	
+	if (p < pe && *p == '.') {
+		p++;
+		while (p < pe && *p >= '0' && *p <= '9') {
+			val = val * 10 + (*p - '0');
+			scale *= 10;
+			p++;
+		}
+	}
+	
+	return sign * (float)(val / scale);
+}
+
+static int SubHexDigitValue(unichar c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+unsigned SubParseHexCharacters(const unichar *chars, NSUInteger length)
+{
+	const unichar *p = chars, *pe = chars + length;
+	unsigned val = 0;
+	int digit;
+	
+	if (!chars) return 0;
+	
+	while (p < pe && (digit = SubHexDigitValue(*p)) >= 0) {
+		val = (val << 4) | digit;
+		p++;
+	}
+	
+	return val;
+}
+
+void SubParseCoordinateCharacters(const unichar *chars, NSUInteger length, double *x, double *y)
+{
+	const unichar *p, *pe, *comma;
+	
+	*x = *y = 0;
+	if (!chars || length < 2 || chars[0] != '(') return;
+	
+	p = chars + 1;
+	pe = chars + length;
+	for (comma = p; comma < pe && *comma != ','; comma++);
+	*x = SubParseFloatCharacters(p, comma - p);
+	if (comma < pe) *y = SubParseFloatCharacters(comma + 1, pe - (comma + 1));
+}
+
 NSString *SubStandardizeStringNewlines(NSString *str)
 {
 	if(str == nil)
@@ -192,6 +309,146 @@ const unichar *SubUnicodeForString(NSString *str, NSData *__strong*datap)
 	return p;
 }
 
+#pragma mark UTF-16 buffers
+
+//! How many buffers each thread keeps for reuse.
+#define kSubUnicodePoolSize 4
+//! Bigger buffers, like ones for whole scripts, are freed when they're ended.
+#define kSubUnicodePoolMaxCapacity (256 * 1024)
+
+typedef struct SubUnicodePool {
+	unichar *buffers[kSubUnicodePoolSize];
+	size_t capacities[kSubUnicodePoolSize];
+	int count;
+} SubUnicodePool;
+
+static pthread_key_t unicodePoolKey;
+static pthread_once_t unicodePoolOnce = PTHREAD_ONCE_INIT;
+static _Atomic uint64_t unicodeCopies, unicodeBytes, unicodeBorrowed;
+
+static void FreeUnicodePool(void *p)
+{
+	SubUnicodePool *pool = p;
+	
+	for (int i = 0; i < pool->count; i++) free(pool->buffers[i]);
+	free(pool);
+}
+
+static void CreateUnicodePoolKey(void)
+{
+	pthread_key_create(&unicodePoolKey, FreeUnicodePool);
+}
+
+static SubUnicodePool *GetUnicodePool(void)
+{
+	SubUnicodePool *pool;
+	
+	pthread_once(&unicodePoolOnce, CreateUnicodePoolKey);
+	pool = pthread_getspecific(unicodePoolKey);
+	if (!pool) {
+		pool = calloc(1, sizeof(SubUnicodePool));
+		pthread_setspecific(unicodePoolKey, pool);
+	}
+	
+	return pool;
+}
+
+//! Gives \c buffer room for \c length characters from the thread's pool, or a new allocation.
+static unichar *TakeUnicodeStorage(SubUnicodeBuffer *buffer, size_t length)
+{
+	SubUnicodePool *pool = GetUnicodePool();
+	int i;
+	
+	// the most recently ended buffer is the likeliest to still be in cache
+	for (i = pool->count - 1; i >= 0; i--) {
+		if (pool->capacities[i] >= length) break;
+	}
+	
+	if (i >= 0) {
+		buffer->storage = pool->buffers[i];
+		buffer->capacity = pool->capacities[i];
+		pool->count--;
+		pool->buffers[i] = pool->buffers[pool->count];
+		pool->capacities[i] = pool->capacities[pool->count];
+	} else {
+		buffer->capacity = MAX(length, 256);
+		buffer->storage = malloc(buffer->capacity * sizeof(unichar));
+	}
+	
+	return buffer->storage;
+}
+
+const unichar *SubUnicodeBufferBegin(SubUnicodeBuffer *buffer, NSString *str)
+{
+	CFStringRef cfstr = (__bridge CFStringRef)str;
+	NSUInteger length = CFStringGetLength(cfstr);
+	const unichar *p = CFStringGetCharactersPtr(cfstr);
+	const char *ascii;
+	
+	buffer->length = length;
+	buffer->storage = NULL;
+	buffer->capacity = 0;
+	
+	if (p) {
+		atomic_fetch_add_explicit(&unicodeBorrowed, 1, memory_order_relaxed);
+		return buffer->characters = p;
+	}
+	
+	// byte-backed strings can be widened instead of going through CFString's own copy
+	ascii = CFStringGetCStringPtr(cfstr, kCFStringEncodingASCII);
+	TakeUnicodeStorage(buffer, length);
+	if (ascii) SubUTF8ToUTF16((const uint8_t *)ascii, length, buffer->storage);
+	else CFStringGetCharacters(cfstr, CFRangeMake(0, length), buffer->storage);
+	
+	atomic_fetch_add_explicit(&unicodeCopies, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&unicodeBytes, length * sizeof(unichar), memory_order_relaxed);
+	return buffer->characters = buffer->storage;
+}
+
+const unichar *SubUnicodeBufferBeginUTF8(SubUnicodeBuffer *buffer, const char *utf8, size_t length)
+{
+	TakeUnicodeStorage(buffer, length);
+	buffer->length = SubUTF8ToUTF16((const uint8_t *)utf8, length, buffer->storage);
+	
+	atomic_fetch_add_explicit(&unicodeCopies, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&unicodeBytes, buffer->length * sizeof(unichar), memory_order_relaxed);
+	return buffer->characters = buffer->storage;
+}
+
+void SubUnicodeBufferEnd(SubUnicodeBuffer *buffer)
+{
+	if (buffer->storage) {
+		SubUnicodePool *pool = GetUnicodePool();
+		
+		if (buffer->capacity <= kSubUnicodePoolMaxCapacity && pool->count < kSubUnicodePoolSize) {
+			pool->buffers[pool->count] = buffer->storage;
+			pool->capacities[pool->count] = buffer->capacity;
+			pool->count++;
+		} else {
+			free(buffer->storage);
+		}
+	}
+	
+	buffer->characters = buffer->storage = NULL;
+	buffer->length = buffer->capacity = 0;
+}
+
+SubUnicodeStatistics SubUnicodeGetStatistics(void)
+{
+	return (SubUnicodeStatistics){
+		.copies = atomic_load_explicit(&unicodeCopies, memory_order_relaxed),
+		.bytes = atomic_load_explicit(&unicodeBytes, memory_order_relaxed),
+		.borrowed = atomic_load_explicit(&unicodeBorrowed, memory_order_relaxed)
+	};
+}
+
+void SubUnicodeResetStatistics(void)
+{
+	atomic_store_explicit(&unicodeCopies, 0, memory_order_relaxed);
+	atomic_store_explicit(&unicodeBytes, 0, memory_order_relaxed);
+	atomic_store_explicit(&unicodeBorrowed, 0, memory_order_relaxed);
+}
+
 CFMutableStringRef CopyHomeDirectory(void)
 {	
 	@autoreleasepool {
@@ -0,0 +1,336 @@
+//
+//  SubYUVBlend.c
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+#include <math.h>
+#include "SubYUVBlend.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+/*
+ * The subtitle pixels are premultiplied, so each one adds a fixed amount to the
+ * frame after the frame is scaled by (255 - alpha) / 255:
+ *
+ *   Y = (yr*r + yg*g + yb*b + ya*a + 8192) >> 14
+ *
+ * where ya*a puts back the black level. Chroma uses the sums of the four pixels
+ * in its 2x2 block, so the same coefficients are applied with a shift of 16.
+ */
+typedef struct BlendCoefficients {
+	int16_t y[4], u[4], v[4];	//!< r, g, b, a in 1/16384ths
+} BlendCoefficients;
+
+static void SetupCoefficients(const SubYUVFrame *frame, BlendCoefficients *k)
+{
+	double kr = frame->matrix == kSubYUVMatrixBT709 ? .2126 : .299;
+	double kb = frame->matrix == kSubYUVMatrixBT709 ? .0722 : .114;
+	double kg = 1 - kr - kb;
+	double ys = frame->fullRange ? 1 : 219 / 255., cs = frame->fullRange ? 1 : 224 / 255.;
+	double yo = frame->fullRange ? 0 : 16;
+	double ub = 2 * (1 - kb), vr = 2 * (1 - kr);
+
+	k->y[0] = (int16_t)lround(16384 * ys * kr);
+	k->y[1] = (int16_t)lround(16384 * ys * kg);
+	k->y[2] = (int16_t)lround(16384 * ys * kb);
+	k->y[3] = (int16_t)lround(16384 * yo / 255);
+
+	k->u[0] = (int16_t)lround(16384 * cs * -kr / ub);
+	k->u[1] = (int16_t)lround(16384 * cs * -kg / ub);
+	k->u[2] = (int16_t)lround(16384 * cs * .5);
+	k->u[3] = (int16_t)lround(16384 * 128 / 255.);
+
+	k->v[0] = (int16_t)lround(16384 * cs * .5);
+	k->v[1] = (int16_t)lround(16384 * cs * -kg / vr);
+	k->v[2] = (int16_t)lround(16384 * cs * -kb / vr);
+	k->v[3] = k->u[3];
+}
+
+//! dst * (255 - a) / 255 + sub, with the division rounded.
+static inline uint8_t BlendSample(uint8_t dst, int sub, int a)
+{
+	unsigned x = dst * (255 - a) + 128;
+
+	x = ((x + (x >> 8)) >> 8) + sub;
+	return x > 255 ? 255 : x;
+}
+
+#pragma mark Luma
+
+static void BlendLumaRow(uint8_t *dst, const uint8_t *px, int count, const BlendCoefficients *k)
+{
+	int i = 0;
+
+#if defined(__SSE2__)
+	const __m128i mask = _mm_set1_epi32(0x00FF00FF), zero = _mm_setzero_si128();
+	const __m128i krb = _mm_set1_epi32((uint16_t)k->y[0] | ((uint32_t)(uint16_t)k->y[2] << 16));
+	const __m128i kga = _mm_set1_epi32((uint16_t)k->y[1] | ((uint32_t)(uint16_t)k->y[3] << 16));
+	const __m128i round14 = _mm_set1_epi32(8192), c128 = _mm_set1_epi16(128), c255 = _mm_set1_epi16(255);
+
+	for (; i + 8 <= count; i += 8) {
+		__m128i p0 = _mm_loadu_si128((const __m128i *)(px + i * 4)), p1 = _mm_loadu_si128((const __m128i *)(px + i * 4 + 16));
+		__m128i a = _mm_packs_epi32(_mm_srli_epi32(p0, 24), _mm_srli_epi32(p1, 24));
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi16(a, zero)) == 0xFFFF) continue;
+
+		// 16-bit lanes of (r, b) and (g, a) for each pixel
+		__m128i s0 = _mm_add_epi32(_mm_madd_epi16(_mm_and_si128(p0, mask), krb), _mm_madd_epi16(_mm_and_si128(_mm_srli_epi32(p0, 8), mask), kga));
+		__m128i s1 = _mm_add_epi32(_mm_madd_epi16(_mm_and_si128(p1, mask), krb), _mm_madd_epi16(_mm_and_si128(_mm_srli_epi32(p1, 8), mask), kga));
+		__m128i sub = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(s0, round14), 14), _mm_srai_epi32(_mm_add_epi32(s1, round14), 14));
+
+		__m128i y = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(dst + i)), zero);
+		__m128i x = _mm_add_epi16(_mm_mullo_epi16(y, _mm_sub_epi16(c255, a)), c128);
+		x = _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+		_mm_storel_epi64((__m128i *)(dst + i), _mm_packus_epi16(_mm_add_epi16(x, sub), zero));
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	const uint16x8_t c128 = vdupq_n_u16(128), c255 = vdupq_n_u16(255);
+	const uint32x4_t round14 = vdupq_n_u32(8192);
+
+	for (; i + 8 <= count; i += 8) {
+		uint8x8x4_t p = vld4_u8(px + i * 4);
+
+		if (vmaxv_u8(p.val[3]) == 0) continue;
+
+		uint16x8_t r = vmovl_u8(p.val[0]), g = vmovl_u8(p.val[1]), b = vmovl_u8(p.val[2]), a = vmovl_u8(p.val[3]);
+		uint32x4_t lo = vmull_n_u16(vget_low_u16(r), k->y[0]), hi = vmull_n_u16(vget_high_u16(r), k->y[0]);
+		lo = vmlal_n_u16(lo, vget_low_u16(g), k->y[1]);   hi = vmlal_n_u16(hi, vget_high_u16(g), k->y[1]);
+		lo = vmlal_n_u16(lo, vget_low_u16(b), k->y[2]);   hi = vmlal_n_u16(hi, vget_high_u16(b), k->y[2]);
+		lo = vmlal_n_u16(lo, vget_low_u16(a), k->y[3]);   hi = vmlal_n_u16(hi, vget_high_u16(a), k->y[3]);
+		uint16x8_t sub = vcombine_u16(vshrn_n_u32(vaddq_u32(lo, round14), 14), vshrn_n_u32(vaddq_u32(hi, round14), 14));
+
+		uint16x8_t x = vaddq_u16(vmulq_u16(vmovl_u8(vld1_u8(dst + i)), vsubq_u16(c255, a)), c128);
+		x = vshrq_n_u16(vaddq_u16(x, vshrq_n_u16(x, 8)), 8);
+		vst1_u8(dst + i, vqmovn_u16(vaddq_u16(x, sub)));
+	}
+#endif
+
+	for (; i < count; i++) {
+		const uint8_t *p = px + i * 4;
+
+		if (!p[3]) continue;
+		int sub = (k->y[0] * p[0] + k->y[1] * p[1] + k->y[2] * p[2] + k->y[3] * p[3] + 8192) >> 14;
+		dst[i] = BlendSample(dst[i], sub, p[3]);
+	}
+}
+
+#pragma mark Chroma
+
+static inline void StoreChroma(const SubYUVFrame *frame, int cx, int cy, int u, int v, int a)
+{
+	if (frame->format == kSubYUVNV12) {
+		uint8_t *uv = frame->planes[1] + cy * frame->strides[1] + cx * 2;
+		uv[0] = BlendSample(uv[0], u, a);
+		uv[1] = BlendSample(uv[1], v, a);
+	} else {
+		uint8_t *pu = frame->planes[1] + cy * frame->strides[1] + cx, *pv = frame->planes[2] + cy * frame->strides[2] + cx;
+		*pu = BlendSample(*pu, u, a);
+		*pv = BlendSample(*pv, v, a);
+	}
+}
+
+/**
+ * Blends one chroma block. \c rows are the image rows for the block's two luma rows,
+ * or NULL where the image doesn't cover it; columns outside [x0, x1) are transparent too.
+ * \c x is the frame column of the image's first pixel.
+ */
+static void BlendChromaBlock(const SubYUVFrame *frame, int cx, int cy, const uint8_t *rows[2], int x, int x0, int x1, const BlendCoefficients *k)
+{
+	int sum[4] = {0};
+
+	for (int r = 0; r < 2; r++) {
+		if (!rows[r]) continue;
+		for (int px = cx * 2; px < cx * 2 + 2; px++) {
+			if (px < x0 || px >= x1) continue;
+			const uint8_t *p = rows[r] + (px - x) * 4;
+			sum[0] += p[0]; sum[1] += p[1]; sum[2] += p[2]; sum[3] += p[3];
+		}
+	}
+
+	if (!sum[3]) return;
+
+	int u = (k->u[0] * sum[0] + k->u[1] * sum[1] + k->u[2] * sum[2] + k->u[3] * sum[3] + 32768) >> 16;
+	int v = (k->v[0] * sum[0] + k->v[1] * sum[1] + k->v[2] * sum[2] + k->v[3] * sum[3] + 32768) >> 16;
+	StoreChroma(frame, cx, cy, u, v, (sum[3] + 2) >> 2);
+}
+
+#if defined(__SSE2__)
+//! Sums of 2x2 blocks for four blocks, as (r, b) and (g, a) 16-bit pairs in 32-bit lanes 0 and 2 of each vector.
+static inline void ChromaPairSums(const uint8_t *r0, const uint8_t *r1, __m128i *rb, __m128i *ga)
+{
+	const __m128i mask = _mm_set1_epi32(0x00FF00FF);
+	__m128i p0 = _mm_loadu_si128((const __m128i *)r0), p1 = _mm_loadu_si128((const __m128i *)r1);
+	__m128i s_rb = _mm_add_epi16(_mm_and_si128(p0, mask), _mm_and_si128(p1, mask));
+	__m128i s_ga = _mm_add_epi16(_mm_and_si128(_mm_srli_epi32(p0, 8), mask), _mm_and_si128(_mm_srli_epi32(p1, 8), mask));
+
+	*rb = _mm_add_epi16(s_rb, _mm_srli_epi64(s_rb, 32));
+	*ga = _mm_add_epi16(s_ga, _mm_srli_epi64(s_ga, 32));
+}
+
+//! Packs 32-bit lanes 0 and 2 of \c a and \c b into one vector.
+static inline __m128i EvenLanes(__m128i a, __m128i b)
+{
+	return _mm_unpacklo_epi64(_mm_shuffle_epi32(a, _MM_SHUFFLE(3,1,2,0)), _mm_shuffle_epi32(b, _MM_SHUFFLE(3,1,2,0)));
+}
+#endif
+
+//! Computes the blended values of four whole chroma blocks from eight pixels of two rows. Returns false if they're all transparent.
+static bool ChromaBlocks4(const uint8_t *r0, const uint8_t *r1, const BlendCoefficients *k, int32_t u[4], int32_t v[4], int32_t a[4])
+{
+#if defined(__SSE2__)
+	const __m128i kurb = _mm_set1_epi32((uint16_t)k->u[0] | ((uint32_t)(uint16_t)k->u[2] << 16));
+	const __m128i kuga = _mm_set1_epi32((uint16_t)k->u[1] | ((uint32_t)(uint16_t)k->u[3] << 16));
+	const __m128i kvrb = _mm_set1_epi32((uint16_t)k->v[0] | ((uint32_t)(uint16_t)k->v[2] << 16));
+	const __m128i kvga = _mm_set1_epi32((uint16_t)k->v[1] | ((uint32_t)(uint16_t)k->v[3] << 16));
+	const __m128i round16 = _mm_set1_epi32(32768), round2 = _mm_set1_epi32(2);
+	__m128i rb0, ga0, rb1, ga1;
+
+	ChromaPairSums(r0, r1, &rb0, &ga0);
+	ChromaPairSums(r0 + 16, r1 + 16, &rb1, &ga1);
+
+	__m128i sa = EvenLanes(_mm_srli_epi32(ga0, 16), _mm_srli_epi32(ga1, 16));
+	if (_mm_movemask_epi8(_mm_cmpeq_epi32(sa, _mm_setzero_si128())) == 0xFFFF) return false;
+
+	__m128i su = EvenLanes(_mm_add_epi32(_mm_madd_epi16(rb0, kurb), _mm_madd_epi16(ga0, kuga)),
+						   _mm_add_epi32(_mm_madd_epi16(rb1, kurb), _mm_madd_epi16(ga1, kuga)));
+	__m128i sv = EvenLanes(_mm_add_epi32(_mm_madd_epi16(rb0, kvrb), _mm_madd_epi16(ga0, kvga)),
+						   _mm_add_epi32(_mm_madd_epi16(rb1, kvrb), _mm_madd_epi16(ga1, kvga)));
+
+	_mm_storeu_si128((__m128i *)u, _mm_srai_epi32(_mm_add_epi32(su, round16), 16));
+	_mm_storeu_si128((__m128i *)v, _mm_srai_epi32(_mm_add_epi32(sv, round16), 16));
+	_mm_storeu_si128((__m128i *)a, _mm_srli_epi32(_mm_add_epi32(sa, round2), 2));
+	return true;
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	uint8x8x4_t p0 = vld4_u8(r0), p1 = vld4_u8(r1);
+	int32x4_t r = vreinterpretq_s32_u32(vpaddlq_u16(vaddl_u8(p0.val[0], p1.val[0])));
+	int32x4_t g = vreinterpretq_s32_u32(vpaddlq_u16(vaddl_u8(p0.val[1], p1.val[1])));
+	int32x4_t b = vreinterpretq_s32_u32(vpaddlq_u16(vaddl_u8(p0.val[2], p1.val[2])));
+	int32x4_t sa = vreinterpretq_s32_u32(vpaddlq_u16(vaddl_u8(p0.val[3], p1.val[3])));
+
+	if (vmaxvq_s32(sa) == 0) return false;
+
+	int32x4_t su = vmlaq_n_s32(vmlaq_n_s32(vmlaq_n_s32(vmulq_n_s32(r, k->u[0]), g, k->u[1]), b, k->u[2]), sa, k->u[3]);
+	int32x4_t sv = vmlaq_n_s32(vmlaq_n_s32(vmlaq_n_s32(vmulq_n_s32(r, k->v[0]), g, k->v[1]), b, k->v[2]), sa, k->v[3]);
+
+	vst1q_s32(u, vshrq_n_s32(vaddq_s32(su, vdupq_n_s32(32768)), 16));
+	vst1q_s32(v, vshrq_n_s32(vaddq_s32(sv, vdupq_n_s32(32768)), 16));
+	vst1q_s32(a, vshrq_n_s32(vaddq_s32(sa, vdupq_n_s32(2)), 2));
+	return true;
+#else
+	bool any = false;
+
+	for (int i = 0; i < 4; i++) {
+		const uint8_t *p = r0 + i * 8, *q = r1 + i * 8;
+		int sr = p[0] + p[4] + q[0] + q[4], sg = p[1] + p[5] + q[1] + q[5];
+		int sb = p[2] + p[6] + q[2] + q[6], sa = p[3] + p[7] + q[3] + q[7];
+
+		u[i] = (k->u[0] * sr + k->u[1] * sg + k->u[2] * sb + k->u[3] * sa + 32768) >> 16;
+		v[i] = (k->v[0] * sr + k->v[1] * sg + k->v[2] * sb + k->v[3] * sa + 32768) >> 16;
+		a[i] = (sa + 2) >> 2;
+		any |= sa != 0;
+	}
+
+	return any;
+#endif
+}
+
+static void BlendChromaRow(const SubYUVFrame *frame, int cy, const uint8_t *rows[2], int x, int x0, int x1, const BlendCoefficients *k)
+{
+	int cx = x0 >> 1, cEnd = (x1 + 1) >> 1;
+
+	// a leading block that's only half covered
+	if (x0 & 1) BlendChromaBlock(frame, cx++, cy, rows, x, x0, x1, k);
+
+	if (rows[0] && rows[1]) {
+		for (; (cx + 4) * 2 <= x1; cx += 4) {
+			int32_t u[4], v[4], a[4];
+
+			if (!ChromaBlocks4(rows[0] + (cx * 2 - x) * 4, rows[1] + (cx * 2 - x) * 4, k, u, v, a)) continue;
+			for (int i = 0; i < 4; i++) StoreChroma(frame, cx + i, cy, u[i], v[i], a[i]);
+		}
+	}
+
+	for (; cx < cEnd; cx++) BlendChromaBlock(frame, cx, cy, rows, x, x0, x1, k);
+}
+
+#pragma mark -
+
+void SubYUVBlendRGBA(const SubYUVFrame *frame, const uint8_t *rgba, ptrdiff_t rgbaStride, int x, int y, int width, int height)
+{
+	int x0 = x > 0 ? x : 0, y0 = y > 0 ? y : 0;
+	int x1 = x + width < frame->width ? x + width : frame->width, y1 = y + height < frame->height ? y + height : frame->height;
+	BlendCoefficients k;
+
+	if (x0 >= x1 || y0 >= y1) return;
+
+	SetupCoefficients(frame, &k);
+
+	for (int py = y0; py < y1; py++)
+		BlendLumaRow(frame->planes[0] + py * frame->strides[0] + x0, rgba + (py - y) * rgbaStride + (x0 - x) * 4, x1 - x0, &k);
+
+	for (int cy = y0 >> 1; cy <= (y1 - 1) >> 1; cy++) {
+		const uint8_t *rows[2];
+
+		for (int r = 0; r < 2; r++) {
+			int py = cy * 2 + r;
+			rows[r] = (py >= y0 && py < y1) ? rgba + (py - y) * rgbaStride : NULL;
+		}
+
+		BlendChromaRow(frame, cy, rows, x, x0, x1, &k);
+	}
+}
+
+//! Returns the index of the first pixel with nonzero alpha in a row, or \c count if there isn't one.
+static int FirstCoveredPixel(const uint8_t *px, int count)
+{
+	int i = 0;
+
+#if defined(__SSE2__)
+	const __m128i alpha = _mm_set1_epi32((int)0xFF000000), zero = _mm_setzero_si128();
+
+	for (; i + 4 <= count; i += 4) {
+		__m128i a = _mm_and_si128(_mm_loadu_si128((const __m128i *)(px + i * 4)), alpha);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(a, zero)) != 0xFFFF) break;
+	}
+#endif
+
+	for (; i < count; i++)
+		if (px[i * 4 + 3]) return i;
+
+	return count;
+}
+
+bool SubYUVCoverageRect(const uint8_t *rgba, ptrdiff_t rgbaStride, int width, int height, int *outX, int *outY, int *outWidth, int *outHeight)
+{
+	int minX = width, maxX = -1, minY = -1, maxY = -1;
+
+	for (int y = 0; y < height; y++) {
+		const uint8_t *row = rgba + y * rgbaStride;
+		int first = FirstCoveredPixel(row, width);
+
+		if (first == width) continue;
+
+		int last = width - 1;
+		while (last > first && !row[last * 4 + 3]) last--;
+
+		if (minY < 0) minY = y;
+		maxY = y;
+		if (first < minX) minX = first;
+		if (last > maxX) maxX = last;
+	}
+
+	if (minY < 0) return false;
+
+	*outX = minX;
+	*outY = minY;
+	*outWidth = maxX - minX + 1;
+	*outHeight = maxY - minY + 1;
+	return true;
+}
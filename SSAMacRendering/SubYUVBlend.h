@@ -0,0 +1,59 @@
+//
+//  SubYUVBlend.h
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+#ifndef SubYUVBlend_h
+#define SubYUVBlend_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+typedef enum SubYUVFormat {
+	kSubYUV420P = 0,	//!< Three planes: Y, then U and V at half width and height.
+	kSubYUVNV12			//!< Two planes: Y, then interleaved UV at half height.
+} SubYUVFormat;
+
+typedef enum SubYUVMatrix {
+	kSubYUVMatrixBT601 = 0,
+	kSubYUVMatrixBT709
+} SubYUVMatrix;
+
+//! A caller-owned 4:2:0 video frame to burn subtitles into.
+typedef struct SubYUVFrame {
+	SubYUVFormat format;
+	SubYUVMatrix matrix;
+	bool fullRange;			//!< 0-255 instead of 16-235/16-240.
+	int width, height;		//!< In luma samples.
+	uint8_t *planes[3];
+	ptrdiff_t strides[3];
+} SubYUVFrame;
+
+/**
+ * Blends a subtitle image over part of a frame.
+ *
+ * \c rgba is premultiplied R,G,B,A bytes with the top row first, which is what a
+ * CGBitmapContext with <code>kCGImageAlphaPremultipliedLast | kCGBitmapByteOrder32Big</code> holds.
+ * It is placed with its top left corner at \c x,y in the frame and clipped to the frame.
+ * Only the luma samples under the image and the chroma samples whose 2x2 block it
+ * touches are read or written, and runs of transparent pixels are skipped.
+ */
+extern void SubYUVBlendRGBA(const SubYUVFrame *frame, const uint8_t *rgba, ptrdiff_t rgbaStride, int x, int y, int width, int height);
+
+/**
+ * Finds the smallest rectangle holding every pixel of \c rgba with nonzero alpha,
+ * so a full-frame render can be blended with SubYUVBlendRGBA() at the cost of its subtitles.
+ * Returns false if the whole image is transparent.
+ */
+extern bool SubYUVCoverageRect(const uint8_t *rgba, ptrdiff_t rgbaStride, int width, int height, int *outX, int *outY, int *outWidth, int *outHeight);
+
+__END_DECLS
+
+#endif /* SubYUVBlend_h */
@@ -122,6 +122,12 @@ extension SubSSATagName: CustomStringConvertible {
 			return "tag_fad"
 		case .tag_fade:
 			return "tag_fade"
+		case .tag_blur:
+			return "tag_blur"
+		case .tag_xbord:
+			return "tag_xbord"
+		case .tag_ybord:
+			return "tag_ybord"
 		@unknown default:
 			return "Unknown tag_, value \(rawValue)"
 		}
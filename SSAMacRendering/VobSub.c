@@ -0,0 +1,415 @@
+//
+//  VobSub.c
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include "VobSub.h"
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#pragma mark .idx files
+
+static bool LineHasPrefix(const char *line, const char *end, const char *prefix, const char **value)
+{
+	size_t len = strlen(prefix);
+
+	if ((size_t)(end - line) < len || strncasecmp(line, prefix, len)) return false;
+
+	line += len;
+	while (line < end && isspace((unsigned char)*line)) line++;
+	*value = line;
+	return true;
+}
+
+static long ParseDecimal(const char **p, const char *end)
+{
+	long v = 0;
+
+	while (*p < end && isdigit((unsigned char)**p)) v = v * 10 + (*(*p)++ - '0');
+	return v;
+}
+
+//! Parses "hh:mm:ss:mmm" into milliseconds.
+static int64_t ParseIndexTime(const char *p, const char *end)
+{
+	int64_t sign = 1, parts[4] = {0};
+
+	if (p < end && *p == '-') {
+		sign = -1;
+		p++;
+	}
+
+	for (int i = 0; i < 4; i++) {
+		parts[i] = ParseDecimal(&p, end);
+		if (p < end && *p == ':') p++;
+	}
+
+	return sign * (((parts[0] * 60 + parts[1]) * 60 + parts[2]) * 1000 + parts[3]);
+}
+
+static void TrackAppend(VobSubIndexTrack *track, int64_t time, int64_t offset)
+{
+	if (track->count == track->capacity) {
+		track->capacity = track->capacity ? track->capacity * 2 : 256;
+		track->times = realloc(track->times, track->capacity * sizeof(int64_t));
+		track->offsets = realloc(track->offsets, track->capacity * sizeof(int64_t));
+	}
+
+	track->times[track->count] = time;
+	track->offsets[track->count] = offset;
+	track->count++;
+}
+
+bool VobSubIndexParse(const char *text, size_t length, VobSubIndex *idx)
+{
+	const char *p = text, *textEnd = text + length;
+	VobSubIndexTrack *track = NULL;
+	int64_t delay = 0;
+	bool hasSize = false, hasPalette = false;
+
+	memset(idx, 0, sizeof(*idx));
+	idx->headerLength = length;
+
+	while (p < textEnd) {
+		const char *line = p, *end = memchr(p, '\n', textEnd - p), *value;
+
+		if (!end) end = textEnd;
+		p = end + 1;
+		if (end > line && end[-1] == '\r') end--;
+
+		if (LineHasPrefix(line, end, "size:", &value)) {
+			idx->width = (int)ParseDecimal(&value, end);
+			if (value < end && (*value == 'x' || *value == 'X')) value++;
+			idx->height = (int)ParseDecimal(&value, end);
+			hasSize = idx->width > 0 && idx->height > 0;
+		} else if (LineHasPrefix(line, end, "palette:", &value)) {
+			int i;
+			for (i = 0; i < 16 && value < end; i++) {
+				char *after;
+				char hex[7] = {0};
+
+				memcpy(hex, value, end - value < 6 ? end - value : 6);
+				idx->palette[i] = (uint32_t)strtoul(hex, &after, 16);
+				if (after == hex) break; // not a color; the palette is incomplete
+				value += after - hex;
+				while (value < end && (*value == ',' || isspace((unsigned char)*value))) value++;
+			}
+			hasPalette = i == 16;
+		} else if (LineHasPrefix(line, end, "id:", &value)) {
+			if (!track) idx->headerLength = line - text;
+
+			idx->tracks = realloc(idx->tracks, (idx->trackCount + 1) * sizeof(VobSubIndexTrack));
+			track = &idx->tracks[idx->trackCount++];
+			memset(track, 0, sizeof(*track));
+			memcpy(track->language, value, end - value < 2 ? end - value : 2);
+
+			const char *index = value;
+			while (index < end && !LineHasPrefix(index, end, "index:", &value)) index++;
+			track->index = (index < end) ? (int)ParseDecimal(&value, end) : (int)idx->trackCount - 1;
+			delay = 0;
+		} else if (track && LineHasPrefix(line, end, "delay:", &value)) {
+			delay += ParseIndexTime(value, end);
+		} else if (track && LineHasPrefix(line, end, "timestamp:", &value)) {
+			int64_t time = ParseIndexTime(value, end) + delay;
+			const char *filepos = value;
+
+			while (filepos < end && !LineHasPrefix(filepos, end, "filepos:", &value)) filepos++;
+			if (filepos == end) continue;
+
+			TrackAppend(track, time, strtoll(value, NULL, 16));
+		}
+	}
+
+	return hasSize && hasPalette;
+}
+
+void VobSubIndexFree(VobSubIndex *idx)
+{
+	for (size_t i = 0; i < idx->trackCount; i++) {
+		free(idx->tracks[i].times);
+		free(idx->tracks[i].offsets);
+	}
+
+	free(idx->tracks);
+	memset(idx, 0, sizeof(*idx));
+}
+
+long VobSubIndexTrackFind(const int64_t *times, size_t count, int64_t time)
+{
+	size_t lo = 0, hi = count;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (times[mid] <= time) lo = mid + 1;
+		else hi = mid;
+	}
+
+	return (long)lo - 1;
+}
+
+#pragma mark .sub files
+
+static int64_t ParsePTS(const uint8_t *p)
+{
+	return ((int64_t)(p[0] & 0x0e) << 29) | (p[1] << 22) | ((p[2] & 0xfe) << 14) | (p[3] << 7) | (p[4] >> 1);
+}
+
+size_t VobSubDemuxSPU(const uint8_t *sub, size_t subLength, size_t offset, uint8_t *buf, size_t bufLength, int64_t *pts)
+{
+	size_t pos = offset, got = 0, spuSize = 0;
+	int stream = -1;
+
+	while (pos + 6 <= subLength) {
+		const uint8_t *p = sub + pos;
+
+		if (p[0] || p[1] || p[2] != 1) {
+			pos++;
+			continue;
+		}
+
+		if (p[3] == 0xBA) { // pack header
+			if ((p[4] & 0xC0) == 0x40) {
+				if (pos + 14 > subLength) break;
+				pos += 14 + (p[13] & 7);
+			} else pos += 12;
+			continue;
+		}
+
+		size_t next = pos + 6 + ((p[4] << 8) | p[5]);
+		if (next > subLength) break;
+
+		// private stream 1, MPEG-2 PES header, which needs 3 bytes after the length
+		if (p[3] == 0xBD && next >= pos + 9 && (p[6] & 0xC0) == 0x80) {
+			size_t payload = pos + 9 + p[8];
+
+			if (payload < next) {
+				int substream = sub[payload];
+				const uint8_t *data = sub + payload + 1;
+				size_t dataLength = next - payload - 1;
+
+				if (stream == -1) {
+					stream = substream;
+					if (dataLength < 2) return 0;
+					spuSize = (data[0] << 8) | data[1];
+					if (spuSize < 4 || spuSize > bufLength) return 0;
+					if (pts) *pts = ((p[7] & 0x80) && p[8] >= 5) ? ParsePTS(p + 9) : 0;
+				}
+
+				if (substream == stream) {
+					size_t copy = dataLength < spuSize - got ? dataLength : spuSize - got;
+
+					memcpy(buf + got, data, copy);
+					got += copy;
+					if (got == spuSize) return spuSize;
+				}
+			}
+		}
+
+		pos = next;
+	}
+
+	return 0;
+}
+
+#pragma mark Subpictures
+
+typedef struct NibbleReader {
+	const uint8_t *data;
+	size_t nibble, end; //!< in nibbles
+} NibbleReader;
+
+static inline unsigned GetNibble(NibbleReader *r)
+{
+	if (r->nibble >= r->end) return 0;
+
+	unsigned byte = r->data[r->nibble / 2];
+	return (r->nibble++ & 1) ? (byte & 0xf) : (byte >> 4);
+}
+
+//! Decodes one run-length encoded line. Runs are 4, 8, 12 or 16 bits: the run length is everything above the low 2 bits, and 0 means "to the end of the line".
+static bool DecodeLine(NibbleReader *r, uint8_t *row, int width)
+{
+	int x = 0;
+
+	while (x < width) {
+		if (r->nibble >= r->end) return false;
+
+		unsigned v = GetNibble(r);
+		if (v < 0x4) {
+			v = (v << 4) | GetNibble(r);
+			if (v < 0x10) {
+				v = (v << 4) | GetNibble(r);
+				if (v < 0x40) v = (v << 4) | GetNibble(r);
+			}
+		}
+
+		int run = v >> 2;
+		if (!run || run > width - x) run = width - x;
+
+		memset(row + x, v & 3, run);
+		x += run;
+	}
+
+	r->nibble = (r->nibble + 1) & ~(size_t)1; // lines are byte aligned
+	return true;
+}
+
+//! SPU delays are in units of 1024/90000 s.
+static int DelayToMilliseconds(unsigned delay)
+{
+	return (int)((delay * 1024 + 45) / 90);
+}
+
+bool VobSubDecodeSPU(const uint8_t *spu, size_t length, VobSubPicture *pic)
+{
+	size_t control, fieldOffset[2] = {0, 0};
+	int x2 = -1, y2 = -1;
+
+	memset(pic, 0, sizeof(*pic));
+	pic->endDelay = -1;
+
+	if (length < 4) return false;
+	control = (spu[2] << 8) | spu[3];
+
+	for (int sequences = 0; sequences < 64 && control + 4 <= length; sequences++) {
+		unsigned delay = (spu[control] << 8) | spu[control+1];
+		size_t next = (spu[control+2] << 8) | spu[control+3], i = control + 4;
+		bool done = false;
+
+		while (i < length && !done) {
+			switch (spu[i++]) {
+				case 0x00: pic->forced = true; break;
+				case 0x01: pic->startDelay = DelayToMilliseconds(delay); break;
+				case 0x02: pic->endDelay = DelayToMilliseconds(delay); break;
+				case 0x03:
+					if (i + 2 > length) return false;
+					pic->colorIndex[3] = spu[i] >> 4; pic->colorIndex[2] = spu[i] & 0xf;
+					pic->colorIndex[1] = spu[i+1] >> 4; pic->colorIndex[0] = spu[i+1] & 0xf;
+					i += 2;
+					break;
+				case 0x04:
+					if (i + 2 > length) return false;
+					pic->alpha[3] = spu[i] >> 4; pic->alpha[2] = spu[i] & 0xf;
+					pic->alpha[1] = spu[i+1] >> 4; pic->alpha[0] = spu[i+1] & 0xf;
+					i += 2;
+					break;
+				case 0x05:
+					if (i + 6 > length) return false;
+					pic->x = (spu[i] << 4) | (spu[i+1] >> 4);
+					x2 = ((spu[i+1] & 0xf) << 8) | spu[i+2];
+					pic->y = (spu[i+3] << 4) | (spu[i+4] >> 4);
+					y2 = ((spu[i+4] & 0xf) << 8) | spu[i+5];
+					i += 6;
+					break;
+				case 0x06:
+					if (i + 4 > length) return false;
+					fieldOffset[0] = (spu[i] << 8) | spu[i+1];
+					fieldOffset[1] = (spu[i+2] << 8) | spu[i+3];
+					i += 4;
+					break;
+				case 0xff: done = true; break;
+				default: return false;
+			}
+		}
+
+		if (next == control) break;
+		control = next;
+	}
+
+	pic->width = x2 - pic->x + 1;
+	pic->height = y2 - pic->y + 1;
+	if (pic->width <= 0 || pic->height <= 0 || !fieldOffset[0] || !fieldOffset[1] ||
+		fieldOffset[0] >= length || fieldOffset[1] >= length) return false;
+
+	pic->pixels = malloc((size_t)pic->width * pic->height);
+	if (!pic->pixels) return false;
+
+	// the two fields are interlaced: even lines first, then odd lines
+	NibbleReader fields[2] = {
+		{spu, fieldOffset[0] * 2, length * 2},
+		{spu, fieldOffset[1] * 2, length * 2}
+	};
+
+	for (int y = 0; y < pic->height; y++) {
+		if (!DecodeLine(&fields[y & 1], pic->pixels + (size_t)y * pic->width, pic->width)) {
+			// a truncated field leaves the rest of the picture transparent
+			memset(pic->pixels + (size_t)y * pic->width, 0, (size_t)(pic->height - y) * pic->width);
+			break;
+		}
+	}
+
+	return true;
+}
+
+void VobSubPictureFree(VobSubPicture *pic)
+{
+	free(pic->pixels);
+	pic->pixels = NULL;
+}
+
+void VobSubPictureColors(const VobSubPicture *pic, const uint32_t palette[16], uint8_t colors[16])
+{
+	for (int i = 0; i < 4; i++) {
+		uint32_t rgb = palette[pic->colorIndex[i]];
+		unsigned a = pic->alpha[i] * 17;
+
+		colors[i*4+0] = (((rgb >> 16) & 0xff) * a + 127) / 255;
+		colors[i*4+1] = (((rgb >> 8) & 0xff) * a + 127) / 255;
+		colors[i*4+2] = ((rgb & 0xff) * a + 127) / 255;
+		colors[i*4+3] = a;
+	}
+}
+
+void VobSubExpandPalette(const uint8_t *pixels, size_t count, const uint8_t colors[16], uint8_t *rgba)
+{
+	size_t i = 0;
+
+	// The four colors fit in one 16-byte register, so each group of four pixels is one
+	// byte shuffle: pixel value v selects bytes 4v...4v+3 of the table.
+#if defined(__SSSE3__)
+	const __m128i table = _mm_loadu_si128((const __m128i *)colors);
+	const __m128i lane = _mm_setr_epi8(0,1,2,3, 0,1,2,3, 0,1,2,3, 0,1,2,3);
+
+	for (; i + 16 <= count; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(pixels + i));
+
+		for (int k = 0; k < 4; k++) {
+			const __m128i spread = _mm_setr_epi8(4*k,4*k,4*k,4*k, 4*k+1,4*k+1,4*k+1,4*k+1, 4*k+2,4*k+2,4*k+2,4*k+2, 4*k+3,4*k+3,4*k+3,4*k+3);
+			__m128i index = _mm_shuffle_epi8(v, spread);
+			// values are below 4, so shifting 16-bit lanes can't carry between bytes
+			index = _mm_add_epi8(_mm_slli_epi16(index, 2), lane);
+			_mm_storeu_si128((__m128i *)(rgba + (i + 4*k) * 4), _mm_shuffle_epi8(table, index));
+		}
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	const uint8x16_t table = vld1q_u8(colors);
+	const uint8_t laneBytes[16] = {0,1,2,3, 0,1,2,3, 0,1,2,3, 0,1,2,3};
+	const uint8x16_t lane = vld1q_u8(laneBytes);
+
+	for (; i + 16 <= count; i += 16) {
+		uint8x16_t v = vld1q_u8(pixels + i);
+
+		for (int k = 0; k < 4; k++) {
+			const uint8_t spreadBytes[16] = {4*k,4*k,4*k,4*k, 4*k+1,4*k+1,4*k+1,4*k+1, 4*k+2,4*k+2,4*k+2,4*k+2, 4*k+3,4*k+3,4*k+3,4*k+3};
+			uint8x16_t index = vqtbl1q_u8(v, vld1q_u8(spreadBytes));
+			index = vaddq_u8(vshlq_n_u8(index, 2), lane);
+			vst1q_u8(rgba + (i + 4*k) * 4, vqtbl1q_u8(table, index));
+		}
+	}
+#endif
+
+	for (; i < count; i++)
+		memcpy(rgba + i * 4, colors + (pixels[i] & 3) * 4, 4);
+}
@@ -0,0 +1,83 @@
+//
+//  VobSub.h
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+#ifndef VobSub_h
+#define VobSub_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+#pragma mark .idx files
+
+//! One language in a .idx file. Times are in milliseconds; offsets are into the .sub file.
+typedef struct VobSubIndexTrack {
+	char language[3];
+	int index;
+	int64_t *times;
+	int64_t *offsets;
+	size_t count, capacity;
+} VobSubIndexTrack;
+
+typedef struct VobSubIndex {
+	int width, height;
+	uint32_t palette[16];	//!< 0xRRGGBB
+	VobSubIndexTrack *tracks;
+	size_t trackCount;
+	size_t headerLength;	//!< Length of everything before the first "id:" line, the part Matroska stores as CodecPrivate.
+} VobSubIndex;
+
+//! Parses the text of a .idx file. Returns false if there's no "size:" or "palette:" line.
+extern bool VobSubIndexParse(const char *text, size_t length, VobSubIndex *idx);
+extern void VobSubIndexFree(VobSubIndex *idx);
+
+//! Returns the index of the last sample starting at or before \c time, or -1 if \c time is before the first one.
+extern long VobSubIndexTrackFind(const int64_t *times, size_t count, int64_t time);
+
+#pragma mark .sub files
+
+/**
+ * Reads the subpicture unit starting at \c offset in an MPEG-PS .sub file.
+ *
+ * The SPU is reassembled from the private stream 1 PES packets with the same substream
+ * as the first one, into \c buf, which should be at least 65536 bytes.
+ * \c pts, if not NULL, gets the first packet's presentation time in 90 kHz units.
+ * Returns the SPU length, or 0 if it couldn't be read.
+ */
+extern size_t VobSubDemuxSPU(const uint8_t *sub, size_t subLength, size_t offset, uint8_t *buf, size_t bufLength, int64_t *pts);
+
+#pragma mark Subpictures
+
+typedef struct VobSubPicture {
+	int x, y, width, height;
+	int startDelay, endDelay;	//!< Milliseconds from the SPU's PTS. \c endDelay is -1 if the SPU doesn't say.
+	bool forced;
+	uint8_t colorIndex[4];		//!< Palette entries for each of the 2-bit pixel values.
+	uint8_t alpha[4];			//!< 0-15
+	uint8_t *pixels;			//!< width * height 2-bit values, one per byte, owned by the picture
+} VobSubPicture;
+
+/**
+ * Parses an SPU's control sequences and decodes its run-length encoded fields.
+ * Returns false if the SPU is malformed. Free the picture with VobSubPictureFree.
+ */
+extern bool VobSubDecodeSPU(const uint8_t *spu, size_t length, VobSubPicture *pic);
+extern void VobSubPictureFree(VobSubPicture *pic);
+
+//! Builds the four premultiplied RGBA colors (as bytes R,G,B,A) a picture's pixel values map to.
+extern void VobSubPictureColors(const VobSubPicture *pic, const uint32_t palette[16], uint8_t colors[16]);
+
+//! Expands \c count 2-bit pixel values to RGBA through \c colors. Uses SSSE3 or NEON table lookups when available.
+extern void VobSubExpandPalette(const uint8_t *pixels, size_t count, const uint8_t colors[16], uint8_t *rgba);
+
+__END_DECLS
+
+#endif /* VobSub_h */
@@ -0,0 +1,48 @@
+//
+//  VobSubDecoder.h
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <CoreGraphics/CoreGraphics.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class VobSubTrack;
+
+//! One decoded VobSub subpicture.
+@interface VobSubImage : NSObject
+//! Premultiplied RGBA, the size of \c frame.
+@property (readonly) CGImageRef image;
+//! Where the image goes, in the .idx file's video size, with the origin at the top left.
+@property (readonly) CGRect frame;
+//! Milliseconds.
+@property (readonly) long startTime, endTime;
+@property (readonly, getter=isForced) BOOL forced;
+@end
+
+/**
+ * @brief Decodes the subpictures of a VobSub .sub file.
+ *
+ * @discussion The .sub file is memory mapped. Decoding a sample only reads the mapping,
+ * so one decoder can be used from several threads at once.
+ */
+@interface VobSubDecoder : NSObject
+
+- (instancetype)init UNAVAILABLE_ATTRIBUTE;
+//! \c privateData is the .idx header, e.g. <code>-[VobSubTrack privateData]</code>.
+- (nullable instancetype)initWithSubURL:(NSURL *)subURL privateData:(NSData *)privateData error:(NSError *_Nullable __autoreleasing *_Nullable)error NS_DESIGNATED_INITIALIZER;
+
+@property (readonly) CGSize videoSize;
+
+- (nullable VobSubImage *)imageForSampleAtIndex:(NSUInteger)index ofTrack:(VobSubTrack *)track;
+
+/// Decodes every sample of \c track in parallel. Samples that can't be decoded are \c NSNull.
+- (NSArray *)imagesForTrack:(VobSubTrack *)track;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,171 @@
+//
+//  VobSubDecoder.m
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+#import "VobSubDecoder.h"
+#import "SubImport.h"
+#import "Codecprintf.h"
+#include "VobSub.h"
+
+//! The SPU size field is 16 bits.
+#define kVobSubMaxSPUSize 65536
+
+@implementation VobSubImage
+{
+	CGImageRef image;
+	CGRect frame;
+	long startTime, endTime;
+	BOOL forced;
+}
+@synthesize image;
+@synthesize frame;
+@synthesize startTime;
+@synthesize endTime;
+@synthesize forced;
+
+- (instancetype)initWithImage:(CGImageRef)img frame:(CGRect)rect start:(long)start end:(long)end forced:(BOOL)isForced
+{
+	if (self = [super init]) {
+		image = CGImageRetain(img);
+		frame = rect;
+		startTime = start;
+		endTime = end;
+		forced = isForced;
+	}
+
+	return self;
+}
+
+- (void)dealloc
+{
+	CGImageRelease(image);
+}
+
+@end
+
+static void ReleasePixels(void *info, const void *data, size_t size)
+{
+	free((void *)data);
+}
+
+@implementation VobSubDecoder
+{
+	NSData *sub;
+	uint32_t palette[16];
+	CGSize videoSize;
+	CGColorSpaceRef colorSpace;
+}
+@synthesize videoSize;
+
+- (instancetype)initWithSubURL:(NSURL *)subURL privateData:(NSData *)privateData error:(NSError *__autoreleasing *)error
+{
+	if (self = [super init]) {
+		VobSubIndex idx;
+
+		if (!VobSubIndexParse((const char *)[privateData bytes], [privateData length], &idx)) {
+			VobSubIndexFree(&idx);
+			if (error) *error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadCorruptFileError userInfo:nil];
+			return nil;
+		}
+
+		memcpy(palette, idx.palette, sizeof(palette));
+		videoSize = CGSizeMake(idx.width, idx.height);
+		VobSubIndexFree(&idx);
+
+		sub = [NSData dataWithContentsOfURL:subURL options:NSDataReadingMappedAlways error:error];
+		if (!sub) return nil;
+
+		colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
+	}
+
+	return self;
+}
+
+- (void)dealloc
+{
+	CGColorSpaceRelease(colorSpace);
+}
+
+- (VobSubImage *)imageForSampleAtIndex:(NSUInteger)index ofTrack:(VobSubTrack *)track spuBuffer:(uint8_t *)spu
+{
+	long time, offset;
+	VobSubPicture pic;
+	uint8_t colors[16];
+
+	[track getTime:&time offset:&offset ofSampleAtIndex:index];
+	if (offset < 0 || (NSUInteger)offset >= [sub length]) return nil;
+
+	size_t spuLength = VobSubDemuxSPU([sub bytes], [sub length], offset, spu, kVobSubMaxSPUSize, NULL);
+	if (!spuLength || !VobSubDecodeSPU(spu, spuLength, &pic)) {
+		Codecprintf(NULL, "Couldn't decode VobSub sample %lu at offset %ld\n", (unsigned long)index, offset);
+		return nil;
+	}
+
+	size_t pixelCount = (size_t)pic.width * pic.height;
+	uint8_t *rgba = malloc(pixelCount * 4);
+
+	VobSubPictureColors(&pic, palette, colors);
+	VobSubExpandPalette(pic.pixels, pixelCount, colors, rgba);
+
+	CGDataProviderRef provider = CGDataProviderCreateWithData(NULL, rgba, pixelCount * 4, ReleasePixels);
+	CGImageRef image = CGImageCreate(pic.width, pic.height, 8, 32, pic.width * 4, colorSpace,
+									 kCGImageAlphaPremultipliedLast | kCGBitmapByteOrderDefault, provider, NULL, false, kCGRenderingIntentDefault);
+	CGDataProviderRelease(provider);
+
+	long end;
+	if (pic.endDelay >= 0) {
+		end = time + pic.endDelay;
+	} else if (index + 1 < [track sampleCount]) {
+		[track getTime:&end offset:NULL ofSampleAtIndex:index + 1];
+	} else {
+		end = time + pic.startDelay;
+	}
+
+	VobSubImage *result = [[VobSubImage alloc] initWithImage:image frame:CGRectMake(pic.x, pic.y, pic.width, pic.height)
+													   start:time + pic.startDelay end:end forced:pic.forced];
+
+	CGImageRelease(image);
+	VobSubPictureFree(&pic);
+	return result;
+}
+
+- (VobSubImage *)imageForSampleAtIndex:(NSUInteger)index ofTrack:(VobSubTrack *)track
+{
+	uint8_t *spu = malloc(kVobSubMaxSPUSize);
+	VobSubImage *image = [self imageForSampleAtIndex:index ofTrack:track spuBuffer:spu];
+
+	free(spu);
+	return image;
+}
+
+- (NSArray *)imagesForTrack:(VobSubTrack *)track
+{
+	NSUInteger count = [track sampleCount], workers = MAX([[NSProcessInfo processInfo] activeProcessorCount], 1);
+	__strong id *images = (__strong id *)calloc(MAX(count, 1), sizeof(id));
+
+	// one SPU buffer per worker, each decoding an interleaved share of the samples
+	dispatch_apply(workers, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t worker) {
+		uint8_t *spu = malloc(kVobSubMaxSPUSize);
+
+		for (NSUInteger i = worker; i < count; i += workers) {
+			@autoreleasepool {
+				VobSubImage *image = [self imageForSampleAtIndex:i ofTrack:track spuBuffer:spu];
+				images[i] = image ? image : [NSNull null];
+			}
+		}
+
+		free(spu);
+	});
+
+	NSArray *result = [NSArray arrayWithObjects:images count:count];
+
+	for (NSUInteger i = 0; i < count; i++) images[i] = nil;
+	free(images);
+	return result;
+}
+
+@end
@@ -21,23 +21,30 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <stdarg.h>
 #import "SubImport.h"
 #import "SubParsing.h"
 #import "SubRenderer.h"
 #import "SubParsing.h"
 
+//! Output is collected here and written out whenever it fills, so memory use doesn't depend on the script length.
+#define kHTMLBufferSize 16384
+
 @interface SubHTMLExporter : NSObject <SubRenderer>
 {
 	SubContext *sc;
-	NSMutableString *html;
+	FILE *out;
+	size_t used;
+	char buf[kHTMLBufferSize];
 }
-@property (readonly) NSMutableString *html;
+- (instancetype)initWithFile:(FILE*)f;
+- (void)flush;
 @end
 
 @interface SubHTMLSpanExtra : NSObject <NSCopying>
 {
 	@public;
-	NSMutableString *str;
+	NSMutableData *css; //!< UTF-8 contents of the span's style attribute
 }
 @end
 
@@ -45,7 +52,7 @@
 -(instancetype)init
 {
 	self = [super init];
-	str = [[NSMutableString alloc] init];
+	css = [[NSMutableData alloc] init];
 	return self;
 }
 
@@ -56,38 +63,194 @@
 
 @end
 
+static void SpanAppendFormat(SubHTMLSpanExtra *ex, const char *fmt, ...) __printflike(2, 3);
+static void SpanAppendFormat(SubHTMLSpanExtra *ex, const char *fmt, ...)
+{
+	char tmp[256];
+	va_list ap;
+	
+	va_start(ap, fmt);
+	int n = vsnprintf(tmp, sizeof(tmp), fmt, ap);
+	va_end(ap);
+	
+	if (n <= 0) return;
+	
+	if (n < (int)sizeof(tmp)) {
+		[ex->css appendBytes:tmp length:n];
+	} else {
+		// too long for the stack, e.g. a long font name, so format it again at its full length
+		char *big = malloc(n + 1);
+		
+		va_start(ap, fmt);
+		vsnprintf(big, n + 1, fmt, ap);
+		va_end(ap);
+		[ex->css appendBytes:big length:n];
+		free(big);
+	}
+}
+
 @implementation SubHTMLExporter
-@synthesize html;
 @synthesize context=sc;
+
+static void HTMLFlush(SubHTMLExporter *h)
+{
+	if (h->used) fwrite(h->buf, 1, h->used, h->out);
+	h->used = 0;
+}
+
+static void HTMLWrite(SubHTMLExporter *h, const void *s, size_t len)
+{
+	if (h->used + len > kHTMLBufferSize) {
+		HTMLFlush(h);
+		if (len > kHTMLBufferSize) {
+			fwrite(s, 1, len, h->out);
+			return;
+		}
+	}
+	
+	memcpy(h->buf + h->used, s, len);
+	h->used += len;
+}
+
+#define HTMLWriteLiteral(h, s) HTMLWrite(h, s, sizeof(s) - 1)
+
+static void HTMLWriteFormat(SubHTMLExporter *h, const char *fmt, ...) __printflike(2, 3);
+static void HTMLWriteFormat(SubHTMLExporter *h, const char *fmt, ...)
+{
+	va_list ap;
+	
+	va_start(ap, fmt);
+	int n = vsnprintf(h->buf + h->used, kHTMLBufferSize - h->used, fmt, ap);
+	va_end(ap);
+	
+	if (n < 0) return;
+	
+	// didn't fit, or only fit without room for the terminator
+	if (h->used + n >= kHTMLBufferSize) {
+		HTMLFlush(h);
+		
+		if (n >= kHTMLBufferSize) {
+			// longer than the whole buffer, so format it on its own and write it straight through
+			char *big = malloc(n + 1);
+			
+			va_start(ap, fmt);
+			vsnprintf(big, n + 1, fmt, ap);
+			va_end(ap);
+			HTMLWrite(h, big, n);
+			free(big);
+			return;
+		}
+		
+		va_start(ap, fmt);
+		n = vsnprintf(h->buf, kHTMLBufferSize, fmt, ap);
+		va_end(ap);
+		if (n < 0) return;
+	}
+	
+	h->used += n;
+}
+
+//! Writes part of \c s as UTF-8 without making any temporary strings. If \c breaks is set, newlines become <br>.
+static void HTMLWriteString(SubHTMLExporter *h, NSString *s, NSRange range, BOOL breaks)
+{
+	unichar chunk[256];
+	NSUInteger end = NSMaxRange(range);
+	
+	for (NSUInteger i = range.location; i < end;) {
+		NSUInteger n = MIN(end - i, 256);
+		[s getCharacters:chunk range:NSMakeRange(i, n)];
+		
+		// keep surrogate pairs in one chunk
+		if (n > 1 && i + n < end && CFStringIsSurrogateHighCharacter(chunk[n-1])) n--;
+		i += n;
+		
+		for (NSUInteger j = 0; j < n; j++) {
+			UTF32Char c = chunk[j];
+			
+			if (c == '\n' && breaks) {
+				HTMLWriteLiteral(h, "<br>\n");
+				continue;
+			}
+			
+			if (h->used + 4 > kHTMLBufferSize) HTMLFlush(h);
+			
+			uint8_t *o = (uint8_t*)h->buf + h->used;
+			
+			if (CFStringIsSurrogateHighCharacter(c) && j + 1 < n && CFStringIsSurrogateLowCharacter(chunk[j+1]))
+				c = CFStringGetLongCharacterForSurrogatePair(c, chunk[++j]);
+			else if (CFStringIsSurrogateHighCharacter(c) || CFStringIsSurrogateLowCharacter(c))
+				c = 0xFFFD;
+			
+			if (c < 0x80) {
+				*o++ = c;
+			} else if (c < 0x800) {
+				*o++ = 0xC0 | (c >> 6);
+				*o++ = 0x80 | (c & 0x3F);
+			} else if (c < 0x10000) {
+				*o++ = 0xE0 | (c >> 12);
+				*o++ = 0x80 | ((c >> 6) & 0x3F);
+				*o++ = 0x80 | (c & 0x3F);
+			} else {
+				*o++ = 0xF0 | (c >> 18);
+				*o++ = 0x80 | ((c >> 12) & 0x3F);
+				*o++ = 0x80 | ((c >> 6) & 0x3F);
+				*o++ = 0x80 | (c & 0x3F);
+			}
+			
+			h->used = (char*)o - h->buf;
+		}
+	}
+}
+
+static void HTMLWriteNSString(SubHTMLExporter *h, NSString *s)
+{
+	HTMLWriteString(h, s, NSMakeRange(0, [s length]), NO);
+}
+
+#pragma mark -
+
 - (CGFloat)aspectRatio {
 	return 4.0/3.0;
 }
 
--(instancetype)init
+-(instancetype)initWithFile:(FILE*)f
 {
 	if (self = [super init])
 	{
-		html = [[NSMutableString alloc] init];
-		[html appendString:@"<html>\n"];
-		[html appendString:@"<head>\n"];
-		[html appendString:@"<meta http-equiv=\"Content-type\" content=\"text/html; charset=UTF-8\" />\n"];
-		[html appendString:@"<meta name=\"generator\" content=\"ssa2html\" />\n"];
+		out = f;
+		used = 0;
+		HTMLWriteLiteral(self, "<html>\n");
+		HTMLWriteLiteral(self, "<head>\n");
+		HTMLWriteLiteral(self, "<meta http-equiv=\"Content-type\" content=\"text/html; charset=UTF-8\" />\n");
+		HTMLWriteLiteral(self, "<meta name=\"generator\" content=\"ssa2html\" />\n");
 	}
 	
 	return self;
 }
 
+-(void)flush
+{
+	HTMLFlush(self);
+	fflush(out);
+}
+
+-(void)dealloc
+{
+	HTMLFlush(self);
+}
 
 -(void)didCompleteHeaderParsing:(SubContext*)sc_
 {
 	sc = sc_;
-	[html appendFormat:@"<title>%@</title>\n",[sc->headers objectForKey:@"Title"]];
-	[html appendString:@"<style type=\"text/css\">\n"];
-	[html appendFormat:@".screen {width: %fpx; height: %fpx; background-color: gray; position: relative; display: table}\n.bottom {bottom: 20px; position: absolute} .top {top: 20px; position: absolute}\n",sc->resX,sc->resY];
+	HTMLWriteLiteral(self, "<title>");
+	HTMLWriteNSString(self, [sc->headers objectForKey:@"Title"]);
+	HTMLWriteLiteral(self, "</title>\n");
+	HTMLWriteLiteral(self, "<style type=\"text/css\">\n");
+	HTMLWriteFormat(self, ".screen {width: %fpx; height: %fpx; background-color: gray; position: relative; display: table}\n.bottom {bottom: 20px; position: absolute} .top {top: 20px; position: absolute}\n",sc->resX,sc->resY);
 }
 
-static const NSString *haligns[] = {@"left", @"center", @"right"};
-static const NSString *valigns[] = {@"bottom", @"middle", @"top"};
+static const char *haligns[] = {"left", "center", "right"};
+static const char *valigns[] = {"bottom", "middle", "top"};
 
 // font-weight actually seems to be enumerated 100|200|...|900
 // but, like, whatever
@@ -109,38 +272,38 @@ static NSString *EscapeCSSIdentifier(NSString *s)
 
 -(void)didCompleteStyleParsing:(SubStyle*)s
 {
-	[html appendFormat:@".%@ {display: table-cell; clear: none;\n",EscapeCSSIdentifier(s->name)];
-	[html appendFormat:@"font-family: \"%@\"; ",s->fontname];
-	[html appendFormat:@"font-size: %fpt;\n",s->size * (72./96.)];
-	[html appendFormat:@"color: #%X%X%X;\n",(int)(s->primaryColor.red*255.),(int)(s->primaryColor.green*255.),(int)(s->primaryColor.blue*255.)];
-	[html appendFormat:@"-webkit-text-stroke-color: #%X%X%X;\n",(int)(s->outlineColor.red*255.),(int)(s->outlineColor.green*255.),(int)(s->outlineColor.blue*255.)];
-	[html appendFormat:@"letter-spacing: %fpx;\n",s->tracking];
-//	[html appendFormat:@"-webkit-text-stroke-width: %fpx;\n",s->outlineRadius];
-	[html appendFormat:@"text-shadow: #%X%X%X %fpx %fpx 0;\n",(int)(s->shadowColor.red*255.),(int)(s->shadowColor.green*255.),(int)(s->shadowColor.blue*255.),
-					  s->shadowDist*2., s->shadowDist*2.];
-	[html appendFormat:@"text-outline: #%X%X%X %fpx 0;\n",(int)(s->shadowColor.red*255.),(int)(s->shadowColor.green*255.),(int)(s->shadowColor.blue*255.),
-		s->outlineRadius];
-	[html appendFormat:@"width: %fpx;\n",sc->resX - s->marginL - s->marginR];
-	[html appendFormat:@"font-weight: %@; font-style: %@; text-decoration: %@;\n",FontWeightStringForWeight(s->weight), s->italic ? @"italic" : @"normal", s->underline ? @"underline" : (s->strikeout ? @"line-through" : @"none")];
-	[html appendFormat:@"text-align: %@;\n", haligns[s->alignH]];
-	[html appendFormat:@"vertical-align: %@;\n", valigns[s->alignV]];
-	[html appendString:@"}\n"];
+	NSString *cssName = EscapeCSSIdentifier(s->name);
+	
+	HTMLWriteLiteral(self, ".");
+	HTMLWriteNSString(self, cssName);
+	HTMLWriteLiteral(self, " {display: table-cell; clear: none;\n");
+	HTMLWriteLiteral(self, "font-family: \"");
+	HTMLWriteNSString(self, s->fontname);
+	HTMLWriteLiteral(self, "\"; ");
+	HTMLWriteFormat(self, "font-size: %fpt;\n",s->size * (72./96.));
+	HTMLWriteFormat(self, "color: #%X%X%X;\n",(int)(s->primaryColor.red*255.),(int)(s->primaryColor.green*255.),(int)(s->primaryColor.blue*255.));
+	HTMLWriteFormat(self, "-webkit-text-stroke-color: #%X%X%X;\n",(int)(s->outlineColor.red*255.),(int)(s->outlineColor.green*255.),(int)(s->outlineColor.blue*255.));
+	HTMLWriteFormat(self, "letter-spacing: %fpx;\n",s->tracking);
+//	HTMLWriteFormat(self, "-webkit-text-stroke-width: %fpx;\n",s->outlineRadius);
+	HTMLWriteFormat(self, "text-shadow: #%X%X%X %fpx %fpx 0;\n",(int)(s->shadowColor.red*255.),(int)(s->shadowColor.green*255.),(int)(s->shadowColor.blue*255.),
+					  s->shadowDist*2., s->shadowDist*2.);
+	HTMLWriteFormat(self, "text-outline: #%X%X%X %fpx 0;\n",(int)(s->shadowColor.red*255.),(int)(s->shadowColor.green*255.),(int)(s->shadowColor.blue*255.),
+		s->outlineRadius);
+	HTMLWriteFormat(self, "width: %fpx;\n",sc->resX - s->marginL - s->marginR);
+	HTMLWriteFormat(self, "font-weight: %s; font-style: %s; text-decoration: %s;\n",[FontWeightStringForWeight(s->weight) UTF8String], s->italic ? "italic" : "normal", s->underline ? "underline" : (s->strikeout ? "line-through" : "none"));
+	HTMLWriteFormat(self, "text-align: %s;\n", haligns[s->alignH]);
+	HTMLWriteFormat(self, "vertical-align: %s;\n", valigns[s->alignV]);
+	HTMLWriteLiteral(self, "}\n");
+	
+	// every div using this style opens with the same tag, so build it once
+	s->extra = [[NSString stringWithFormat:@"<span class=\"%@\">", cssName] dataUsingEncoding:NSUTF8StringEncoding];
 }
 
 -(void)endOfHead
 {
-	[html appendString:@"</style>\n"];
-	[html appendString:@"</head>\n"];
-	[html appendString:@"<body>\n"];
-}
-
-NSString *htmlfilter(NSString *s)
-{
-	NSMutableString *ms = [s mutableCopy];
-	
-	[ms replaceOccurrencesOfString:@"\n" withString:@"<br>\n" options:0 range:NSMakeRange(0, [ms length])];
-//	[ms replaceOccurrencesOfString:[NSString stringWithFormat:@"%C",0x00A0] withString:@"&nbsp;" options:0 range:NSMakeRange(0, [ms length])];
-	return ms;
+	HTMLWriteLiteral(self, "</style>\n");
+	HTMLWriteLiteral(self, "</head>\n");
+	HTMLWriteLiteral(self, "<body>\n");
 }
 
 -(void)didCreateStartingSpan:(SubRenderSpan *)span forDiv:(SubRenderDiv *)div
@@ -151,7 +314,6 @@ NSString *htmlfilter(NSString *s)
 -(void)spanChangedTag:(SubSSATagName)tag span:(SubRenderSpan*)span div:(SubRenderDiv*)div param:(void*)p
 {
 	SubHTMLSpanExtra *ex = span.extra;
-	NSMutableString *sty = ex->str;
 	int ip;
 	NSString *sp;
 	float fp;
@@ -164,36 +326,38 @@ NSString *htmlfilter(NSString *s)
 	switch (tag) {
 		case tag_b:
 			iv();
-			[sty appendFormat:@"font-weight: %@; ", ip? @"bold" : @"normal"];
+			SpanAppendFormat(ex, "font-weight: %s; ", ip? "bold" : "normal");
 			break;
 		case tag_i:
 			iv();
-			[sty appendFormat:@"font-style: %@; ", ip? @"italic" : @"normal"];
+			SpanAppendFormat(ex, "font-style: %s; ", ip? "italic" : "normal");
 			break;
 		case tag_u:
 			iv();
-			[sty appendFormat:@"text-decoration: %@; ", ip? @"underline" : @"none"];
+			SpanAppendFormat(ex, "text-decoration: %s; ", ip? "underline" : "none");
 			break;
 		case tag_s:
 			iv();
-			[sty appendFormat:@"text-decoration: %@; ", ip? @"line-through" : @"none"];
+			SpanAppendFormat(ex, "text-decoration: %s; ", ip? "line-through" : "none");
 			break;
 		case tag_fn:
 			sv();
-			[sty appendFormat:@"font-family: %@; ", sp];
+			[ex->css appendBytes:"font-family: " length:13];
+			[ex->css appendData:[sp dataUsingEncoding:NSUTF8StringEncoding]];
+			[ex->css appendBytes:"; " length:2];
 			break;
 		case tag_fs:
 			fv();
 			//this is wrong, see GetWinFontSizeScale()
-			[sty appendFormat:@"font-size: %fpt; ", fp * (72./96.)];
+			SpanAppendFormat(ex, "font-size: %fpt; ", fp * (72./96.));
 			break;
 		case tag_1c:
 			cv();
-			[sty appendFormat:@"color: #%0.9X; ", ip]; 
+			SpanAppendFormat(ex, "color: #%0.9X; ", ip); 
 			break;
 		case tag_4c:
 			cv();
-			[sty appendFormat:@"text-shadow: #%0.9X %fpx %fpx 0; ", ip, div->styleLine->shadowDist*2., div->styleLine->shadowDist*2.];
+			SpanAppendFormat(ex, "text-shadow: #%0.9X %fpx %fpx 0; ", ip, div->styleLine->shadowDist*2., div->styleLine->shadowDist*2.);
 			break;
 		default:
 			NSLog(@"unimplemented tag type %d",tag);
@@ -211,37 +375,49 @@ NSString *htmlfilter(NSString *s)
 			continue;
 		}
 		NSInteger spancount = [div->spans count], spans = 1, close_div = 0;
+		NSUInteger textLength = [div->text length];
+		NSData *classTag = div->styleLine->extra;
 		
 		if (div->positioned) {
-			[html appendFormat:@"<div style=\"top: %fpx; left: %fpx; position: absolute\">", div->posY, div->posX];
+			HTMLWriteFormat(self, "<div style=\"top: %fpx; left: %fpx; position: absolute\">", div->posY, div->posX);
 			close_div = 1;
 		}
-				
-		[html appendFormat:@"<span class=\"%@\">", EscapeCSSIdentifier(div->styleLine->name)];
+		
+		if (classTag)
+			HTMLWrite(self, [classTag bytes], [classTag length]);
+		else {
+			HTMLWriteLiteral(self, "<span class=\"");
+			HTMLWriteNSString(self, EscapeCSSIdentifier(div->styleLine->name));
+			HTMLWriteLiteral(self, "\">");
+		}
 		
 		for (NSInteger j = 0; j < spancount; j++) {
 			SubRenderSpan *span = [div->spans objectAtIndex:j];
 			SubHTMLSpanExtra *ex = span.extra;
-			NSMutableString *str = ex->str;
+			NSData *css = ex->css;
+			NSUInteger end = (j == (spancount-1)) ? textLength : ((SubRenderSpan*)[div->spans objectAtIndex:j+1])->offset;
 			
-			if ([str length]) {[html appendFormat:@"<span style=\"%@\">",str]; spans++;}
-			[html appendString:htmlfilter([div->text substringWithRange:NSMakeRange(span->offset, ((j == (spancount-1)) ? [div->text length] : ((SubRenderSpan*)[div->spans objectAtIndex:j+1])->offset) - span->offset)])];
+			if ([css length]) {
+				HTMLWriteLiteral(self, "<span style=\"");
+				HTMLWrite(self, [css bytes], [css length]);
+				HTMLWriteLiteral(self, "\">");
+				spans++;
+			}
+			HTMLWriteString(self, div->text, NSMakeRange(span->offset, end - span->offset), YES);
 		}
 		
-		while (spans--) [html appendString:@"</span>"]; 
-		if (close_div) [html appendString:@"</div>"];
-		[html appendString:@"\n"]; 
+		while (spans--) HTMLWriteLiteral(self, "</span>");
+		if (close_div) HTMLWriteLiteral(self, "</div>");
+		HTMLWriteLiteral(self, "\n");
 	}
 }
 
 -(void)addSub:(SubLine*)sl
 {	
-	unichar *ubuf = malloc(sizeof(unichar) * [sl.line length]);
 	NSArray *divs = SubParsePacket(sl.line, sc, self);
-	free(ubuf);
 	NSMutableArray *top = [NSMutableArray array], *bot = [NSMutableArray array], *abs = [NSMutableArray array];
 	
-	[html appendString:@"<div class=\"screen\">\n"];
+	HTMLWriteLiteral(self, "<div class=\"screen\">\n");
 
 	for (SubRenderDiv *div in divs) {
 		
@@ -254,27 +430,28 @@ NSString *htmlfilter(NSString *s)
 	}
 	
 	if ([top count]) {
-		[html appendString:@"<div class=\"top\">\n"];
+		HTMLWriteLiteral(self, "<div class=\"top\">\n");
 		[self htmlifyDivArray:top];
-		[html appendString:@"</div>\n"];
+		HTMLWriteLiteral(self, "</div>\n");
 	}
 	
 	if ([bot count]) {
-		[html appendString:@"<div class=\"bottom\">\n"];
+		HTMLWriteLiteral(self, "<div class=\"bottom\">\n");
 		[self htmlifyDivArray:bot];
-		[html appendString:@"</div>\n"];
+		HTMLWriteLiteral(self, "</div>\n");
 	}
 	
 	[self htmlifyDivArray:abs];
 	
-	[html appendString:@"</div>\n"];
+	HTMLWriteLiteral(self, "</div>\n");
 
-	[html appendString:@"<br>\n"];
+	HTMLWriteLiteral(self, "<br>\n");
 }
 
 -(void)endOfFile
 {
-	[html appendString:@"</body></html>\n"];
+	HTMLWriteLiteral(self, "</body></html>\n");
+	[self flush];
 }
 @end
 
@@ -285,7 +462,7 @@ int main(int argc, char *argv[])
 	
 	@autoreleasepool {
 		SubContext *sc; SubSerializer *ss = [[SubSerializer alloc] init];
-		SubHTMLExporter *htm = [[SubHTMLExporter alloc] init];
+		SubHTMLExporter *htm = [[SubHTMLExporter alloc] initWithFile:stdout];
 		
 		//start of lameness
 		//it should only have to call subparsessafile here, or something
@@ -309,8 +486,6 @@ int main(int argc, char *argv[])
 		}
 		
 		[htm endOfFile];
-		
-		puts([htm.html UTF8String]);
 	}
 	
 	return 0;
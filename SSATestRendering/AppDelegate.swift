@@ -101,6 +101,9 @@ func createPDFWithATSUI(fromFile inFile: String, toDirectory dir: URL) {
 class AppDelegate: NSObject, NSApplicationDelegate {
 
 	func applicationDidFinishLaunching(_ aNotification: Notification) {
+		if UserDefaults.standard.bool(forKey: "RunRenderingChecks") {
+			exit(runRenderingChecks())
+		}
 		createPDF(fromFile: "/Users/cwbetts/mm.ssa", toDirectory: URL(fileURLWithPath: "/Users/cwbetts/Movies"))
 //		createPDFWithATSUI(fromFile: "/Users/cwbetts/mm.ssa", toDirectory: URL(fileURLWithPath: "/Users/cwbetts/Movies"))
 	}
@@ -0,0 +1,173 @@
+//
+//  RenderingChecks.swift
+//  SSATestRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+import Foundation
+import CoreGraphics
+import SSAMacRendering
+
+// Checks of SubCoreTextRenderer that need real fonts, so they run in the app instead of a unit test.
+// Launch it with `-RunRenderingChecks YES`; it prints each failure and exits with how many there were.
+
+private let checkHeader = """
+[Script Info]
+ScriptType: v4.00+
+PlayResX: 640
+PlayResY: 360
+
+[V4+ Styles]
+Format: Name, Fontname, Fontsize, PrimaryColour, SecondaryColour, OutlineColour, BackColour, Bold, Italic, Underline, StrikeOut, ScaleX, ScaleY, Spacing, Angle, BorderStyle, Outline, Shadow, Alignment, MarginL, MarginR, MarginV, Encoding
+Style: Default,Helvetica,32,&H00FFFFFF,&H000000FF,&H00000000,&H80000000,0,0,0,0,100,100,0,0,1,2,1,2,20,20,20,1
+Style: Top,Helvetica,24,&H0000FFFF,&H000000FF,&H00000000,&H80000000,-1,0,0,0,100,100,0,0,1,1,0,8,20,20,20,1
+
+"""
+
+private let cachedLayoutPackets = [
+	"0,0,Default,,0,0,0,,A line long enough to wrap at the script's own resolution, so the breaks have to match as well as the glyphs.",
+	"0,0,Default,,0,0,0,,{\\b1}Bold{\\b0} and {\\i1}italic{\\i0}\\Non two lines\n1,0,Top,,0,0,0,,And one more at the top",
+]
+
+private let parallelLayoutPacket = [
+	"0,0,Default,,0,0,0,,First line at the bottom",
+	"1,0,Default,,0,0,0,,Second line, pushed up by the first",
+	"2,0,Top,,0,0,0,,A line at the top",
+	"3,0,Top,,0,0,0,,{\\an7\\pos(40,120)}Positioned",
+	"4,1,Default,,0,0,0,,{\\fs48\\c&H00FF00&}Bigger and green",
+	"5,0,Default,,0,0,0,,A long line that has to wrap onto two, since it is too wide for the margins",
+].joined(separator: "\n")
+
+/// The images of a packet flattened into one coverage mask the size of the output.
+private struct Coverage {
+	let width: Int
+	let height: Int
+	private(set) var pixels: [UInt8]
+
+	init(_ list: SubRenderImageList, width: Int, height: Int) {
+		self.width = width
+		self.height = height
+		pixels = [UInt8](repeating: 0, count: width * height)
+		guard let images = list.images else {
+			return
+		}
+		for i in 0 ..< list.count {
+			let image = images[i]
+			let opacity = Int(image.color & 0xFF)
+			for row in 0 ..< Int(image.height) {
+				let src = image.alpha + row * image.stride
+				let dst = (Int(image.y) + row) * width + Int(image.x)
+				for col in 0 ..< Int(image.width) {
+					pixels[dst + col] = max(pixels[dst + col], UInt8(Int(src[col]) * opacity / 255))
+				}
+			}
+		}
+	}
+
+	/// The smallest rectangle holding every covered pixel, or `nil` if nothing was drawn.
+	var inkBounds: (minX: Int, minY: Int, maxX: Int, maxY: Int)? {
+		var bounds: (minX: Int, minY: Int, maxX: Int, maxY: Int)? = nil
+		for y in 0 ..< height {
+			for x in 0 ..< width where pixels[y * width + x] != 0 {
+				if let b = bounds {
+					bounds = (min(b.minX, x), b.minY, max(b.maxX, x), y)
+				} else {
+					bounds = (x, y, x, y)
+				}
+			}
+		}
+		return bounds
+	}
+
+	var total: Int {
+		return pixels.reduce(0) { $0 + Int($1) }
+	}
+}
+
+/// Draws `packet` at `size` through `shared`, which was created at another size and keeps its layout,
+/// and through a renderer created at `size`, then checks they agree as the SubCoreTextRenderer docs promise.
+private func checkCachedLayout(_ packet: String, shared: SubCoreTextRenderer, size: CGSize) -> Bool {
+	let name = "cached layout at \(Int(size.width))x\(Int(size.height))"
+	guard let own = SubCoreTextRenderer(scriptType: .SSA, header: checkHeader, videoWidth: size.width, videoHeight: size.height) else {
+		print("FAIL \(name): couldn't create a renderer")
+		return false
+	}
+	let width = Int(size.width), height = Int(size.height)
+	let cached = Coverage(shared.images(packet: packet, size: size, karaokeTime: -1), width: width, height: height)
+	let fresh = Coverage(own.images(packet: packet, size: size, karaokeTime: -1), width: width, height: height)
+	guard let a = cached.inkBounds, let b = fresh.inkBounds else {
+		print("FAIL \(name): nothing was drawn")
+		return false
+	}
+
+	let toleranceX = max(2, Int((Double(width) * 0.01).rounded(.up)))
+	let toleranceY = max(2, Int((Double(height) * 0.01).rounded(.up)))
+	let offX = max(abs(a.minX - b.minX), abs(a.maxX - b.maxX))
+	let offY = max(abs(a.minY - b.minY), abs(a.maxY - b.maxY))
+	let coverageOff = Double(abs(cached.total - fresh.total)) / Double(fresh.total)
+
+	guard offX <= toleranceX, offY <= toleranceY, coverageOff <= 0.05 else {
+		print("FAIL \(name): ink is \(offX),\(offY) px off (allowed \(toleranceX),\(toleranceY)), coverage \(Int(coverageOff * 100))% off (allowed 5%)")
+		return false
+	}
+	return true
+}
+
+/// Draws a packet with enough lines to be laid out on several threads, then again with a renderer that
+/// lays everything out on the calling thread, and checks that both give exactly the same images.
+private func checkParallelLayout(size: CGSize) -> Bool {
+	let name = "parallel layout at \(Int(size.width))x\(Int(size.height))"
+	guard let parallel = SubCoreTextRenderer(scriptType: .SSA, header: checkHeader, videoWidth: size.width, videoHeight: size.height),
+		let sequential = SubCoreTextRenderer(scriptType: .SSA, header: checkHeader, videoWidth: size.width, videoHeight: size.height) else {
+			print("FAIL \(name): couldn't create a renderer")
+			return false
+	}
+	parallel.parallelLayoutThreshold = 1
+	sequential.parallelLayoutThreshold = .max
+
+	let a = parallel.images(packet: parallelLayoutPacket, size: size, karaokeTime: -1)
+	let b = sequential.images(packet: parallelLayoutPacket, size: size, karaokeTime: -1)
+	guard a.count == b.count, a.count > 0, let imagesA = a.images, let imagesB = b.images else {
+		print("FAIL \(name): \(a.count) images laid out in parallel, \(b.count) in sequence")
+		return false
+	}
+
+	for i in 0 ..< a.count {
+		let ia = imagesA[i], ib = imagesB[i]
+		guard ia.x == ib.x, ia.y == ib.y, ia.width == ib.width, ia.height == ib.height, ia.color == ib.color, ia.kind == ib.kind else {
+			print("FAIL \(name): image \(i) is at \(ia.x),\(ia.y) \(ia.width)x\(ia.height) in parallel, \(ib.x),\(ib.y) \(ib.width)x\(ib.height) in sequence")
+			return false
+		}
+		for row in 0 ..< Int(ia.height) where memcmp(ia.alpha + row * ia.stride, ib.alpha + row * ib.stride, Int(ia.width)) != 0 {
+			print("FAIL \(name): image \(i) has different ink in row \(row)")
+			return false
+		}
+	}
+	return true
+}
+
+/// Runs every check. Returns the number that failed.
+func runRenderingChecks() -> Int32 {
+	var failures: Int32 = 0
+
+	// one renderer at the script's size draws every packet at a larger and a smaller size, reusing its layouts
+	if let shared = SubCoreTextRenderer(scriptType: .SSA, header: checkHeader, videoWidth: 640, videoHeight: 360) {
+		for packet in cachedLayoutPackets {
+			for size in [CGSize(width: 1280, height: 720), CGSize(width: 320, height: 180)] where !checkCachedLayout(packet, shared: shared, size: size) {
+				failures += 1
+			}
+		}
+	} else {
+		print("FAIL cached layout: couldn't create a renderer")
+		failures += 1
+	}
+
+	for size in [CGSize(width: 640, height: 360), CGSize(width: 1920, height: 1080)] where !checkParallelLayout(size: size) {
+		failures += 1
+	}
+
+	print(failures == 0 ? "All rendering checks passed" : "\(failures) rendering checks failed")
+	return failures
+}
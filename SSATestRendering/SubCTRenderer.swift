@@ -940,12 +940,27 @@ SetATSUStyleOther(style, kATSUAfterWithStreamShiftTag, sizeof(Fixed), &tracking)
 			span.extra = SpanExtra(style: sstyle, colorSpace: CGColorSpace(name: CGColorSpace.sRGB)!)
 
 		case .tag_be:
-			bv()
+			fv()
 			if !isFirstSpan {
 				div.renderComplexity |= renderMultipleParts //FIXME: blur edges
 			}
 			
-			spanEx.blurEdges = bval
+			spanEx.blurEdges = fval > 0
+
+		case .tag_blur:
+			fv()
+			if !isFirstSpan {
+				div.renderComplexity |= renderMultipleParts //FIXME: gaussian blur
+			}
+			
+			spanEx.blurEdges = fval > 0
+
+		case .tag_xbord, .tag_ybord:
+			fv()
+			if !isFirstSpan {
+				div.renderComplexity |= renderMultipleParts
+			}
+			spanEx.outlineRadius = CGFloat(max(fval, 0)) //FIXME: outlines are stroked the same width both ways
 
 		case .tag_p:
 			fv()
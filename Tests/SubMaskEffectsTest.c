@@ -0,0 +1,147 @@
+//
+//  SubMaskEffectsTest.c
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+// Runs the mask effects on fixed pseudo-random masks and checks the results against known hashes.
+// "make check" builds it once per instruction set the kernels have a path for, so every path has
+// to give the same bytes as the plain C one. Pass -print to show the hashes instead.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "SubMaskEffects.h"
+
+static uint32_t seed;
+
+static uint32_t NextRandom(void)
+{
+	seed = seed * 1664525 + 1013904223;
+	return seed >> 16;
+}
+
+//! Blobs of solid ink with soft edges, like glyph masks, and an empty border for the effects to grow into.
+static uint8_t *MakeMask(int width, int height, ptrdiff_t stride, int padding)
+{
+	uint8_t *mask = calloc((size_t)stride * height, 1);
+
+	seed = (uint32_t)(width * 31 + height);
+	for (int y = padding; y < height - padding; y++) {
+		for (int x = padding; x < width - padding; x++) {
+			uint32_t r = NextRandom() & 0xFF;
+			mask[y * stride + x] = r < 96 ? 0 : r > 160 ? 255 : (uint8_t)r;
+		}
+	}
+
+	return mask;
+}
+
+//! FNV-1a of the visible part of each row. The bytes past \c width must be left alone, so they're checked separately.
+static uint64_t HashMask(const uint8_t *mask, int width, int height, ptrdiff_t stride)
+{
+	uint64_t h = 14695981039346656037ULL;
+
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			h ^= mask[y * stride + x];
+			h *= 1099511628211ULL;
+		}
+	}
+
+	return h;
+}
+
+static int CheckStride(const char *name, const uint8_t *mask, int width, int height, ptrdiff_t stride)
+{
+	for (int y = 0; y < height; y++) {
+		for (ptrdiff_t x = width; x < stride; x++) {
+			if (mask[y * stride + x] != 0) {
+				printf("FAIL %s: wrote past the width at %d,%d\n", name, (int)x, y);
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int failures;
+static int printHashes;
+
+static void Check(const char *name, const uint8_t *mask, int width, int height, ptrdiff_t stride, uint64_t expected)
+{
+	uint64_t h = HashMask(mask, width, height, stride);
+
+	failures += CheckStride(name, mask, width, height, stride);
+
+	if (printHashes) {
+		printf("%-24s 0x%016llxULL\n", name, (unsigned long long)h);
+	} else if (h != expected) {
+		printf("FAIL %s: hash 0x%016llx, expected 0x%016llx\n", name, (unsigned long long)h, (unsigned long long)expected);
+		failures++;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	// odd sizes so the vector loops always leave a tail for the plain C one
+	const int width = 77, height = 45, padding = 12;
+	const ptrdiff_t stride = 96;
+
+	printHashes = argc > 1 && !strcmp(argv[1], "-print");
+
+	{
+		uint8_t *m = MakeMask(width, height, stride, padding);
+		Check("source", m, width, height, stride, 0x13741943d1238f75ULL);
+		free(m);
+	}
+	{
+		uint8_t *m = MakeMask(width, height, stride, padding);
+		SubMaskBlurEdges(m, width, height, stride, 1);
+		Check("be 1", m, width, height, stride, 0xa858710d34517655ULL);
+		SubMaskBlurEdges(m, width, height, stride, 3);
+		Check("be 4", m, width, height, stride, 0x1e836e908c02e630ULL);
+		free(m);
+	}
+	{
+		uint8_t *m = MakeMask(width, height, stride, padding);
+		SubMaskBoxBlur(m, width, height, stride, 3, 1);
+		Check("box 3x1", m, width, height, stride, 0xea6b0c3d2cf7a5dbULL);
+		SubMaskBoxBlur(m, width, height, stride, 0, 5);
+		Check("box 0x5", m, width, height, stride, 0x475d9aa672593e68ULL);
+		free(m);
+	}
+	{
+		uint8_t *m = MakeMask(width, height, stride, padding);
+		SubMaskGaussianBlur(m, width, height, stride, 2.5);
+		Check("blur 2.5", m, width, height, stride, 0x97314960674932ddULL);
+		free(m);
+	}
+	{
+		uint8_t *src = MakeMask(width, height, stride, padding);
+		uint8_t *dst = calloc((size_t)stride * height, 1);
+		SubMaskDilate(src, dst, width, height, stride, 3, 3);
+		Check("bord 3", dst, width, height, stride, 0xa942229fd9f70e39ULL);
+		memset(dst, 0, (size_t)stride * height);
+		SubMaskDilate(src, dst, width, height, stride, 5, 1.5);
+		Check("xbord 5 ybord 1.5", dst, width, height, stride, 0xff323e0573184eadULL);
+		free(src);
+		free(dst);
+	}
+	{
+		SubMaskEffectParams params = {.bordX = 2, .bordY = 2, .blur = 1.5, .blurEdges = 1};
+		uint8_t *fill = MakeMask(width, height, stride, padding);
+		uint8_t *outline = calloc((size_t)stride * height, 1);
+		SubMaskApplyEffects(&params, fill, outline, width, height, stride);
+		Check("effects fill", fill, width, height, stride, 0x13741943d1238f75ULL);
+		Check("effects outline", outline, width, height, stride, 0x5317ca922c65d9b5ULL);
+		free(fill);
+		free(outline);
+	}
+
+	if (!printHashes) printf("%s\n", failures ? "SubMaskEffects FAILED" : "SubMaskEffects passed");
+	return failures ? 1 : 0;
+}
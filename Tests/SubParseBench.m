@@ -0,0 +1,241 @@
+//
+//  SubParseBench.m
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+// Times the override tag number parsing in SubUtilities against the string based code it replaced,
+// and counts the heap allocations each tag costs. Exits with 1 if the two disagree on any result.
+// Build and run with "make bench" in this directory after building SSAMacRendering.framework.
+
+#import <Foundation/Foundation.h>
+#import <SSAMacRendering/SubUtilities.h>
+#include <malloc/malloc.h>
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+
+#define kIterations 200000
+
+#pragma mark Allocation counting
+
+static unsigned long allocations;
+
+typedef struct CountedZone {
+	malloc_zone_t *zone;
+	void *(*malloc)(malloc_zone_t *zone, size_t size);
+	void *(*calloc)(malloc_zone_t *zone, size_t num, size_t size);
+	void *(*realloc)(malloc_zone_t *zone, void *ptr, size_t size);
+} CountedZone;
+
+static CountedZone countedZones[16];
+static unsigned countedZoneCount;
+
+static CountedZone *FindCountedZone(malloc_zone_t *zone)
+{
+	for (unsigned i = 0; i < countedZoneCount; i++)
+		if (countedZones[i].zone == zone) return &countedZones[i];
+	abort();
+}
+
+static void *CountingMalloc(malloc_zone_t *zone, size_t size)
+{
+	allocations++;
+	return FindCountedZone(zone)->malloc(zone, size);
+}
+
+static void *CountingCalloc(malloc_zone_t *zone, size_t num, size_t size)
+{
+	allocations++;
+	return FindCountedZone(zone)->calloc(zone, num, size);
+}
+
+static void *CountingRealloc(malloc_zone_t *zone, void *ptr, size_t size)
+{
+	allocations++;
+	return FindCountedZone(zone)->realloc(zone, ptr, size);
+}
+
+//! Wraps the allocation functions of every malloc zone. Returns \c NO if allocations still aren't seen.
+static BOOL StartCountingAllocations(void)
+{
+	vm_address_t *zones;
+	unsigned zoneCount;
+
+	if (malloc_get_all_zones(mach_task_self(), NULL, &zones, &zoneCount) != KERN_SUCCESS) return NO;
+
+	for (unsigned i = 0; i < zoneCount && countedZoneCount < sizeof(countedZones) / sizeof(countedZones[0]); i++) {
+		malloc_zone_t *zone = (malloc_zone_t*)zones[i];
+		CountedZone *c = &countedZones[countedZoneCount++];
+
+		c->zone = zone;
+		c->malloc = zone->malloc;
+		c->calloc = zone->calloc;
+		c->realloc = zone->realloc;
+
+		// zones are read-only after malloc is initialized
+		vm_protect(mach_task_self(), (vm_address_t)zone, sizeof(malloc_zone_t), 0, VM_PROT_READ | VM_PROT_WRITE);
+		zone->malloc = CountingMalloc;
+		zone->calloc = CountingCalloc;
+		zone->realloc = CountingRealloc;
+	}
+
+	unsigned long before = allocations;
+	free(malloc(64));
+	return allocations > before;
+}
+
+#pragma mark Tags
+
+typedef enum {
+	kTagInt,
+	kTagFloat,
+	kTagHex,
+	kTagPos
+} TagKind;
+
+typedef struct BenchTag {
+	TagKind kind;
+	const char *param;	//!< as the tag machine hands it to the action, from parambegin to p
+} BenchTag;
+
+// a mix of what shows up in typesetting-heavy scripts
+static const BenchTag tags[] = {
+	{kTagInt, "1"}, {kTagInt, "0"}, {kTagInt, "-250"}, {kTagInt, "1200"},
+	{kTagFloat, "2"}, {kTagFloat, "45.5"}, {kTagFloat, "-12.25"}, {kTagFloat, "100"},
+	{kTagHex, "00FFFFFF"}, {kTagHex, "80"}, {kTagHex, "3C2A1B"},
+	{kTagPos, "(320,240)"}, {kTagPos, "(12.5,-7.25)"}, {kTagPos, "(0,0,640,360,0,500)"},
+};
+#define kTagCount (sizeof(tags) / sizeof(tags[0]))
+
+static const char *const tagKindNames[] = {"int", "float", "hex", "pos"};
+
+typedef struct TagResult {
+	double a, b;
+} TagResult;
+
+//! What the tag actions did before, going through \c psend().
+static TagResult ParseTagWithStrings(TagKind kind, const unichar *param, NSUInteger length)
+{
+	TagResult r = {0, 0};
+
+	@autoreleasepool {
+		NSString *s = [[NSString alloc] initWithCharacters:param length:length];
+
+		switch (kind) {
+			case kTagInt:
+				r.a = [s intValue];
+				break;
+			case kTagFloat:
+				r.a = [s floatValue];
+				break;
+			case kTagHex:
+				r.a = (int)strtoul([s UTF8String], NULL, 16);
+				break;
+			case kTagPos:
+				sscanf([s UTF8String], "(%lf,%lf", &r.a, &r.b);
+				break;
+		}
+	}
+
+	return r;
+}
+
+//! What the tag actions do now.
+static TagResult ParseTagWithCharacters(TagKind kind, const unichar *param, NSUInteger length)
+{
+	TagResult r = {0, 0};
+
+	switch (kind) {
+		case kTagInt:
+			r.a = SubParseIntCharacters(param, length);
+			break;
+		case kTagFloat:
+			r.a = SubParseFloatCharacters(param, length);
+			break;
+		case kTagHex:
+			r.a = (int)SubParseHexCharacters(param, length);
+			break;
+		case kTagPos:
+			SubParseCoordinateCharacters(param, length, &r.a, &r.b);
+			break;
+	}
+
+	return r;
+}
+
+typedef TagResult (*TagParser)(TagKind kind, const unichar *param, NSUInteger length);
+
+typedef struct BenchResult {
+	double nsPerTag;
+	double allocationsPerTag;
+} BenchResult;
+
+static BenchResult RunBench(TagParser parse, TagKind kind, unichar params[][32], const NSUInteger *lengths)
+{
+	mach_timebase_info_data_t timebase;
+	unsigned long parsed = 0, startAllocations;
+	uint64_t start;
+	volatile double sink = 0;
+
+	mach_timebase_info(&timebase);
+	startAllocations = allocations;
+	start = mach_absolute_time();
+
+	for (int i = 0; i < kIterations; i++) {
+		for (size_t t = 0; t < kTagCount; t++) {
+			if (tags[t].kind != kind) continue;
+			TagResult r = parse(kind, params[t], lengths[t]);
+			sink += r.a + r.b;
+			parsed++;
+		}
+	}
+
+	uint64_t elapsed = (mach_absolute_time() - start) * timebase.numer / timebase.denom;
+	return (BenchResult){(double)elapsed / parsed, (double)(allocations - startAllocations) / parsed};
+}
+
+int main(int argc, const char * argv[])
+{
+	unichar params[kTagCount][32];
+	NSUInteger lengths[kTagCount];
+	int failures = 0;
+
+	for (size_t t = 0; t < kTagCount; t++) {
+		lengths[t] = strlen(tags[t].param);
+		for (NSUInteger i = 0; i < lengths[t]; i++) params[t][i] = tags[t].param[i];
+	}
+
+	// both paths have to agree before their speed means anything
+	for (size_t t = 0; t < kTagCount; t++) {
+		TagResult old = ParseTagWithStrings(tags[t].kind, params[t], lengths[t]);
+		TagResult cur = ParseTagWithCharacters(tags[t].kind, params[t], lengths[t]);
+
+		if (old.a != cur.a || old.b != cur.b) {
+			printf("MISMATCH %s \"%s\": strings %g,%g characters %g,%g\n", tagKindNames[tags[t].kind], tags[t].param, old.a, old.b, cur.a, cur.b);
+			failures++;
+		}
+	}
+
+	BOOL counting = StartCountingAllocations();
+	if (!counting) printf("Allocations can't be counted with this malloc; only times are shown.\n");
+
+	printf("%-6s %14s %14s %14s %14s\n", "tag", "strings ns", "allocs", "characters ns", "allocs");
+	for (TagKind kind = kTagInt; kind <= kTagPos; kind++) {
+		BenchResult old = RunBench(ParseTagWithStrings, kind, params, lengths);
+		BenchResult cur = RunBench(ParseTagWithCharacters, kind, params, lengths);
+
+		if (counting)
+			printf("%-6s %14.1f %14.2f %14.1f %14.2f\n", tagKindNames[kind], old.nsPerTag, old.allocationsPerTag, cur.nsPerTag, cur.allocationsPerTag);
+		else
+			printf("%-6s %14.1f %14s %14.1f %14s\n", tagKindNames[kind], old.nsPerTag, "-", cur.nsPerTag, "-");
+
+		if (counting && cur.allocationsPerTag != 0) {
+			printf("FAIL %s tags allocate\n", tagKindNames[kind]);
+			failures++;
+		}
+	}
+
+	return failures ? 1 : 0;
+}
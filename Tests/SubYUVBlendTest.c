@@ -0,0 +1,174 @@
+//
+//  SubYUVBlendTest.c
+//  SSAMacRendering
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+// Blends fixed pseudo-random subtitle images into fixed frames and checks the planes against known hashes.
+// "make check" builds it once per instruction set the kernels have a path for, so every path has
+// to give the same bytes as the plain C one. Pass -print to show the hashes instead.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "SubYUVBlend.h"
+
+static uint32_t seed;
+
+static uint32_t NextRandom(void)
+{
+	seed = seed * 1664525 + 1013904223;
+	return seed >> 16;
+}
+
+//! Premultiplied RGBA with transparent runs, solid ink and soft edges, like a rendered line of text.
+static uint8_t *MakeImage(int width, int height, ptrdiff_t stride)
+{
+	uint8_t *rgba = calloc((size_t)stride * height, 1);
+
+	seed = (uint32_t)(width * 131 + height);
+	for (int y = 0; y < height; y++) {
+		uint8_t *px = rgba + y * stride;
+
+		for (int x = 0; x < width; x++, px += 4) {
+			uint32_t r = NextRandom();
+			unsigned a = (r & 0xFF) < 100 ? 0 : (r & 0xFF) > 180 ? 255 : r & 0xFF;
+
+			// whole transparent spans, so the skipping is exercised too
+			if ((x / 9 + y / 5) % 4 == 0) a = 0;
+
+			px[0] = (uint8_t)((r >> 8 & 0xFF) * a / 255);
+			px[1] = (uint8_t)((NextRandom() & 0xFF) * a / 255);
+			px[2] = (uint8_t)((NextRandom() & 0xFF) * a / 255);
+			px[3] = (uint8_t)a;
+		}
+	}
+
+	return rgba;
+}
+
+//! A frame filled with a fixed gradient, with its own padding past the width of each plane.
+static void MakeFrame(SubYUVFrame *frame, SubYUVFormat format, SubYUVMatrix matrix, bool fullRange, int width, int height)
+{
+	int chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+	int planeCount = format == kSubYUV420P ? 3 : 2;
+
+	memset(frame, 0, sizeof(*frame));
+	frame->format = format;
+	frame->matrix = matrix;
+	frame->fullRange = fullRange;
+	frame->width = width;
+	frame->height = height;
+
+	frame->strides[0] = width + 13;
+	frame->strides[1] = frame->strides[2] = (format == kSubYUV420P ? chromaWidth : chromaWidth * 2) + 7;
+
+	for (int p = 0; p < planeCount; p++) {
+		int rows = p ? chromaHeight : height;
+
+		frame->planes[p] = malloc((size_t)frame->strides[p] * rows);
+		for (int y = 0; y < rows; y++)
+			for (ptrdiff_t x = 0; x < frame->strides[p]; x++)
+				frame->planes[p][y * frame->strides[p] + x] = (uint8_t)(16 + (x * 3 + y * 5 + p * 40) % 220);
+	}
+}
+
+static void FreeFrame(SubYUVFrame *frame)
+{
+	for (int p = 0; p < 3; p++) free(frame->planes[p]);
+}
+
+//! FNV-1a of every plane, padding included, since the blend mustn't touch anything outside the image.
+static uint64_t HashFrame(const SubYUVFrame *frame)
+{
+	uint64_t h = 14695981039346656037ULL;
+	int planeCount = frame->format == kSubYUV420P ? 3 : 2;
+
+	for (int p = 0; p < planeCount; p++) {
+		int rows = p ? (frame->height + 1) / 2 : frame->height;
+		size_t size = (size_t)frame->strides[p] * rows;
+
+		for (size_t i = 0; i < size; i++) {
+			h ^= frame->planes[p][i];
+			h *= 1099511628211ULL;
+		}
+	}
+
+	return h;
+}
+
+static int failures;
+static int printHashes;
+
+static void Check(const char *name, uint64_t h, uint64_t expected)
+{
+	if (printHashes) {
+		printf("%-28s 0x%016llxULL\n", name, (unsigned long long)h);
+	} else if (h != expected) {
+		printf("FAIL %s: hash 0x%016llx, expected 0x%016llx\n", name, (unsigned long long)h, (unsigned long long)expected);
+		failures++;
+	}
+}
+
+typedef struct BlendCase {
+	const char *name;
+	SubYUVFormat format;
+	SubYUVMatrix matrix;
+	bool fullRange;
+	int x, y;		//!< where the image goes, partly off the frame for some
+	uint64_t hash;
+} BlendCase;
+
+static const BlendCase blendCases[] = {
+	{"420p 601 video", kSubYUV420P, kSubYUVMatrixBT601, false, 5, 3, 0xa5c8b98f98128cc8ULL},
+	{"420p 709 full", kSubYUV420P, kSubYUVMatrixBT709, true, 4, 8, 0x1ff6c6b16cd750aeULL},
+	{"nv12 601 video", kSubYUVNV12, kSubYUVMatrixBT601, false, 7, 2, 0x99dde41fddf49d03ULL},
+	{"nv12 709 video clipped", kSubYUVNV12, kSubYUVMatrixBT709, false, -11, -6, 0x7bf29ba0b7b64679ULL},
+	{"420p 601 full clipped", kSubYUV420P, kSubYUVMatrixBT601, true, 40, 25, 0xca8fda8e06456973ULL},
+};
+
+int main(int argc, char *argv[])
+{
+	// odd sizes so the vector loops always leave a tail for the plain C one
+	const int frameWidth = 87, frameHeight = 49;
+	const int imageWidth = 61, imageHeight = 33;
+	const ptrdiff_t imageStride = imageWidth * 4 + 12;
+	uint8_t *image;
+
+	printHashes = argc > 1 && !strcmp(argv[1], "-print");
+	image = MakeImage(imageWidth, imageHeight, imageStride);
+
+	for (size_t i = 0; i < sizeof(blendCases) / sizeof(blendCases[0]); i++) {
+		const BlendCase *c = &blendCases[i];
+		SubYUVFrame frame;
+
+		MakeFrame(&frame, c->format, c->matrix, c->fullRange, frameWidth, frameHeight);
+		SubYUVBlendRGBA(&frame, image, imageStride, c->x, c->y, imageWidth, imageHeight);
+		Check(c->name, HashFrame(&frame), c->hash);
+		FreeFrame(&frame);
+	}
+
+	{
+		int x, y, w, h;
+		uint8_t *sparse = calloc((size_t)imageStride * imageHeight, 1);
+
+		if (SubYUVCoverageRect(sparse, imageStride, imageWidth, imageHeight, &x, &y, &w, &h)) {
+			printf("FAIL coverage: found ink in a transparent image\n");
+			failures++;
+		}
+
+		sparse[7 * imageStride + 19 * 4 + 3] = 1;
+		sparse[30 * imageStride + 42 * 4 + 3] = 255;
+		if (!SubYUVCoverageRect(sparse, imageStride, imageWidth, imageHeight, &x, &y, &w, &h) || x != 19 || y != 7 || w != 24 || h != 24) {
+			printf("FAIL coverage: expected 19,7 24x24\n");
+			failures++;
+		}
+		free(sparse);
+	}
+
+	free(image);
+	if (!printHashes) printf("%s\n", failures ? "SubYUVBlend FAILED" : "SubYUVBlend passed");
+	return failures ? 1 : 0;
+}
@@ -16,6 +16,41 @@ struct StderrOutputStream: TextOutputStream {
 }
 var errStream = StderrOutputStream()
 
+/// Collects output in a fixed-size buffer and writes it to `file` whenever it fills,
+/// so memory use doesn't grow with the length of the script.
+struct BufferedFileOutputStream: TextOutputStream {
+	private let file: UnsafeMutablePointer<FILE>
+	private let capacity: Int
+	private var buffer = [UInt8]()
+	
+	init(file: UnsafeMutablePointer<FILE>, capacity: Int = 16384) {
+		self.file = file
+		self.capacity = capacity
+		buffer.reserveCapacity(capacity)
+	}
+	
+	mutating func write(_ string: String) {
+		var string = string
+		string.withUTF8 { bytes in
+			if buffer.count + bytes.count > capacity {
+				flush()
+			}
+			if bytes.count > capacity {
+				fwrite(bytes.baseAddress, 1, bytes.count, file)
+			} else {
+				buffer.append(contentsOf: bytes)
+			}
+		}
+	}
+	
+	mutating func flush() {
+		buffer.withUnsafeBufferPointer { bytes in
+			_=fwrite(bytes.baseAddress, 1, bytes.count, file)
+		}
+		buffer.removeAll(keepingCapacity: true)
+	}
+}
+
 internal final class SubHTMLExporter: NSObject, SubRenderer {
 	var context: SubContext! {
 		return sc
@@ -28,28 +63,30 @@ internal final class SubHTMLExporter: NSObject, SubRenderer {
 	}
 	
 	var sc: SubContext? = nil
-	var html: String
+	private var out: BufferedFileOutputStream
 	
-	override init() {
-		html =
+	init(file: UnsafeMutablePointer<FILE>) {
+		out = BufferedFileOutputStream(file: file)
+		super.init()
+		out.write(
 """
 <html>
 <head>
 <meta http-equiv="Content-type" content="text/html; charset=UTF-8" />
 <meta name="generator" content="ssa2html" />
 
-"""
+""")
 	}
 	
 	func didCompleteHeaderParsing(_ sc_: SubContext) {
 		sc = sc_
-		html +=
+		out.write(
 """
 <title>\(sc!.headers["Title"] ?? "")</title>
 <style type="text/css">
 .screen {width: \(sc!.resX)px; height: \(sc!.resY)px; background-color: gray; position: relative; display: table}\n.bottom {bottom: 20px; position: absolute} .top {top: 20px; position: absolute}
 
-"""
+""")
 	}
 	
 	func didCompleteStyleParsing(_ s: SubStyle) {
@@ -59,9 +96,10 @@ internal final class SubHTMLExporter: NSObject, SubRenderer {
 			let aBlue = theCol.blue * 255
 			return String(format: "#%02X%02X%02X", Int(aRed), Int(aGreen), Int(aBlue))
 		}
-		html +=
+		let cssName = escapeCSSIdentifier(s.name)
+		out.write(
 		"""
-.\(escapeCSSIdentifier(s.name)) {display: table-cell; clear: none;
+.\(cssName) {display: table-cell; clear: none;
 font-family: "\(s.fontname)"; font-size: \(s.size * (72.0/96.0))pt;
 color: \(colorToString(s.primaryColor));
 -webkit-text-stroke-color: \(colorToString(s.outlineColor));
@@ -75,17 +113,20 @@ text-align: \(s.alignH.stringValue);
 vertical-align: \(s.alignV.stringValue);
 }
 
-"""
+""")
+		
+		// every div using this style opens with the same tag, so build it once
+		s.extra = #"<span class="\#(cssName)">"#
 	}
 	
 	func endOfHead() {
-		html +=
+		out.write(
 		"""
 </style>
 </head>
 <body>
 
-"""
+""")
 	}
 	
 	func didCreateStartingSpan(_ span: SubRenderSpan, for div: SubRenderDiv) {
@@ -169,37 +210,41 @@ vertical-align: \(s.alignV.stringValue);
 			var close_div = false
 			
 			if div.isPositioned {
-				html.append("<div style=\"top: \(div.posY)px; left: \(div.posX)px; position: absolute\">")
+				out.write("<div style=\"top: \(div.posY)px; left: \(div.posX)px; position: absolute\">")
 				close_div = true
 			}
 			
-			html.append(#"<span class="\#(escapeCSSIdentifier(div.styleLine!.name))">"#)
+			if let classTag = div.styleLine!.extra as? String {
+				out.write(classTag)
+			} else {
+				out.write(#"<span class="\#(escapeCSSIdentifier(div.styleLine!.name))">"#)
+			}
 			
 			for j in 0 ..< spanCount {
 				let span = div.spans![j]
 				let ex = span.extra as! SubHTMLSpanExtra
 				let str = ex.str
 				if !str.isEmpty {
-					html.append("<span style=\"\(str)\">")
+					out.write("<span style=\"\(str)\">")
 					spans += 1
 				}
 				
 				if let divTxt = div.text {
 					let rang1 = NSMakeRange(Int(span.offset), (j == (spanCount-1)) ? divTxt.utf16.count : Int(((div.spans![j+1]).offset) - span.offset))
 					if let strRange = Range(rang1, in: divTxt) {
-						html.append(htmlfilter(divTxt[strRange]))
+						writeHTMLFiltered(divTxt[strRange])
 					}
 				}
 			}
 			
 			while spans != 0 {
-				html.append("</span>")
+				out.write("</span>")
 				spans -= 1
 			}
 			if close_div {
-				html.append("</div>")
+				out.write("</div>")
 			}
-			html.append("\n")
+			out.write("\n")
 		}
 	}
 	
@@ -209,7 +254,7 @@ vertical-align: \(s.alignV.stringValue);
 		var bottom = [SubRenderDiv]()
 		var absolute = [SubRenderDiv]()
 		
-		html.append(#"<div class="screen">\#n"#)
+		out.write(#"<div class="screen">\#n"#)
 		
 		for div in divs {
 			if div.isPositioned {
@@ -222,26 +267,36 @@ vertical-align: \(s.alignV.stringValue);
 		}
 		
 		if !top.isEmpty {
-			html.append("<div class=\"top\">\n")
+			out.write("<div class=\"top\">\n")
 			htmlify(top)
-			html.append("</div>\n")
+			out.write("</div>\n")
 		}
 		
 		if !bottom.isEmpty {
-			html.append("<div class=\"bottom\">\n")
+			out.write("<div class=\"bottom\">\n")
 			htmlify(bottom)
-			html.append("</div>\n")
+			out.write("</div>\n")
 		}
 		
 		htmlify(absolute)
 		
-		html.append("</div>\n")
+		out.write("</div>\n")
 
-		html.append("<br>\n")
+		out.write("<br>\n")
 	}
 	
 	func endOfFile() {
-		html.append("</body></html>\n")
+		out.write("</body></html>\n")
+		out.flush()
+	}
+	
+	private func writeHTMLFiltered(_ s: Substring) {
+		for (i, line) in s.split(separator: "\n", omittingEmptySubsequences: false).enumerated() {
+			if i != 0 {
+				out.write("<br>\n")
+			}
+			out.write(String(line))
+		}
 	}
 }
 
@@ -301,7 +356,3 @@ private final class SubHTMLSpanExtra: NSObject, NSCopying {
 	
 	var str = ""
 }
-
-private func htmlfilter<A: StringProtocol>(_ s: A) -> String {
-	return s.replacingOccurrences(of: "\n", with: "<br>\n")
-}
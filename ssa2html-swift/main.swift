@@ -13,20 +13,20 @@ if CommandLine.arguments.count != 2 {
 	exit(1)
 }
 
-func makeHTML(from fileURL: URL) -> String {
+func writeHTML(from fileURL: URL, to file: UnsafeMutablePointer<FILE>) -> Bool {
 	return autoreleasepool {
 		let ss = SubSerializer()
-		let htm = SubHTMLExporter()
+		let htm = SubHTMLExporter(file: file)
 		
 		//start of lameness
 		//it should only have to call subparsessafile here, or something
 		guard let header = SubLoadSSAFromURL(fileURL, ss) else {
-			return ""
+			return false
 		}
 		ss.isFinished = true
 		
 		guard let (headers, styles, _) = parseSSAFile(header) else {
-			return ""
+			return false
 		}
 		let sc = SubContext(scriptType: .SSA, headers: headers, styles: styles, delegate: htm)
 		//end(?) of lameness
@@ -50,13 +50,14 @@ func makeHTML(from fileURL: URL) -> String {
 		
 		_=sc
 		
-		return htm.html
+		return true
 	}
 }
 
 let file = CommandLine.arguments[1]
 let url = URL(fileURLWithPath: file)
 
-let html = makeHTML(from: url)
-puts(html)
+if !writeHTML(from: url, to: stdout) {
+	exit(1)
+}
 
@@ -0,0 +1,560 @@
+//
+//  main.m
+//  subtranscode
+//
+//  Created by C.W. Betts on 10/19/26.
+//  Copyright © 2026 C.W. Betts. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#include <getopt.h>
+#import <SSAMacRendering/SubImport.h>
+#import <SSAMacRendering/SubParsing.h>
+#import <SSAMacRendering/SubRenderer.h>
+#import <SSAMacRendering/SubUtilities.h>
+
+typedef NS_ENUM(int, SubTranscodeFormat) {
+	kSubTranscodeSRT,
+	kSubTranscodeWebVTT,
+	kSubTranscodeASS
+};
+
+static NSString *const outputExtensions[] = {@"srt", @"vtt", @"ass"};
+
+#pragma mark Tag mapping
+
+//! The text attributes SRT and WebVTT can express.
+@interface SubTranscodeSpanExtra : NSObject <NSCopying>
+{
+	@public;
+	BOOL bold, italic, underline, strikeout, drawing;
+}
+@end
+
+@implementation SubTranscodeSpanExtra
+-(id)copyWithZone:(NSZone*)zone
+{
+	SubTranscodeSpanExtra *ex = [SubTranscodeSpanExtra new];
+	ex->bold = bold;
+	ex->italic = italic;
+	ex->underline = underline;
+	ex->strikeout = strikeout;
+	ex->drawing = drawing;
+	return ex;
+}
+
+-(void)setFromStyle:(SubStyle*)s
+{
+	bold = s->weight != 0;
+	italic = s->italic;
+	underline = s->underline;
+	strikeout = s->strikeout;
+}
+@end
+
+//! Only records the attributes of each span; nothing is drawn.
+@interface SubTranscodeTagMapper : NSObject <SubRenderer>
+{
+	SubContext *sc;
+}
+@end
+
+@implementation SubTranscodeTagMapper
+@synthesize context=sc;
+
+- (CGFloat)aspectRatio {
+	return 4.0/3.0;
+}
+
+-(void)didCompleteHeaderParsing:(SubContext*)sc_
+{
+	sc = sc_;
+}
+
+-(void)didCreateStartingSpan:(SubRenderSpan *)span forDiv:(SubRenderDiv *)div
+{
+	SubTranscodeSpanExtra *ex = [SubTranscodeSpanExtra new];
+	[ex setFromStyle:div->styleLine];
+	span.extra = ex;
+}
+
+-(void)spanChangedTag:(SubSSATagName)tag span:(SubRenderSpan*)span div:(SubRenderDiv*)div param:(void*)p
+{
+	SubTranscodeSpanExtra *ex = span.extra;
+	int ip;
+
+	switch (tag) {
+		case tag_b:
+			ip = *(int*)p;
+			ex->bold = ip == 1 || ip >= 600;
+			break;
+		case tag_i:
+			ex->italic = *(int*)p != 0;
+			break;
+		case tag_u:
+			ex->underline = *(int*)p != 0;
+			break;
+		case tag_s:
+			ex->strikeout = *(int*)p != 0;
+			break;
+		case tag_p:
+			ex->drawing = *(float*)p > 0;
+			break;
+		case tag_r: {
+			NSString *sp = *(NSString*__unsafe_unretained*)p;
+			SubStyle *s = [sp length] ? [sc styleForName:sp] : nil;
+			[ex setFromStyle:s ? s : div->styleLine];
+			break;
+		}
+		default:
+			// positioning, colors, fonts etc. have no SRT/WebVTT equivalent
+			break;
+	}
+}
+
+- (void)renderPacket:(NSString *)packet inContext:(CGContextRef)c size:(CGSize)size {
+	//do nothing. Shouldn't even be called...
+}
+@end
+
+//! SRT files often use HTML-style tags; turn the ones we know into override tags and drop the rest.
+static NSString *SubTranscodeSRTMarkup(NSString *line)
+{
+	if ([line rangeOfString:@"<"].location == NSNotFound) return line;
+
+	NSMutableString *out = [NSMutableString stringWithCapacity:[line length]];
+	NSScanner *sc = [NSScanner scannerWithString:line];
+	NSString *res;
+
+	[sc setCharactersToBeSkipped:nil];
+
+	while (![sc isAtEnd]) {
+		if ([sc scanUpToString:@"<" intoString:&res]) [out appendString:res];
+		if ([sc isAtEnd]) break;
+
+		NSUInteger tagStart = [sc scanLocation];
+		[sc setScanLocation:tagStart+1];
+
+		if (![sc scanUpToString:@">" intoString:&res] || [sc isAtEnd]) {
+			// no closing bracket, so it wasn't a tag
+			[out appendString:[line substringFromIndex:tagStart]];
+			break;
+		}
+		[sc setScanLocation:[sc scanLocation]+1];
+
+		NSString *tag = [[res stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]] lowercaseString];
+		BOOL closing = [tag hasPrefix:@"/"];
+		if (closing) tag = [tag substringFromIndex:1];
+
+		if ([tag isEqualToString:@"b"] || [tag isEqualToString:@"i"] || [tag isEqualToString:@"u"] || [tag isEqualToString:@"s"])
+			[out appendFormat:@"{\\%@%d}", tag, !closing];
+	}
+
+	return out;
+}
+
+#pragma mark Output
+
+static void AppendTime(NSMutableString *out, NSUInteger t, NSUInteger timeScale, SubTranscodeFormat format)
+{
+	if (format == kSubTranscodeASS) {
+		NSUInteger cs = t * 100 / timeScale;
+		[out appendFormat:@"%lu:%02lu:%02lu.%02lu", (unsigned long)(cs / 360000), (unsigned long)(cs / 6000 % 60), (unsigned long)(cs / 100 % 60), (unsigned long)(cs % 100)];
+	} else {
+		NSUInteger ms = t * 1000 / timeScale;
+		[out appendFormat:@"%02lu:%02lu:%02lu%c%03lu", (unsigned long)(ms / 3600000), (unsigned long)(ms / 60000 % 60), (unsigned long)(ms / 1000 % 60), format == kSubTranscodeSRT ? ',' : '.', (unsigned long)(ms % 1000)];
+	}
+}
+
+static void AppendEscapedText(NSMutableString *out, NSString *text, NSRange range, SubTranscodeFormat format)
+{
+	NSString *s = [text substringWithRange:range];
+
+	if (format == kSubTranscodeWebVTT) {
+		NSMutableString *ms = [s mutableCopy];
+		[ms replaceOccurrencesOfString:@"&" withString:@"&amp;" options:0 range:NSMakeRange(0, [ms length])];
+		[ms replaceOccurrencesOfString:@"<" withString:@"&lt;" options:0 range:NSMakeRange(0, [ms length])];
+		[ms replaceOccurrencesOfString:@">" withString:@"&gt;" options:0 range:NSMakeRange(0, [ms length])];
+		s = ms;
+	}
+
+	[out appendString:s];
+}
+
+//! Writes a div's text with its spans' attributes as <b>/<i>/<u>/<s> tags.
+static void AppendDivMarkup(NSMutableString *out, SubRenderDiv *div, SubTranscodeFormat format)
+{
+	static NSString *const openTags[] = {@"<b>", @"<i>", @"<u>", @"<s>"};
+	static NSString *const closeTags[] = {@"</b>", @"</i>", @"</u>", @"</s>"};
+	BOOL open[4] = {NO, NO, NO, NO};
+	NSInteger spancount = [div->spans count];
+	NSUInteger textLength = [div->text length];
+
+	for (NSInteger j = 0; j < spancount; j++) {
+		SubRenderSpan *span = [div->spans objectAtIndex:j];
+		SubTranscodeSpanExtra *ex = span.extra;
+		NSUInteger end = (j == spancount-1) ? textLength : ((SubRenderSpan*)[div->spans objectAtIndex:j+1])->offset;
+		BOOL want[4] = {ex->bold, ex->italic, ex->underline, ex->strikeout};
+		int k;
+
+		if (ex->drawing || end <= span->offset) continue;
+
+		// tags have to nest, so close everything past the first change and reopen what's still wanted
+		for (k = 0; k < 4 && open[k] == want[k]; k++);
+		for (int c = 3; c >= k; c--) if (open[c]) {[out appendString:closeTags[c]]; open[c] = NO;}
+		for (; k < 4; k++) if (want[k]) {[out appendString:openTags[k]]; open[k] = YES;}
+
+		AppendEscapedText(out, div->text, NSMakeRange(span->offset, end - span->offset), format);
+	}
+
+	for (int c = 3; c >= 0; c--) if (open[c]) [out appendString:closeTags[c]];
+}
+
+static NSString *const defaultASSHeader =
+	@"[Script Info]\n"
+	"ScriptType: v4.00+\n"
+	"PlayResX: 640\n"
+	"PlayResY: 480\n"
+	"\n"
+	"[V4+ Styles]\n"
+	"Format: Name, Fontname, Fontsize, PrimaryColour, SecondaryColour, OutlineColour, BackColour, Bold, Italic, Underline, StrikeOut, ScaleX, ScaleY, Spacing, Angle, BorderStyle, Outline, Shadow, Alignment, MarginL, MarginR, MarginV, Encoding\n"
+	"Style: Default,Helvetica,32,&H00FFFFFF,&H000000FF,&H00000000,&H80000000,0,0,0,0,100,100,0,0,1,2,1,2,20,20,20,0\n"
+	"\n";
+
+@interface SubTranscodeEvent : NSObject
+{
+	@public;
+	NSString *line;
+	NSUInteger begin, end, order;
+}
+@end
+
+@implementation SubTranscodeEvent
+@end
+
+//! Whether \c header is SSA v4 rather than ASS, so the events have to be written in v4's format.
+static BOOL IsSSAv4Header(NSString *header)
+{
+	NSDictionary<NSString*,NSString*> *headers;
+	NSString *scriptType;
+
+	SubParseSSAFile(header, &headers, NULL, NULL);
+	scriptType = [headers objectForKey:@"ScriptType"];
+	if (scriptType) return [scriptType caseInsensitiveCompare:@"v4.00+"] != NSOrderedSame;
+	return [header rangeOfString:@"[V4 Styles]" options:NSCaseInsensitiveSearch].location != NSNotFound;
+}
+
+/*
+ * The serializer splits overlapping events into non-overlapping packets,
+ * so for ASS output the events are put back together: a line that shows up
+ * in consecutive packets is one event running from the first to the last.
+ */
+static NSString *TranscodeToASS(SubSerializer *ss, NSString *header, BOOL isSSA, NSUInteger timeScale)
+{
+	NSMutableString *out = [NSMutableString stringWithString:header ? header : defaultASSHeader];
+	NSMutableArray<SubTranscodeEvent*> *live = [NSMutableArray array], *done = [NSMutableArray array];
+	NSUInteger order = 0, lastEnd = 0;
+	// a copied SSA header keeps its v4 styles, so the events have to match; v4 has Marked where ASS has Layer
+	BOOL v4 = header && IsSSAv4Header(header);
+	SubLine *sl;
+
+	if (![out hasSuffix:@"\n\n"]) [out appendString:[out hasSuffix:@"\n"] ? @"\n" : @"\n\n"];
+	[out appendFormat:@"[Events]\nFormat: %@, Start, End, Style, Name, MarginL, MarginR, MarginV, Effect, Text\n", v4 ? @"Marked" : @"Layer"];
+
+	while ((sl = [ss getSerializedPacket])) @autoreleasepool {
+		NSString *packet = sl.line;
+		NSMutableArray<NSString*> *lines;
+
+		if (isSSA) {
+			lines = [[packet componentsSeparatedByString:@"\n"] mutableCopy];
+			[lines removeObject:@""];
+		} else {
+			packet = [packet substringToIndex:[packet length]-1];
+			lines = [packet length] ? [NSMutableArray arrayWithObject:packet] : [NSMutableArray array];
+		}
+
+		for (NSInteger i = 0; i < [live count]; i++) {
+			SubTranscodeEvent *ev = [live objectAtIndex:i];
+			NSUInteger idx = sl.beginTime == lastEnd ? [lines indexOfObject:ev->line] : NSNotFound;
+
+			if (idx != NSNotFound) {
+				ev->end = sl.endTime;
+				[lines removeObjectAtIndex:idx];
+			} else {
+				[done addObject:ev];
+				[live removeObjectAtIndex:i--];
+			}
+		}
+
+		for (NSString *line in lines) {
+			SubTranscodeEvent *ev = [SubTranscodeEvent new];
+			ev->line = line;
+			ev->begin = sl.beginTime;
+			ev->end = sl.endTime;
+			ev->order = order++;
+			[live addObject:ev];
+		}
+
+		lastEnd = sl.endTime;
+	}
+
+	[done addObjectsFromArray:live];
+	[done sortUsingComparator:^NSComparisonResult(SubTranscodeEvent *a, SubTranscodeEvent *b) {
+		if (a->begin != b->begin) return a->begin < b->begin ? NSOrderedAscending : NSOrderedDescending;
+		if (a->order != b->order) return a->order < b->order ? NSOrderedAscending : NSOrderedDescending;
+		return NSOrderedSame;
+	}];
+
+	for (SubTranscodeEvent *ev in done) @autoreleasepool {
+		NSString *layer = @"0", *rest;
+
+		if (isSSA) {
+			// ReadOrder,Layer,Style,Name,MarginL,MarginR,MarginV,Effect,Text
+			NSArray<NSString*> *fields = SubSplitStringWithCount(ev->line, @",", 3);
+			if ([fields count] < 3) continue;
+			layer = [fields objectAtIndex:1];
+			rest = [fields objectAtIndex:2];
+		} else {
+			NSString *text = [SubTranscodeSRTMarkup(ev->line) stringByReplacingOccurrencesOfString:@"\n" withString:@"\\N"];
+			rest = [@"Default,,0,0,0,," stringByAppendingString:text];
+		}
+
+		if (v4) [out appendString:@"Dialogue: Marked=0,"];
+		else [out appendFormat:@"Dialogue: %@,", layer];
+		AppendTime(out, ev->begin, timeScale, kSubTranscodeASS);
+		[out appendString:@","];
+		AppendTime(out, ev->end, timeScale, kSubTranscodeASS);
+		[out appendFormat:@",%@\n", rest];
+	}
+
+	return out;
+}
+
+static void AppendCue(NSMutableString *out, NSUInteger cue, NSString *text, NSUInteger begin, NSUInteger end, NSUInteger timeScale, SubTranscodeFormat format)
+{
+	if (format == kSubTranscodeSRT) [out appendFormat:@"%lu\n", (unsigned long)cue];
+	AppendTime(out, begin, timeScale, format);
+	[out appendString:@" --> "];
+	AppendTime(out, end, timeScale, format);
+	[out appendFormat:@"\n%@\n\n", text];
+}
+
+static NSString *TranscodeToCues(SubSerializer *ss, SubContext *context, SubTranscodeTagMapper *mapper, BOOL isSSA, NSUInteger timeScale, SubTranscodeFormat format)
+{
+	NSMutableString *out = [NSMutableString string];
+	NSString *lastText = nil;
+	NSUInteger lastBegin = 0, lastEnd = 0, cue = 1;
+	SubLine *sl;
+
+	if (format == kSubTranscodeWebVTT) [out appendString:@"WEBVTT\n\n"];
+
+	while ((sl = [ss getSerializedPacket])) @autoreleasepool {
+		if ([sl.line length] <= 1) continue;
+
+		NSString *packet = isSSA ? sl.line : SubTranscodeSRTMarkup(sl.line);
+		NSArray<SubRenderDiv*> *divs = SubParsePacket(packet, context, mapper);
+		NSMutableString *text = [NSMutableString string];
+
+		for (SubRenderDiv *div in divs) {
+			if (![div->text length]) continue;
+			if ([text length]) [text appendString:@"\n"];
+			AppendDivMarkup(text, div, format);
+		}
+
+		// blank lines end a cue in both formats
+		while ([text rangeOfString:@"\n\n"].location != NSNotFound)
+			[text replaceOccurrencesOfString:@"\n\n" withString:@"\n" options:0 range:NSMakeRange(0, [text length])];
+		NSString *cueText = [text stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
+		if (![cueText length]) continue;
+
+		// the serializer splits events at every overlap; merge the pieces that look the same
+		if (lastText && lastEnd == sl.beginTime && [lastText isEqualToString:cueText]) {
+			lastEnd = sl.endTime;
+			continue;
+		}
+
+		if (lastText) AppendCue(out, cue++, lastText, lastBegin, lastEnd, timeScale, format);
+		lastText = cueText;
+		lastBegin = sl.beginTime;
+		lastEnd = sl.endTime;
+	}
+
+	if (lastText) AppendCue(out, cue, lastText, lastBegin, lastEnd, timeScale, format);
+
+	return out;
+}
+
+static BOOL TranscodeFile(NSURL *inURL, NSURL *outURL, SubTranscodeFormat format, NSString **error)
+{
+	NSString *ext = [[inURL pathExtension] lowercaseString];
+	SubSerializer *ss = [[SubSerializer alloc] init];
+	SubTranscodeTagMapper *mapper = [[SubTranscodeTagMapper alloc] init];
+	SubContext *context;
+	NSString *header = nil, *result;
+	BOOL isSSA = NO;
+	NSUInteger timeScale = 1000;
+
+	if ([ext isEqualToString:@"ass"] || [ext isEqualToString:@"ssa"]) {
+		header = SubLoadSSAFromURL(inURL, ss);
+		if (!header) {
+			*error = @"couldn't read script";
+			return NO;
+		}
+		isSSA = YES;
+		timeScale = 100;
+	} else if ([ext isEqualToString:@"srt"]) {
+		SubLoadSRTFromURL(inURL, ss);
+	} else {
+		SubLoadSMIFromURL(inURL, ss, 1);
+	}
+	ss.finished = YES;
+
+	if (format == kSubTranscodeASS) {
+		result = TranscodeToASS(ss, header, isSSA, timeScale);
+	} else {
+		if (isSSA) {
+			NSDictionary *headers;
+			NSArray *styles;
+			SubParseSSAFile(header, &headers, &styles, NULL);
+			context = [[SubContext alloc] initWithScriptType:kSubTypeSSA headers:headers styles:styles delegate:mapper];
+		} else
+			context = [[SubContext alloc] initWithScriptType:kSubTypeSRT headers:nil styles:nil delegate:mapper];
+
+		result = TranscodeToCues(ss, context, mapper, isSSA, timeScale, format);
+	}
+
+	NSError *err = nil;
+	if (![[NSFileManager defaultManager] createDirectoryAtURL:[outURL URLByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:&err] ||
+		![[result dataUsingEncoding:NSUTF8StringEncoding] writeToURL:outURL options:NSDataWritingAtomic error:&err]) {
+		*error = [err localizedDescription];
+		return NO;
+	}
+
+	return YES;
+}
+
+#pragma mark -
+
+static void usage(void)
+{
+	fputs("usage: subtranscode [-f srt|vtt|ass] [-j jobs] input output\n"
+		  "  input can be a subtitle file or a directory, which is searched recursively for\n"
+		  "  .ass, .ssa, .srt and .smi files. The directory layout is kept in output.\n", stderr);
+}
+
+int main(int argc, char * const argv[])
+{
+	SubTranscodeFormat format = kSubTranscodeWebVTT;
+	NSInteger jobs = 0;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "f:j:")) != -1) {
+		switch (ch) {
+			case 'f':
+				if (!strcmp(optarg, "srt")) format = kSubTranscodeSRT;
+				else if (!strcmp(optarg, "vtt") || !strcmp(optarg, "webvtt")) format = kSubTranscodeWebVTT;
+				else if (!strcmp(optarg, "ass")) format = kSubTranscodeASS;
+				else {usage(); return 1;}
+				break;
+			case 'j':
+				jobs = atoi(optarg);
+				break;
+			default:
+				usage();
+				return 1;
+		}
+	}
+
+	if (argc - optind != 2) {
+		usage();
+		return 1;
+	}
+
+	@autoreleasepool {
+		NSFileManager *fm = [NSFileManager defaultManager];
+		NSURL *inURL = [[NSURL fileURLWithFileSystemRepresentation:argv[optind] isDirectory:NO relativeToURL:nil] URLByResolvingSymlinksInPath];
+		NSURL *outURL = [NSURL fileURLWithFileSystemRepresentation:argv[optind+1] isDirectory:YES relativeToURL:nil];
+		NSSet<NSString*> *inputExtensions = [NSSet setWithObjects:@"ass", @"ssa", @"srt", @"smi", nil];
+		NSMutableArray<NSString*> *paths = [NSMutableArray array]; // relative to inURL
+		BOOL isDir = NO;
+
+		if (![fm fileExistsAtPath:[inURL path] isDirectory:&isDir]) {
+			fprintf(stderr, "%s: no such file or directory\n", argv[optind]);
+			return 1;
+		}
+
+		if (isDir) {
+			NSDirectoryEnumerator<NSURL*> *en = [fm enumeratorAtURL:inURL includingPropertiesForKeys:@[NSURLIsRegularFileKey] options:NSDirectoryEnumerationSkipsHiddenFiles errorHandler:nil];
+			NSString *base = [inURL path];
+
+			if (![base hasSuffix:@"/"]) base = [base stringByAppendingString:@"/"];
+
+			for (NSURL *url in en) {
+				NSNumber *isFile;
+				NSString *path = [url path];
+				[url getResourceValue:&isFile forKey:NSURLIsRegularFileKey error:NULL];
+				if (![isFile boolValue] || ![inputExtensions containsObject:[[url pathExtension] lowercaseString]]) continue;
+
+				// the enumerator's URLs start with inURL as it was given, which is already resolved,
+				// so the file's own symlinks are kept; resolving them could leave the directory
+				if ([path hasPrefix:base]) [paths addObject:[path substringFromIndex:[base length]]];
+				else fprintf(stderr, "%s: skipping, not under the input directory\n", [path fileSystemRepresentation]);
+			}
+			// enumeration order isn't defined; sort so reports come out the same every time
+			[paths sortUsingSelector:@selector(compare:)];
+		} else {
+			[paths addObject:[inURL lastPathComponent]];
+			inURL = [inURL URLByDeletingLastPathComponent];
+		}
+
+		NSUInteger count = [paths count];
+		NSMutableArray *errors = [NSMutableArray arrayWithCapacity:count];
+		__block unsigned long long totalBytes = 0;
+		NSLock *statsLock = [NSLock new];
+		NSOperationQueue *queue = [NSOperationQueue new];
+
+		for (NSUInteger i = 0; i < count; i++) [errors addObject:[NSNull null]];
+		queue.maxConcurrentOperationCount = jobs > 0 ? jobs : [[NSProcessInfo processInfo] activeProcessorCount];
+
+		CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+
+		for (NSUInteger i = 0; i < count; i++) {
+			NSString *path = [paths objectAtIndex:i];
+
+			[queue addOperationWithBlock:^{
+				@autoreleasepool {
+					NSURL *src = [inURL URLByAppendingPathComponent:path];
+					NSURL *dst = [[outURL URLByAppendingPathComponent:[path stringByDeletingPathExtension]] URLByAppendingPathExtension:outputExtensions[format]];
+					NSNumber *size = nil;
+					NSString *error = nil;
+
+					[src getResourceValue:&size forKey:NSURLFileSizeKey error:NULL];
+					BOOL ok = TranscodeFile(src, dst, format, &error);
+
+					[statsLock lock];
+					totalBytes += [size unsignedLongLongValue];
+					if (!ok) [errors replaceObjectAtIndex:i withObject:error];
+					[statsLock unlock];
+				}
+			}];
+		}
+
+		[queue waitUntilAllOperationsAreFinished];
+
+		CFAbsoluteTime elapsed = MAX(CFAbsoluteTimeGetCurrent() - start, 1e-6);
+		NSUInteger failed = 0;
+
+		for (NSUInteger i = 0; i < count; i++) {
+			id error = [errors objectAtIndex:i];
+			if (error == [NSNull null]) continue;
+			fprintf(stderr, "%s: %s\n", [[paths objectAtIndex:i] fileSystemRepresentation], [error UTF8String]);
+			failed++;
+		}
+
+		double mb = totalBytes / (1024. * 1024.);
+		fprintf(stderr, "%lu files (%lu failed), %.2f MB in %.3f s: %.1f files/s, %.2f MB/s\n",
+				(unsigned long)count, (unsigned long)failed, mb, elapsed, count / elapsed, mb / elapsed);
+
+		return failed ? 1 : 0;
+	}
+}